@@ -0,0 +1,301 @@
+/*
+ * bench.h — Tiny self-contained harness for the zerror.h benchmarks.
+ *
+ * Each case runs a function for N iterations. N is calibrated until one run
+ * takes at least BENCH_MIN_NS, and the best of BENCH_RUNS runs is reported as
+ * ns/op, cycles/op (x86 TSC, 0 elsewhere) and heap allocations/op (counted
+ * through the Z_MALLOC hooks). Pass "--json <file>" to also write the results
+ * as a JSON array, for comparing releases.
+ *
+ * Include this instead of zerror.h; it brings in the implementation.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#   define BENCH_TSC() __rdtsc()
+#elif defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#   define BENCH_TSC() __rdtsc()
+#else
+#   define BENCH_TSC() 0ULL
+#endif
+
+#ifndef BENCH_MIN_NS
+#   define BENCH_MIN_NS 50000000ULL
+#endif
+
+#ifndef BENCH_RUNS
+#   define BENCH_RUNS 5
+#endif
+
+// Counting allocator, installed through the zerror.h allocator hooks.
+static void *bench_malloc(size_t n);
+static void *bench_calloc(size_t n, size_t sz);
+static void *bench_realloc(void *p, size_t n);
+
+#define Z_MALLOC(sz)       bench_malloc(sz)
+#define Z_CALLOC(n, sz)    bench_calloc(n, sz)
+#define Z_REALLOC(p, sz)   bench_realloc(p, sz)
+#define Z_FREE(p)          free(p)
+
+#define ZERROR_IMPLEMENTATION
+#include "zerror.h"
+
+static unsigned long long bench_allocs = 0;
+
+static void *bench_malloc(size_t n)
+{
+    ZERROR_ATOMIC_ADD(&bench_allocs, 1);
+    return malloc(n);
+}
+
+static void *bench_calloc(size_t n, size_t sz)
+{
+    ZERROR_ATOMIC_ADD(&bench_allocs, 1);
+    return calloc(n, sz);
+}
+
+static void *bench_realloc(void *p, size_t n)
+{
+    ZERROR_ATOMIC_ADD(&bench_allocs, 1);
+    return realloc(p, n);
+}
+
+// Keeps a value alive without letting the compiler see through it.
+#if defined(__GNUC__) || defined(__clang__)
+#   define BENCH_KEEP(x) __asm__ __volatile__("" : : "g"(x) : "memory")
+#   define BENCH_NOINLINE __attribute__((noinline))
+#else
+static volatile long long bench_sink_;
+#   define BENCH_KEEP(x) (bench_sink_ = (long long)(x))
+#   define BENCH_NOINLINE __declspec(noinline)
+#endif
+
+typedef void (*bench_fn)(unsigned long long iters, void *ctx);
+
+typedef struct
+{
+    char name[64];
+    int threads;
+    unsigned long long iters;
+    double ns_per_op;
+    double cycles_per_op;
+    double allocs_per_op;
+} bench_result;
+
+#define BENCH_MAX_RESULTS 128
+
+static bench_result bench_results[BENCH_MAX_RESULTS];
+static int bench_count = 0;
+static const char *bench_json_path = NULL;
+static const char *bench_filter = NULL;
+static const char *bench_pending_section = NULL;
+
+static unsigned long long bench_now_ns(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+// Threaded runs: every worker waits at the gate, then runs 'iters' iterations.
+typedef struct
+{
+    bench_fn fn;
+    void *ctx;
+    unsigned long long iters;
+    unsigned long long *gate;
+} bench_worker;
+
+#if defined(_WIN32)
+static DWORD WINAPI bench_worker_main(LPVOID arg)
+#else
+static void *bench_worker_main(void *arg)
+#endif
+{
+    bench_worker *w = (bench_worker *)arg;
+    while (!ZERROR_ATOMIC_LOAD(w->gate))
+    {
+    }
+    w->fn(w->iters, w->ctx);
+    return 0;
+}
+
+static void bench_run_once(bench_fn fn, void *ctx, int threads, unsigned long long iters,
+                           unsigned long long *ns, unsigned long long *cycles, unsigned long long *allocs)
+{
+    unsigned long long a0 = ZERROR_ATOMIC_LOAD(&bench_allocs);
+    if (threads <= 1)
+    {
+        unsigned long long c0 = BENCH_TSC();
+        unsigned long long t0 = bench_now_ns();
+        fn(iters, ctx);
+        *ns = bench_now_ns() - t0;
+        *cycles = BENCH_TSC() - c0;
+    }
+    else
+    {
+        unsigned long long gate = 0;
+        bench_worker workers[64];
+#       if defined(_WIN32)
+        HANDLE handles[64];
+#       else
+        pthread_t handles[64];
+#       endif
+        for (int i = 0; i < threads; i++)
+        {
+            workers[i].fn = fn;
+            workers[i].ctx = ctx;
+            workers[i].iters = iters;
+            workers[i].gate = &gate;
+#           if defined(_WIN32)
+            handles[i] = CreateThread(NULL, 0, bench_worker_main, &workers[i], 0, NULL);
+#           else
+            pthread_create(&handles[i], NULL, bench_worker_main, &workers[i]);
+#           endif
+        }
+        unsigned long long c0 = BENCH_TSC();
+        unsigned long long t0 = bench_now_ns();
+        ZERROR_ATOMIC_STORE(&gate, 1);
+        for (int i = 0; i < threads; i++)
+        {
+#           if defined(_WIN32)
+            WaitForSingleObject(handles[i], INFINITE);
+            CloseHandle(handles[i]);
+#           else
+            pthread_join(handles[i], NULL);
+#           endif
+        }
+        *ns = bench_now_ns() - t0;
+        *cycles = BENCH_TSC() - c0;
+    }
+    *allocs = ZERROR_ATOMIC_LOAD(&bench_allocs) - a0;
+}
+
+/*
+ * Runs one case. With threads > 1 every thread does 'iters' iterations and the
+ * reported ns/op is wall time over all operations (so a flat number means
+ * perfect scaling and a rising one means contention).
+ */
+static void bench_run_threads(const char *name, bench_fn fn, void *ctx, int threads)
+{
+    if (bench_filter && !strstr(name, bench_filter))
+    {
+        return;
+    }
+    if (bench_pending_section)
+    {
+        printf("\n%s\n", bench_pending_section);
+        bench_pending_section = NULL;
+    }
+    if (threads > 64)
+    {
+        threads = 64;
+    }
+
+    unsigned long long iters = 16, ns = 0, cycles = 0, allocs = 0;
+    for (;;)
+    {
+        bench_run_once(fn, ctx, threads, iters, &ns, &cycles, &allocs);
+        if (ns >= BENCH_MIN_NS / (unsigned long long)threads || iters >= (1ULL << 40))
+        {
+            break;
+        }
+        iters *= (ns < BENCH_MIN_NS / 64) ? 8 : 2;
+    }
+
+    double ops = (double)iters * (double)threads;
+    bench_result r;
+    memset(&r, 0, sizeof(r));
+    snprintf(r.name, sizeof(r.name), "%s", name);
+    r.threads = threads;
+    r.iters = iters;
+    r.ns_per_op = (double)ns / ops;
+    r.cycles_per_op = (double)cycles / ops;
+    r.allocs_per_op = (double)allocs / ops;
+    for (int run = 1; run < BENCH_RUNS; run++)
+    {
+        bench_run_once(fn, ctx, threads, iters, &ns, &cycles, &allocs);
+        if ((double)ns / ops < r.ns_per_op)
+        {
+            r.ns_per_op = (double)ns / ops;
+            r.cycles_per_op = (double)cycles / ops;
+            r.allocs_per_op = (double)allocs / ops;
+        }
+    }
+
+    printf("  %-44s %3d  %10.2f ns/op  %10.1f cyc/op  %8.3f allocs/op\n", 
+           r.name, r.threads, r.ns_per_op, r.cycles_per_op, r.allocs_per_op);
+    fflush(stdout);
+    if (bench_count < BENCH_MAX_RESULTS)
+    {
+        bench_results[bench_count++] = r;
+    }
+}
+
+static void bench_run(const char *name, bench_fn fn, void *ctx)
+{
+    bench_run_threads(name, fn, ctx, 1);
+}
+
+// Printed before the next case that passes the filter.
+static void bench_section(const char *title)
+{
+    bench_pending_section = title;
+}
+
+// Usage: <bench> [--json file] [filter]
+static void bench_begin(const char *suite, int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "--json") && i + 1 < argc)
+        {
+            bench_json_path = argv[++i];
+        }
+        else
+        {
+            bench_filter = argv[i];
+        }
+    }
+    (void)bench_realloc;
+    printf("=> Running benchmarks (zerror.h, %s).\n", suite);
+    printf("  %-44s %3s  %16s  %17s  %18s\n", "case", "thr", "time", "cycles", "allocations");
+}
+
+static int bench_end(const char *suite)
+{
+    if (!bench_json_path)
+    {
+        return 0;
+    }
+    FILE *fp = fopen(bench_json_path, "w");
+    if (!fp)
+    {
+        perror(bench_json_path);
+        return 1;
+    }
+    fprintf(fp, "{\n  \"suite\": \"%s\",\n  \"results\": [\n", suite);
+    for (int i = 0; i < bench_count; i++)
+    {
+        const bench_result *r = &bench_results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"threads\": %d, \"iters\": %llu, \"ns_per_op\": %.3f, "
+                    "\"cycles_per_op\": %.1f, \"allocs_per_op\": %.4f}%s\n",
+                r->name, r->threads, r->iters, r->ns_per_op, r->cycles_per_op, r->allocs_per_op,
+                (i + 1 < bench_count) ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+    printf("=> Wrote %s.\n", bench_json_path);
+    return 0;
+}
+
+#endif // BENCH_H
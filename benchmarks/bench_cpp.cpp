@@ -0,0 +1,304 @@
+#include <string>
+#include <vector>
+#if __cplusplus >= 201703L
+#   include <optional>
+#endif
+#if __cplusplus > 202002L && __has_include(<expected>)
+#   include <expected>
+#endif
+#include "bench.h"
+
+using z_error::result;
+
+// result<T> construction and moves against returning T directly.
+
+static BENCH_NOINLINE result<int> make_int(int v, bool fail)
+{
+    if (fail)
+    {
+        return zerr_create(400, "Bad input");
+    }
+    return v;
+}
+
+static BENCH_NOINLINE int make_int_plain(int v, bool fail, int *out)
+{
+    if (fail)
+    {
+        return -400;
+    }
+    *out = v;
+    return 0;
+}
+
+static BENCH_NOINLINE result<std::string> make_string(const char *s)
+{
+    return std::string(s);
+}
+
+static BENCH_NOINLINE std::string make_string_plain(const char *s)
+{
+    return std::string(s);
+}
+
+#if __cplusplus >= 201703L
+static BENCH_NOINLINE std::optional<int> make_int_optional(int v, bool fail)
+{
+    if (fail)
+    {
+        return std::nullopt;
+    }
+    return v;
+}
+#endif
+
+#if defined(__cpp_lib_expected)
+static BENCH_NOINLINE std::expected<int, zerr> make_int_expected(int v, bool fail)
+{
+    if (fail)
+    {
+        return std::unexpected(zerr_create(400, "Bad input"));
+    }
+    return v;
+}
+#endif
+
+static BENCH_NOINLINE result<int> chain(int depth, bool fail)
+{
+    if (0 == depth)
+    {
+        return make_int(1, fail);
+    }
+    result<int> r = chain(depth - 1, fail);
+    if (!r.ok())
+    {
+        return r.err;
+    }
+    return r.unwrap_val() + 1;
+}
+
+static void bench_result_int_ok(unsigned long long iters, void *)
+{
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        result<int> r = make_int((int)i, false);
+        BENCH_KEEP(r.unwrap_val());
+    }
+}
+
+static void bench_plain_int_ok(unsigned long long iters, void *)
+{
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        int v = 0;
+        int rc = make_int_plain((int)i, false, &v);
+        BENCH_KEEP(rc);
+        BENCH_KEEP(v);
+    }
+}
+
+static void bench_result_int_err(unsigned long long iters, void *)
+{
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        result<int> r = make_int((int)i, true);
+        BENCH_KEEP(r.ok());
+    }
+}
+
+#if __cplusplus >= 201703L
+static void bench_optional_int_ok(unsigned long long iters, void *)
+{
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        std::optional<int> r = make_int_optional((int)i, false);
+        BENCH_KEEP(*r);
+    }
+}
+#endif
+
+#if defined(__cpp_lib_expected)
+static void bench_expected_int_ok(unsigned long long iters, void *)
+{
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        std::expected<int, zerr> r = make_int_expected((int)i, false);
+        BENCH_KEEP(*r);
+    }
+}
+
+static void bench_expected_int_err(unsigned long long iters, void *)
+{
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        std::expected<int, zerr> r = make_int_expected((int)i, true);
+        BENCH_KEEP(r.has_value());
+    }
+}
+#endif
+
+static void bench_result_string(unsigned long long iters, void *)
+{
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        result<std::string> r = make_string("a string long enough to skip SSO");
+        result<std::string> moved(std::move(r));
+        BENCH_KEEP(moved.unwrap_val().size());
+    }
+}
+
+static void bench_plain_string(unsigned long long iters, void *)
+{
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        std::string s = make_string_plain("a string long enough to skip SSO");
+        std::string moved(std::move(s));
+        BENCH_KEEP(moved.size());
+    }
+}
+
+static void bench_result_vector_move(unsigned long long iters, void *ctx)
+{
+    const std::vector<int> &seed = *(const std::vector<int> *)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        result<std::vector<int>> r(seed);
+        result<std::vector<int>> a(std::move(r));
+        result<std::vector<int>> b(std::move(a));
+        BENCH_KEEP(b.unwrap_val().data());
+    }
+}
+
+// Grows a vector of results; a noexcept move keeps reallocation from copying.
+static void bench_result_vector_grow(unsigned long long iters, void *)
+{
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        std::vector<result<std::string>> v;
+        for (int j = 0; j < 16; j++)
+        {
+            v.push_back(result<std::string>(std::string("a string long enough to skip SSO")));
+        }
+        BENCH_KEEP(v.data());
+    }
+}
+
+// Three fallible steps, written by hand and as a combinator pipeline.
+static void bench_steps_manual(unsigned long long iters, void *)
+{
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        int out = -1;
+        result<int> a = make_int((int)i, false);
+        if (a.ok())
+        {
+            result<int> b = make_int(a.unwrap_val() + 1, false);
+            if (b.ok())
+            {
+                out = b.unwrap_val() * 2;
+            }
+        }
+        BENCH_KEEP(out);
+    }
+}
+
+static void bench_steps_combinators(unsigned long long iters, void *)
+{
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        int out = make_int((int)i, false)
+            .and_then([](int v) { return make_int(v + 1, false); })
+            .transform([](int v) { return v * 2; })
+            .value_or(-1);
+        BENCH_KEEP(out);
+    }
+}
+
+static void bench_log_printf(unsigned long long iters, void *)
+{
+    std::string path = "/index";
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        log_info("request %llu to %s served in %d ms", i, path.c_str(), 12);
+    }
+}
+
+static void bench_log_fmt(unsigned long long iters, void *)
+{
+    std::string path = "/index";
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        log_info_fmt("request {} to {} served in {} ms", i, path, 12);
+    }
+}
+
+static void bench_chain_ok(unsigned long long iters, void *ctx)
+{
+    int depth = *(const int *)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        result<int> r = chain(depth, false);
+        BENCH_KEEP(r.ok());
+    }
+}
+
+static void bench_chain_err(unsigned long long iters, void *ctx)
+{
+    int depth = *(const int *)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        result<int> r = chain(depth, true);
+        BENCH_KEEP(r.ok());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bench_begin("cpp", argc, argv);
+
+    bench_section("result<T> construction and moves");
+    bench_run("int return code (ok)", bench_plain_int_ok, NULL);
+    bench_run("result<int> (ok)", bench_result_int_ok, NULL);
+    bench_run("result<int> (err)", bench_result_int_err, NULL);
+#if __cplusplus >= 201703L
+    bench_run("std::optional<int> (ok)", bench_optional_int_ok, NULL);
+#endif
+#if defined(__cpp_lib_expected)
+    bench_run("std::expected<int, zerr> (ok)", bench_expected_int_ok, NULL);
+    bench_run("std::expected<int, zerr> (err)", bench_expected_int_err, NULL);
+#endif
+    bench_run("std::string make + move", bench_plain_string, NULL);
+    bench_run("result<std::string> make + move", bench_result_string, NULL);
+    std::vector<int> seed(64, 7);
+    bench_run("result<std::vector<int>> copy + 2 moves", bench_result_vector_move, &seed);
+    bench_run("vector<result<std::string>> grow to 16", bench_result_vector_grow, NULL);
+
+    bench_section("result<int> pipelines");
+    bench_run("3 steps, if (!r.ok()) checks", bench_steps_manual, NULL);
+    bench_run("3 steps, and_then/transform", bench_steps_combinators, NULL);
+
+    bench_section("result<int> propagation");
+    static const int depths[] = { 1, 4, 16 };
+    char name[64];
+    for (int d : depths)
+    {
+        int depth = d;
+        snprintf(name, sizeof(name), "result<int> depth %d (ok)", d);
+        bench_run(name, bench_chain_ok, &depth);
+        snprintf(name, sizeof(name), "result<int> depth %d (err)", d);
+        bench_run(name, bench_chain_err, &depth);
+    }
+
+    bench_section("C++ logging (text ring sink)");
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_NONE);
+    zlog_sink_config cfg = {};
+    cfg.kind = ZLOG_SINK_RING;
+    cfg.level = ZLOG_TRACE;
+    cfg.format = ZLOG_FORMAT_TEXT;
+    cfg.size = 1 << 20;
+    zlog_add_sink(&cfg);
+    bench_run("log_info (printf)", bench_log_printf, NULL);
+    bench_run("log_info_fmt ({})", bench_log_fmt, NULL);
+
+    return bench_end("cpp");
+}
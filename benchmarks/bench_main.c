@@ -0,0 +1,345 @@
+#define ZERROR_ENABLE_TRACE
+#include "bench.h"
+
+// Built twice by `make bench`: with the full zerr layout and with ZERROR_COMPACT.
+#ifdef ZERROR_COMPACT
+#   define BENCH_SUITE "c-compact"
+#else
+#   define BENCH_SUITE "c"
+#endif
+
+// Error creation.
+
+static void bench_create_eager(unsigned long long iters, void *ctx)
+{
+    (void)ctx;
+    zerr_set_lazy_format(false);
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        zerr e = zerr_create(404, "User %d not found in %s", (int)i, "accounts");
+        BENCH_KEEP(e.code);
+    }
+}
+
+static void bench_create_lazy(unsigned long long iters, void *ctx)
+{
+    (void)ctx;
+    zerr_set_lazy_format(true);
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        zerr e = zerr_create(404, "User %d not found in %s", (int)i, "accounts");
+        BENCH_KEEP(e.code);
+    }
+    zerr_set_lazy_format(false);
+}
+
+static void bench_create_plain(unsigned long long iters, void *ctx)
+{
+    (void)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        zerr e = zerr_create(500, "Internal Server Error");
+        BENCH_KEEP(e.code);
+    }
+}
+
+static void bench_wrap(unsigned long long iters, void *ctx)
+{
+    (void)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        zerr e = zerr_create(404, "Not found");
+        e = zerr_wrap(e, "loading config %d", (int)i);
+        BENCH_KEEP(e.code);
+    }
+}
+
+static void bench_clone(unsigned long long iters, void *ctx)
+{
+    (void)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        zerr e = zerr_create(404, "Not found");
+        e = zerr_wrap(e, "loading config %d", (int)i);
+        zerr_owned *o = zerr_clone(e);
+        BENCH_KEEP(zerr_owned_code(o));
+        zerr_free(o);
+    }
+}
+
+static void bench_print_msg(unsigned long long iters, void *ctx)
+{
+    (void)ctx;
+    zerr_set_lazy_format(true);
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        zerr e = zerr_create(404, "User %d not found", (int)i);
+        BENCH_KEEP(zerr_msg(e));
+    }
+    zerr_set_lazy_format(false);
+}
+
+// Propagation through N frames: zres + ZERROR_CHECK against plain int codes.
+
+static BENCH_NOINLINE zres chain_zres(int depth, bool fail)
+{
+    if (0 == depth)
+    {
+        return fail ? zres_err(zerr_create(400, "Bad input")) : zres_ok();
+    }
+    ZERROR_CHECK(chain_zres(depth - 1, fail), "chain_zres(depth - 1, fail)");
+    return zres_ok();
+}
+
+static BENCH_NOINLINE int chain_int(int depth, bool fail)
+{
+    if (0 == depth)
+    {
+        return fail ? -400 : 0;
+    }
+    int rc = chain_int(depth - 1, fail);
+    if (rc != 0)
+    {
+        return rc;
+    }
+    return 0;
+}
+
+DEFINE_RESULT(int, BenchInt)
+
+static BENCH_NOINLINE BenchInt chain_try(int depth, bool fail)
+{
+    if (0 == depth)
+    {
+        return fail ? BenchInt_err(zerr_create(400, "Bad input")) : BenchInt_ok(1);
+    }
+    int v = ZERROR_TRY(chain_try(depth - 1, fail), "chain_try(depth - 1, fail)");
+    return BenchInt_ok(v + 1);
+}
+
+DEFINE_RESULT_SLIM(int, BenchSlim)
+
+static BENCH_NOINLINE BenchSlim chain_slim(int depth, bool fail)
+{
+    if (0 == depth)
+    {
+        return fail ? BenchSlim_err(zerr_create(400, "Bad input")) : BenchSlim_ok(1);
+    }
+    int v = ZERROR_TRY_SLIM(chain_slim(depth - 1, fail), "chain_slim(depth - 1, fail)");
+    return BenchSlim_ok(v + 1);
+}
+
+typedef struct
+{
+    int depth;
+    bool fail;
+} chain_ctx;
+
+static void bench_chain_zres(unsigned long long iters, void *ctx)
+{
+    const chain_ctx *c = (const chain_ctx *)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        zres r = chain_zres(c->depth, c->fail);
+        BENCH_KEEP(r.is_ok);
+    }
+}
+
+static void bench_chain_try(unsigned long long iters, void *ctx)
+{
+    const chain_ctx *c = (const chain_ctx *)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        BenchInt r = chain_try(c->depth, c->fail);
+        BENCH_KEEP(r.is_ok);
+    }
+}
+
+static void bench_chain_slim(unsigned long long iters, void *ctx)
+{
+    const chain_ctx *c = (const chain_ctx *)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        BenchSlim r = chain_slim(c->depth, c->fail);
+        BENCH_KEEP(r.is_ok);
+    }
+}
+
+static void bench_chain_int(unsigned long long iters, void *ctx)
+{
+    const chain_ctx *c = (const chain_ctx *)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        int rc = chain_int(c->depth, c->fail);
+        BENCH_KEEP(rc);
+    }
+}
+
+// One call and return, success path: the result layout alone.
+
+static BENCH_NOINLINE BenchInt ret_full(int v)
+{
+    return BenchInt_ok(v);
+}
+
+static BENCH_NOINLINE BenchSlim ret_slim(int v)
+{
+    return BenchSlim_ok(v);
+}
+
+static BENCH_NOINLINE int ret_int(int v, int *out)
+{
+    *out = v;
+    return 0;
+}
+
+static void bench_ret_full(unsigned long long iters, void *ctx)
+{
+    (void)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        BenchInt r = ret_full((int)i);
+        BENCH_KEEP(r.val);
+    }
+}
+
+static void bench_ret_slim(unsigned long long iters, void *ctx)
+{
+    (void)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        BenchSlim r = ret_slim((int)i);
+        BENCH_KEEP(r.val);
+    }
+}
+
+static void bench_ret_int(unsigned long long iters, void *ctx)
+{
+    (void)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        int v = 0;
+        int rc = ret_int((int)i, &v);
+        BENCH_KEEP(rc);
+        BENCH_KEEP(v);
+    }
+}
+
+// Logging.
+
+static void bench_log_filtered(unsigned long long iters, void *ctx)
+{
+    (void)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        log_debug("filtered %llu", i);
+    }
+}
+
+static void bench_log_info(unsigned long long iters, void *ctx)
+{
+    (void)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        log_info("request %llu served in %d ms", i, 12);
+    }
+}
+
+static void bench_log_kv(unsigned long long iters, void *ctx)
+{
+    (void)ctx;
+    for (unsigned long long i = 0; i < iters; i++)
+    {
+        log_info_kv("request served", ZKV_UINT("id", i), ZKV_INT("ms", 12), ZKV_STR("path", "/index"));
+    }
+}
+
+static int bench_ring_sink(zlog_format format)
+{
+    zlog_sink_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.kind = ZLOG_SINK_RING;
+    cfg.level = ZLOG_TRACE;
+    cfg.format = format;
+    cfg.size = 1 << 20;
+    return zlog_add_sink(&cfg);
+}
+
+static void bench_logging(const char *mode, int max_threads)
+{
+    char name[64];
+    for (int t = 1; t <= max_threads; t *= 2)
+    {
+        snprintf(name, sizeof(name), "log_info %s x%d", mode, t);
+        bench_run_threads(name, bench_log_info, NULL, t);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bench_begin(BENCH_SUITE, argc, argv);
+
+    bench_section("Error creation");
+    bench_run("zerr_create (literal)", bench_create_plain, NULL);
+    bench_run("zerr_create (formatted, eager)", bench_create_eager, NULL);
+    bench_run("zerr_create (formatted, lazy)", bench_create_lazy, NULL);
+    bench_run("zerr_create + zerr_msg (lazy)", bench_print_msg, NULL);
+    bench_run("zerr_create + zerr_wrap", bench_wrap, NULL);
+    bench_run("zerr_create + zerr_wrap + zerr_clone/free", bench_clone, NULL);
+
+    bench_section("Result return (success path)");
+    bench_run("int code + out param", bench_ret_int, NULL);
+    bench_run("DEFINE_RESULT(int)", bench_ret_full, NULL);
+    bench_run("DEFINE_RESULT_SLIM(int)", bench_ret_slim, NULL);
+
+    bench_section("Propagation (ZERROR_CHECK / ZERROR_TRY vs int codes)");
+    static const int depths[] = { 1, 4, 16 };
+    char name[64];
+    for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++)
+    {
+        for (int fail = 0; fail <= 1; fail++)
+        {
+            chain_ctx c = { depths[d], fail != 0 };
+            const char *path = fail ? "err" : "ok";
+            snprintf(name, sizeof(name), "int codes depth %d (%s)", depths[d], path);
+            bench_run(name, bench_chain_int, &c);
+            snprintf(name, sizeof(name), "zres CHECK depth %d (%s)", depths[d], path);
+            bench_run(name, bench_chain_zres, &c);
+            snprintf(name, sizeof(name), "result TRY depth %d (%s)", depths[d], path);
+            bench_run(name, bench_chain_try, &c);
+            snprintf(name, sizeof(name), "slim TRY depth %d (%s)", depths[d], path);
+            bench_run(name, bench_chain_slim, &c);
+        }
+    }
+
+    // Keep the console out of the numbers: everything goes to in-memory rings.
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_NONE);
+    zlog_set_level(ZLOG_INFO);
+    bench_ring_sink(ZLOG_FORMAT_TEXT);
+
+    bench_section("Logging");
+    bench_run("log_debug (filtered)", bench_log_filtered, NULL);
+    zlog_set_flight_level(ZLOG_TRACE);
+    bench_run("log_debug -> flight recorder", bench_log_filtered, NULL);
+    zlog_flight_clear();
+    zlog_set_flight_level(ZLOG_NONE);
+    bench_run("log_info -> text ring", bench_log_info, NULL);
+    bench_run("log_info_kv -> text ring", bench_log_kv, NULL);
+    bench_ring_sink(ZLOG_FORMAT_JSON);
+    bench_run("log_info_kv -> text + json rings", bench_log_kv, NULL);
+    zlog_shutdown();
+
+    bench_section("Logging scaling (ns/op over all threads)");
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_NONE);
+    bench_ring_sink(ZLOG_FORMAT_TEXT);
+    bench_logging("sync", 8);
+    zlog_shutdown();
+
+    zlog_init_async(NULL, ZLOG_INFO, 1 << 16, ZLOG_OVERFLOW_BLOCK);
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_NONE);
+    bench_ring_sink(ZLOG_FORMAT_TEXT);
+    bench_logging("async", 8);
+    zlog_shutdown();
+
+    return bench_end(BENCH_SUITE);
+}
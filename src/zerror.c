@@ -33,6 +33,7 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 
@@ -43,6 +44,19 @@
 #   include <type_traits>
 #   include <utility>
 #   include <new>
+#   if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#       include <string_view>
+#   endif
+#   if defined(__cpp_impl_coroutine) && defined(__has_include)
+#       if __has_include(<coroutine>)
+#           include <coroutine>
+#           define ZERROR_HAS_COROUTINES 1
+#       endif
+#   endif
+#endif
+
+#ifndef ZERROR_HAS_COROUTINES
+#   define ZERROR_HAS_COROUTINES 0
 #endif
 
 #ifdef __cplusplus
@@ -69,6 +83,38 @@ extern "C" {
 #   define ZERROR_UID(prefix) Z_CONCAT(prefix, __LINE__)
 #endif
 
+// Branch hints and printf-style argument checking.
+#if defined(__GNUC__) || defined(__clang__)
+#   define ZERROR_LIKELY(x)   __builtin_expect(!!(x), 1)
+#   define ZERROR_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#   define ZERROR_PRINTF(f, a) __attribute__((format(printf, f, a)))
+#else
+#   define ZERROR_LIKELY(x)   (x)
+#   define ZERROR_UNLIKELY(x) (x)
+#   define ZERROR_PRINTF(f, a)
+#endif
+
+// Allocator hooks (Guarded to avoid zcommon.h conflicts).
+#ifndef Z_MALLOC
+#   define Z_MALLOC(sz)       malloc(sz)
+#   define Z_CALLOC(n, sz)    calloc(n, sz)
+#   define Z_REALLOC(p, sz)   realloc(p, sz)
+#   define Z_FREE(p)          free(p)
+#endif
+
+// Return codes shared by the z-libs (also guarded against zcommon.h).
+#ifndef Z_OK
+#   define Z_OK          0
+#   define Z_FOUND       1
+#   define Z_ERR        -1
+#   define Z_ENOMEM     -2
+#   define Z_EOOB       -3
+#   define Z_EEMPTY     -4
+#   define Z_ENOTFOUND  -5
+#   define Z_EINVAL     -6
+#   define Z_EEXIST     -7
+#endif
+
 /// @section API Reference (C)
 ///
 /// @section Logging
@@ -76,11 +122,30 @@ extern "C" {
 /// @columns Function / Macro | Description
 /// @row `zlog_init(path, level)` | Initializes logging to a file (optional) and sets min level.
 /// @row `zlog_set_level(level)` | Sets the minimum logging level at runtime.
+/// @row `zlog_set_time_mode(mode)` | Chooses local time, UTC, or epoch nanoseconds for timestamps.
+/// @row `zlog_init_async(path, level, cap, policy)` | Like `zlog_init`, but hands records to a background writer thread.
+/// @row `zlog_flush()` | Blocks until every queued record has been written (no-op in sync mode).
+/// @row `zlog_shutdown()` | Drains the queue, stops the writer thread and closes the log file.
+/// @row `zlog_dropped()` | Returns the number of records discarded by the overflow policy.
+/// @row `zlog_init_binary(path, level)` | Writes records in compact binary form instead of text (decode with `tools/zlog_decode`).
+/// @row `zlog_add_sink(&config)` | Adds an output (stderr, file, rotating file, ring, callback, socket); returns its id or -1.
+/// @row `zlog_remove_sink(id)` | Closes and removes a sink (`ZLOG_CONSOLE_SINK` is the default stderr sink).
+/// @row `zlog_set_sink_level(id, level)` | Sets the minimum level a sink accepts.
+/// @row `zlog_ring_read(id, buf, size)` | Copies the newest text held by a ring sink into `buf`.
 /// @row `log_info(...)` | Logs an info message (White).
 /// @row `log_warn(...)` | Logs a warning message (Yellow).
 /// @row `log_error(...)` | Logs an error message (Red).
 /// @row `log_debug(...)` | Logs a debug message (Cyan, if level permits).
 /// @row `log_trace(...)` | Logs a trace message (Blue, if level permits).
+/// @row `ZLOG_ENABLED(level)` | True if a message at `level` would currently be logged or kept by the flight recorder.
+/// @row `log_warn_every(n, ...)` | Logs the 1st, (n+1)th, (2n+1)th... call of this call site (all levels have an `_every` form).
+/// @row `log_error_ratelimit(per_sec, ...)` | Logs at most `per_sec` messages per second from this call site (all levels).
+/// @row `zlog_set_rate_limit(per_sec)` | Applies a `per_sec` limit to every logging call site (0 = off, the default).
+/// @row `log_info_kv(msg, fields...)` | Logs a message with typed fields, e.g. `ZKV_INT("status", 200)` (all levels have a `_kv` form).
+/// @row `ZKV_INT / ZKV_UINT / ZKV_DOUBLE / ZKV_BOOL / ZKV_STR` | Build one field; values are stored as-is and encoded by the sink.
+/// @row `zlog_set_flight_level(level)` | Keeps records at or above `level` in a per-thread flight recorder, even below the log level (`ZLOG_NONE` = off, the default).
+/// @row `zlog_flight_dump()` | Writes the calling thread's recorded records that were not logged to the sinks, then clears it (`zerr_print` and `zerr_panic` do this too).
+/// @row `zlog_flight_clear()` | Forgets the calling thread's recorded records (e.g. at a request boundary).
 /// @endgroup
 
 // Logging config.
@@ -96,19 +161,297 @@ typedef enum
     ZLOG_NONE
 } zlog_level;
 
+// What a producer does when the async queue is full.
+typedef enum
+{
+    ZLOG_OVERFLOW_BLOCK = 0,    // Wait for the writer thread to free a slot.
+    ZLOG_OVERFLOW_DROP_NEWEST,  // Discard the record being logged.
+    ZLOG_OVERFLOW_DROP_OLDEST   // Discard the oldest queued record to make room.
+} zlog_overflow;
+
+// Size of the text stored per queued record (message + extra info).
+#ifndef ZLOG_ASYNC_RECORD_MAX
+#   define ZLOG_ASYNC_RECORD_MAX 2048
+#endif
+
+// Flight recorder: records kept per thread, and argument bytes stored per record.
+#ifndef ZLOG_FLIGHT_RECORDS
+#   define ZLOG_FLIGHT_RECORDS 64
+#endif
+
+#ifndef ZLOG_FLIGHT_ARGS
+#   define ZLOG_FLIGHT_ARGS 128
+#endif
+
+// Layout of text timestamps.
+typedef enum
+{
+    ZLOG_TIME_LOCAL = 0,    // "2024-05-01 13:37:00.123" in the local zone.
+    ZLOG_TIME_UTC,          // "2024-05-01 11:37:00.123Z".
+    ZLOG_TIME_EPOCH_NS      // Nanoseconds since the Unix epoch, for machine ingestion.
+} zlog_time_mode;
+
+// Fractional second digits in text timestamps (0, 3 or 6).
+#ifndef ZLOG_TIME_DIGITS
+#   define ZLOG_TIME_DIGITS 3
+#endif
+
+// Calls below this level compile to nothing (their arguments are still type-checked).
+#ifndef ZLOG_COMPILE_LEVEL
+#   define ZLOG_COMPILE_LEVEL ZLOG_TRACE
+#endif
+
+// In binary mode, records at or above this level are also printed to stderr.
+#ifndef ZLOG_BINARY_ECHO_LEVEL
+#   define ZLOG_BINARY_ECHO_LEVEL ZLOG_ERROR
+#endif
+
 void zlog_init(const char *file_path, zlog_level min_level);
 void zlog_set_level(zlog_level level);
+void zlog_set_time_mode(zlog_time_mode mode);
+
+void zlog_set_flight_level(zlog_level level);
+void zlog_flight_dump(void);
+void zlog_flight_clear(void);
+
+// Async mode. 'capacity' is rounded up to a power of two (0 = 1024). Sinks that
+// are already registered keep their ids; only the file sink is replaced.
+void zlog_init_async(const char *file_path, zlog_level min_level, size_t capacity, zlog_overflow policy);
+void zlog_flush(void);
+void zlog_shutdown(void);
+size_t zlog_dropped(void);
+
+// Binary mode. Arguments are stored raw and format strings once per call site.
+void zlog_init_binary(const char *file_path, zlog_level min_level);
+
+// Output layouts a sink can ask for. Each is built at most once per record.
+typedef enum
+{
+    ZLOG_FORMAT_TEXT = 0,   // "[time] LABEL: msg" plus an "at func (file:line)" line.
+    ZLOG_FORMAT_COLOR,      // ZLOG_FORMAT_TEXT with ANSI colors.
+    ZLOG_FORMAT_SYSLOG,     // "<pri>zlog: LABEL: msg (file:line)" on one line.
+    ZLOG_FORMAT_JSON,       // One JSON object per line; fields become members.
+    ZLOG_FORMAT_LOGFMT,     // One "key=value ..." line per record.
+    ZLOG_FORMAT_BINARY,     // Binary records, as written by zlog_init_binary (file sinks only).
+    ZLOG_FORMAT_COUNT
+} zlog_format;
+
+typedef enum
+{
+    ZLOG_SINK_STDERR = 0,
+    ZLOG_SINK_FILE,
+    ZLOG_SINK_ROTATING,
+    ZLOG_SINK_RING,
+    ZLOG_SINK_CALLBACK,
+    ZLOG_SINK_SOCKET
+} zlog_sink_kind;
+
+typedef enum
+{
+    ZKV_T_INT = 0,
+    ZKV_T_UINT,
+    ZKV_T_DOUBLE,
+    ZKV_T_BOOL,
+    ZKV_T_STR
+} zkv_type;
+
+// One structured field. Keys and strings are copied when the record is made.
+typedef struct
+{
+    const char *key;
+    zkv_type type;
+    union
+    {
+        long long i;
+        unsigned long long u;
+        double d;
+        const char *s;
+    } v;
+} zkv;
+
+static inline zkv zkv_int(const char *key, long long v)            { zkv f; f.key = key; f.type = ZKV_T_INT; f.v.i = v; return f; }
+static inline zkv zkv_uint(const char *key, unsigned long long v)  { zkv f; f.key = key; f.type = ZKV_T_UINT; f.v.u = v; return f; }
+static inline zkv zkv_double(const char *key, double v)            { zkv f; f.key = key; f.type = ZKV_T_DOUBLE; f.v.d = v; return f; }
+static inline zkv zkv_bool(const char *key, bool v)                { zkv f; f.key = key; f.type = ZKV_T_BOOL; f.v.i = v; return f; }
+static inline zkv zkv_str(const char *key, const char *v)          { zkv f; f.key = key; f.type = ZKV_T_STR; f.v.s = v; return f; }
+
+#define ZKV_INT(k, v)    zkv_int((k), (long long)(v))
+#define ZKV_UINT(k, v)   zkv_uint((k), (unsigned long long)(v))
+#define ZKV_DOUBLE(k, v) zkv_double((k), (double)(v))
+#define ZKV_BOOL(k, v)   zkv_bool((k), (v) ? true : false)
+#define ZKV_STR(k, v)    zkv_str((k), (v))
+
+// Most fields a single record carries; extra ones are dropped.
+#ifndef ZLOG_KV_MAX
+#   define ZLOG_KV_MAX 32
+#endif
+
+// A record as handed to callback sinks.
+typedef struct
+{
+    zlog_level level;
+    const char *label;
+    const char *file;
+    int line;
+    const char *func;
+    const char *msg;
+    const char *extra;
+    unsigned long long ts;  // Nanoseconds since the Unix epoch.
+    const zkv *fields;
+    size_t field_count;
+} zlog_entry;
+
+typedef void (*zlog_sink_fn)(const zlog_entry *entry, const char *text, size_t len, void *user);
+
+typedef struct
+{
+    zlog_sink_kind kind;
+    zlog_level level;       // Records below this level skip the sink.
+    zlog_format format;
+    const char *path;       // FILE/ROTATING: log file. SOCKET: Unix datagram socket (NULL = "/dev/log").
+    size_t size;            // ROTATING: rotate past this many bytes. RING: capacity (0 = 64 KiB).
+    unsigned max_age;       // ROTATING: also rotate files older than this many seconds (0 = never).
+    unsigned keep;          // ROTATING: rotated files kept as "<path>.1".."<path>.N" (0 = ZLOG_ROTATE_KEEP).
+    size_t flush_bytes;     // FILE/ROTATING: stdio buffer size (0 = ZLOG_FLUSH_BYTES).
+    unsigned flush_ms;      // FILE/ROTATING: flush buffered lines at least this often (0 = ZLOG_FLUSH_MS).
+    zlog_sink_fn fn;        // CALLBACK: runs under the logging lock, so it must not log itself.
+    void (*rotated)(const char *path, void *user);  // ROTATING: called with the closed file (e.g. to compress it).
+    void *user;
+} zlog_sink_config;
+
+// Rotation and batching defaults for file sinks.
+#ifndef ZLOG_ROTATE_KEEP
+#   define ZLOG_ROTATE_KEEP 5
+#endif
+
+#ifndef ZLOG_FLUSH_BYTES
+#   define ZLOG_FLUSH_BYTES 65536
+#endif
+
+#ifndef ZLOG_FLUSH_MS
+#   define ZLOG_FLUSH_MS 1000
+#endif
+
+// Records at or above this level are flushed to disk right away.
+#ifndef ZLOG_FLUSH_LEVEL
+#   define ZLOG_FLUSH_LEVEL ZLOG_ERROR
+#endif
+
+#ifndef ZLOG_SINK_MAX
+#   define ZLOG_SINK_MAX 8
+#endif
+
+// Id of the stderr sink every process starts with.
+#define ZLOG_CONSOLE_SINK 0
+
+// A rate-limited site reports how many messages it dropped at most this often.
+#ifndef ZLOG_LIMIT_SUMMARY_MS
+#   define ZLOG_LIMIT_SUMMARY_MS 10000
+#endif
+
+// Call sites tracked by the global rate limit; sites past that are not limited.
+#ifndef ZLOG_LIMIT_SITES
+#   define ZLOG_LIMIT_SITES 1024
+#endif
+
+// Per-call-site state of the _every / _ratelimit macros (zero-initialized static).
+typedef struct
+{
+    unsigned long long count;       // Calls seen, for 1-in-N sampling.
+    unsigned long long tat;         // Token bucket as a theoretical arrival time (ns).
+    unsigned long long suppressed;  // Dropped since the last summary.
+    unsigned long long reported;    // When the last summary went out (ns).
+} zlog_limit;
+
+void zlog_set_rate_limit(double per_sec);
+
+int zlog_add_sink(const zlog_sink_config *config);
+void zlog_remove_sink(int id);
+void zlog_set_sink_level(int id, zlog_level level);
+size_t zlog_ring_read(int id, char *buf, size_t size);
 
 // Internal function.
-void zlog_msg(zlog_level level, const char *file, int line, const char *func, const char *fmt, ...);
+void zlog_msg(zlog_level level, const char *file, int line, const char *func, const char *fmt, ...) ZERROR_PRINTF(5, 6);
+
+void zlog_kv(zlog_level level, const char *file, int line, const char *func, const char *msg, 
+             const zkv *fields, size_t count);
+
+// Internal: decides whether a limited call site logs this time ('every' and 'per_sec' 0 = unused).
+bool zlog__limit(zlog_limit *site, zlog_level level, const char *file, int line, const char *func,
+                 unsigned long long every, double per_sec);
+
+// Runtime thresholds. The macros read the gate (the lower of the log and flight
+// recorder levels), so calls nobody wants never leave the caller.
+extern zlog_level zlog__level;
+extern zlog_level zlog__gate;
+
+#define ZLOG_ENABLED(lvl) ((lvl) >= ZLOG_COMPILE_LEVEL && (lvl) >= zlog__gate)
+
+// The compile-time test folds away; a dead call is still parsed, so bad arguments still fail to build.
+#define ZLOG__LOG(lvl, ...)                                             \
+    do                                                                  \
+    {                                                                   \
+        if ((lvl) >= ZLOG_COMPILE_LEVEL && ZERROR_UNLIKELY((lvl) >= zlog__gate)) \
+        {                                                               \
+            zlog_msg(lvl, __FILE__, __LINE__, __func__, __VA_ARGS__);   \
+        }                                                               \
+    } while (0)
+
+#define ZLOG__KV(lvl, msg, ...)                                         \
+    do                                                                  \
+    {                                                                   \
+        if ((lvl) >= ZLOG_COMPILE_LEVEL && ZERROR_UNLIKELY((lvl) >= zlog__gate)) \
+        {                                                               \
+            const zkv zlog__kv_[] = { __VA_ARGS__ };                    \
+            zlog_kv(lvl, __FILE__, __LINE__, __func__, msg, zlog__kv_,  \
+                    sizeof(zlog__kv_) / sizeof(zlog__kv_[0]));          \
+        }                                                               \
+    } while (0)
+
+// Each expansion owns a static zlog_limit; the check runs before any formatting.
+#define ZLOG__LIMITED(lvl, every, per_sec, ...)                         \
+    do                                                                  \
+    {                                                                   \
+        if ((lvl) >= ZLOG_COMPILE_LEVEL && ZERROR_UNLIKELY((lvl) >= zlog__gate)) \
+        {                                                               \
+            static zlog_limit zlog__limit_;                             \
+            if (zlog__limit(&zlog__limit_, lvl, __FILE__, __LINE__, __func__, (every), (per_sec))) \
+            {                                                           \
+                zlog_msg(lvl, __FILE__, __LINE__, __func__, __VA_ARGS__); \
+            }                                                           \
+        }                                                               \
+    } while (0)
 
 // Pleasant macros.
-#define log_trace(...) zlog_msg(ZLOG_TRACE, __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define log_debug(...) zlog_msg(ZLOG_DEBUG, __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define log_info(...)  zlog_msg(ZLOG_INFO,  __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define log_warn(...)  zlog_msg(ZLOG_WARN,  __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define log_error(...) zlog_msg(ZLOG_ERROR, __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define log_fatal(...) zlog_msg(ZLOG_FATAL, __FILE__, __LINE__, __func__, __VA_ARGS__)
+#define log_trace(...) ZLOG__LOG(ZLOG_TRACE, __VA_ARGS__)
+#define log_debug(...) ZLOG__LOG(ZLOG_DEBUG, __VA_ARGS__)
+#define log_info(...)  ZLOG__LOG(ZLOG_INFO,  __VA_ARGS__)
+#define log_warn(...)  ZLOG__LOG(ZLOG_WARN,  __VA_ARGS__)
+#define log_error(...) ZLOG__LOG(ZLOG_ERROR, __VA_ARGS__)
+#define log_fatal(...) ZLOG__LOG(ZLOG_FATAL, __VA_ARGS__)
+
+// Structured variants: a plain message plus at least one ZKV_* field.
+#define log_trace_kv(msg, ...) ZLOG__KV(ZLOG_TRACE, msg, __VA_ARGS__)
+#define log_debug_kv(msg, ...) ZLOG__KV(ZLOG_DEBUG, msg, __VA_ARGS__)
+#define log_info_kv(msg, ...)  ZLOG__KV(ZLOG_INFO,  msg, __VA_ARGS__)
+#define log_warn_kv(msg, ...)  ZLOG__KV(ZLOG_WARN,  msg, __VA_ARGS__)
+#define log_error_kv(msg, ...) ZLOG__KV(ZLOG_ERROR, msg, __VA_ARGS__)
+#define log_fatal_kv(msg, ...) ZLOG__KV(ZLOG_FATAL, msg, __VA_ARGS__)
+
+// Sampled (1 in n) and rate-limited (per second) variants, limited per call site.
+#define log_trace_every(n, ...) ZLOG__LIMITED(ZLOG_TRACE, (n), 0, __VA_ARGS__)
+#define log_debug_every(n, ...) ZLOG__LIMITED(ZLOG_DEBUG, (n), 0, __VA_ARGS__)
+#define log_info_every(n, ...)  ZLOG__LIMITED(ZLOG_INFO,  (n), 0, __VA_ARGS__)
+#define log_warn_every(n, ...)  ZLOG__LIMITED(ZLOG_WARN,  (n), 0, __VA_ARGS__)
+#define log_error_every(n, ...) ZLOG__LIMITED(ZLOG_ERROR, (n), 0, __VA_ARGS__)
+#define log_fatal_every(n, ...) ZLOG__LIMITED(ZLOG_FATAL, (n), 0, __VA_ARGS__)
+
+#define log_trace_ratelimit(per_sec, ...) ZLOG__LIMITED(ZLOG_TRACE, 0, (per_sec), __VA_ARGS__)
+#define log_debug_ratelimit(per_sec, ...) ZLOG__LIMITED(ZLOG_DEBUG, 0, (per_sec), __VA_ARGS__)
+#define log_info_ratelimit(per_sec, ...)  ZLOG__LIMITED(ZLOG_INFO,  0, (per_sec), __VA_ARGS__)
+#define log_warn_ratelimit(per_sec, ...)  ZLOG__LIMITED(ZLOG_WARN,  0, (per_sec), __VA_ARGS__)
+#define log_error_ratelimit(per_sec, ...) ZLOG__LIMITED(ZLOG_ERROR, 0, (per_sec), __VA_ARGS__)
+#define log_fatal_ratelimit(per_sec, ...) ZLOG__LIMITED(ZLOG_FATAL, 0, (per_sec), __VA_ARGS__)
 
 // Legacy/caps aliases.
 #define LOG_INFO  log_info
@@ -133,35 +476,311 @@ void zlog_msg(zlog_level level, const char *file, int line, const char *func, co
 #   define ZERROR_PANIC_ACTION() abort()
 #endif
 
+// Per-thread message arena size, and the longest single message it will hold.
+#ifndef ZERROR_ARENA_SIZE
+#   define ZERROR_ARENA_SIZE 16384
+#endif
+
+#ifndef ZERROR_MSG_MAX
+#   define ZERROR_MSG_MAX 2048
+#endif
+
+// Frames kept per thread for logical traces, and the deepest trace rendered.
+#ifndef ZERROR_TRACE_POOL
+#   define ZERROR_TRACE_POOL 256
+#endif
+
+#ifndef ZERROR_TRACE_MAX
+#   define ZERROR_TRACE_MAX 32
+#endif
+
+// Error statistics: counter shards (threads are spread over them) and sites per shard.
+#ifndef ZERROR_STATS_SHARDS
+#   define ZERROR_STATS_SHARDS 16
+#endif
+
+#ifndef ZERROR_STATS_SITES
+#   define ZERROR_STATS_SITES 256
+#endif
+
+// Bodies (message, trace head, source) kept per thread for ZERROR_COMPACT errors.
+#ifndef ZERROR_BODY_POOL
+#   define ZERROR_BODY_POOL 512
+#endif
+
+// Errors parked per thread for DEFINE_RESULT_SLIM results.
+#ifndef ZERROR_REF_POOL
+#   define ZERROR_REF_POOL 64
+#endif
+
+// Wrapped errors parked per thread as causes of zerr_wrap layers.
+#ifndef ZERROR_CAUSE_POOL
+#   define ZERROR_CAUSE_POOL 128
+#endif
+
+// Owned error pool: blocks a thread caches per size class, idle blocks kept
+// globally per class, and the most bytes held from Z_MALLOC (0 = no limit).
+#ifndef ZERROR_POOL_CACHE
+#   define ZERROR_POOL_CACHE 16
+#endif
+
+#ifndef ZERROR_POOL_GLOBAL
+#   define ZERROR_POOL_GLOBAL 256
+#endif
+
+#ifndef ZERROR_POOL_LIMIT
+#   define ZERROR_POOL_LIMIT (4u << 20)
+#endif
+
+// Crash reports: log records taken from the ring sink, and native frames printed.
+#ifndef ZERROR_CRASH_RECORDS
+#   define ZERROR_CRASH_RECORDS 32
+#endif
+
+#ifndef ZERROR_CRASH_FRAMES
+#   define ZERROR_CRASH_FRAMES 64
+#endif
+
+// Largest argument snapshot kept by a deferred-format error.
+#ifndef ZERROR_LAZY_ARGS_MAX
+#   define ZERROR_LAZY_ARGS_MAX 256
+#endif
+
+typedef struct
+{
+    const char *func;
+    const char *file;
+    int line;
+} zerr_frame;
+
+// Where an error was raised. ZERROR_COMPACT errors point at a static one emitted by zerr_create.
+typedef zerr_frame zerr_site;
+
+#ifdef ZERROR_COMPACT
+
+/*
+ * Compact layout: 16 bytes, so it is returned in registers. The call site is a
+ * static descriptor; message, trace and source expression live in a body in
+ * the creating thread's body pool, addressed by 'ref'. Read them through
+ * zerr_msg / zerr_file / zerr_line / zerr_func / zerr_source.
+ */
+typedef struct
+{
+    int code;
+    unsigned ref;           // Body in the thread's body pool (0 = none).
+    const zerr_site *site;  // Static call site (NULL = kept in the body).
+} zerr;
+
+#   define ZERROR_NO_ERROR {0, 0, NULL}
+
+#else
+
+// 'trace' and 'gen' sit in what was padding after 'code' and 'line', so every
+// field from 'msg' on moved: build a zerr from ZERROR_NO_ERROR or with
+// designated initializers, never positionally.
 typedef struct 
 {
     int code;
+    unsigned trace;     // Newest frame in the thread's frame pool (0 = no trace).
     const char *msg;
     const char *file;
     int line;
+    unsigned gen;       // Arena generation of 'msg' (0 if not arena-owned).
     const char *func;
     const char *source;
 } zerr;
 
+#   define ZERROR_NO_ERROR {0, 0, NULL, NULL, 0, 0, NULL, NULL}
+
+#endif
+
 /// @section Error Management
 /// @table Creation & Manipulation
 /// @columns Function | Description
 /// @row `zerr_create(code, msg)` | Creates a new error with current file/line context.
 /// @row `zerr_errno(code, msg)` | Creates a new error, appending the string description of `errno`.
-/// @row `zerr_wrap(e, fmt, ...)` | Wraps an existing error with a new context message.
+/// @row `zerr_wrap(e, fmt, ...)` | Wraps an error in a new layer with its own message and location; the code is kept and `e` becomes its cause.
+/// @row `zerr_wrap_code(e, code, fmt, ...)` | Like `zerr_wrap`, but the new layer gets `code`.
+/// @row `zerr_msg(e)` | Returns the message text, formatting a deferred message on first use.
+/// @row `zerr_file(e)` / `zerr_line(e)` / `zerr_func(e)` | Where the error was created (work with either layout).
+/// @row `zerr_source(e)` | The expression that first propagated the error, or `NULL`.
+/// @row `zerr_resolve(e)` | Returns `e` with a plain-text `msg` (call before handing a deferred error to another thread).
+/// @row `zerr_set_lazy_format(on)` | Switches deferred formatting on or off for errors created afterwards.
 /// @row `zerr_print(e)` | Prints a stylized error report to stderr.
+/// @row `zerr_trace(e, out, max)` | Copies the propagation frames of `e` (oldest first) and returns how many.
 /// @row `zerr_panic(msg)` | Prints a panic message and aborts the program.
+/// @row `zerr_arena_reset()` | Releases every message in the calling thread's arena (e.g. at a request boundary).
+/// @endgroup
+
+/// @table Cause Chains
+/// @columns Function | Description
+/// @row `zerr_cause(e)` | The error `e` wraps, or one with code `0` if it wraps none.
+/// @row `zerr_root_cause(e)` | The innermost error of the chain (`e` itself if it wraps none).
+/// @row `zerr_find_code(e, code, out)` | Whether `e` or any of its causes has `code`; stores the first match in `out` (may be `NULL`).
+/// @row `zerr_chain_text(e, buf, size)` | Writes `outer: inner: root` like `snprintf` and returns the full length.
 /// @endgroup
 
 zerr zerr_create_impl(int code, const char *file, int line, const char *func, const char *fmt, ...);
 zerr zerr_errno_impl(int code, const char *file, int line, const char *func, const char *fmt, ...);
 
-zerr zerr_wrap(zerr e, const char *fmt, ...);
+#ifdef ZERROR_COMPACT
+zerr zerr_create_at(int code, const zerr_site *site, const char *fmt, ...);
+zerr zerr_errno_at(int code, const zerr_site *site, const char *fmt, ...);
+const char *zerr_file(zerr e);
+int zerr_line(zerr e);
+const char *zerr_func(zerr e);
+const char *zerr_source(zerr e);
+zerr zerr_with_src(zerr e, const char *src);
+#else
+static inline const char *zerr_file(zerr e)   { return e.file; }
+static inline int zerr_line(zerr e)           { return e.line; }
+static inline const char *zerr_func(zerr e)   { return e.func; }
+static inline const char *zerr_source(zerr e) { return e.source; }
+#endif
+
+zerr zerr_wrap_impl(zerr e, int code, const char *file, int line, const char *func, const char *fmt, ...) ZERROR_PRINTF(6, 7);
+#ifdef ZERROR_COMPACT
+zerr zerr_wrap_at(zerr e, int code, const zerr_site *site, const char *fmt, ...) ZERROR_PRINTF(4, 5);
+#endif
+zerr zerr_cause(zerr e);
+zerr zerr_root_cause(zerr e);
+bool zerr_find_code(zerr e, int code, zerr *out);
+size_t zerr_chain_text(zerr e, char *buf, size_t size);
 zerr zerr_add_trace(zerr e, const char *func, const char *file, int line);
 
+const char *zerr_msg(zerr e);
+zerr zerr_resolve(zerr e);
+void zerr_set_lazy_format(bool enabled);
+int zerr_trace(zerr e, zerr_frame *out, int max);
+
 void zerr_print(zerr e);
 void zerr_panic(const char *msg, const char *file, int line);
 
+void zerr_arena_reset(void);
+
+/// @section Crash Reports
+/// @table Fatal signal handler
+/// @columns Function | Description
+/// @row `zerr_crash_install(cfg)` | Installs the handler for SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT (`NULL` = stderr, no ring). Returns `false` where unsupported.
+/// @row `zerr_crash_uninstall()` | Puts back the handlers that were there before.
+/// @row `zerr_crash_report(fd)` | Writes a report now (async-signal-safe, for use from your own handlers).
+/// @endgroup
+
+typedef struct
+{
+    int fd;         // Opened in advance; 0 = stderr.
+    int ring;       // Ring sink whose newest records go into the report (other ids are skipped).
+    int records;    // Records taken from it (0 = ZERROR_CRASH_RECORDS).
+} zerr_crash_config;
+
+bool zerr_crash_install(const zerr_crash_config *cfg);
+void zerr_crash_uninstall(void);
+void zerr_crash_report(int fd);
+
+/// @section Error Statistics
+/// @table Counters per error site
+/// @columns Function | Description
+/// @row `zerr_stats_snapshot(out, max)` | Copies up to `max` site counters (sorted by code, file, line) and returns how many sites there are.
+/// @row `zerr_stats_foreach(fn, user)` | Calls `fn` once per site with its counters summed over all threads.
+/// @row `zerr_stats_prometheus(buf, size)` | Writes the counters in Prometheus text format. Returns the full length, like `snprintf`.
+/// @row `zerr_stats_reset()` | Zeroes every counter; known sites stay registered.
+/// @row `zerr_stats_dropped()` | Events not counted because their shard had no free site slot.
+/// @endgroup
+
+// Counters of one creation site, keyed by (code, file, line) of zerr_create.
+typedef struct
+{
+    int code;
+    const char *file;
+    int line;
+    unsigned long long created;
+    unsigned long long propagated;
+    unsigned long long printed;
+} zerr_stat;
+
+typedef void (*zerr_stat_fn)(const zerr_stat *stat, void *user);
+
+zerr zerr_stats_propagate(zerr e);
+size_t zerr_stats_snapshot(zerr_stat *out, size_t max);
+void zerr_stats_foreach(zerr_stat_fn fn, void *user);
+size_t zerr_stats_prometheus(char *buf, size_t size);
+void zerr_stats_reset(void);
+unsigned long long zerr_stats_dropped(void);
+
+/// @section Error Codes
+/// @table Domains and code metadata
+/// @columns Item | Description
+/// @row `ZERR_DEFINE_DOMAIN(name, id, LIST)` | Defines codes `id * ZERR_DOMAIN_SPAN + i` for each `X(CODE, text, severity, retryable)` in `LIST`, and their table `zerr_domain_<name>`.
+/// @row `zerr_domain_register(&zerr_domain_<name>)` | Makes a domain known to lookups and renderers. Returns `false` if its id is out of range or held by another domain.
+/// @row `zerr_code_lookup(code)` | Metadata of `code` by direct indexing, or `NULL` if it is not registered.
+/// @row `zerr_code_name(code)` | Identifier such as `"HTTP_NOT_FOUND"`, or `NULL`.
+/// @row `zerr_code_severity(code)` / `zerr_code_retryable(code)` | Severity and retry hint (`ZERR_SEV_ERROR` / `false` when not registered).
+/// @row `zerr_code_domain(code)` / `ZERR_IN_DOMAIN(code, name)` | Domain id of a code, for category checks without string compares.
+/// @endgroup
+
+// Codes per domain, and the largest domain id + 1. Domain 0 holds unregistered
+// positive codes; the negative Z_E* codes form a built-in table.
+#ifndef ZERR_DOMAIN_SPAN
+#   define ZERR_DOMAIN_SPAN 1024
+#endif
+
+#ifndef ZERR_DOMAIN_MAX
+#   define ZERR_DOMAIN_MAX 64
+#endif
+
+typedef enum
+{
+    ZERR_SEV_INFO = 0,
+    ZERR_SEV_WARN,
+    ZERR_SEV_ERROR,
+    ZERR_SEV_FATAL
+} zerr_severity;
+
+typedef struct
+{
+    int code;
+    const char *name;           // Identifier, e.g. "HTTP_NOT_FOUND".
+    const char *text;           // Short description.
+    zerr_severity severity;
+    bool retryable;
+} zerr_code_desc;
+
+typedef struct
+{
+    const char *name;
+    int id;
+    const zerr_code_desc *codes;    // codes[i] describes id * ZERR_DOMAIN_SPAN + i.
+    size_t count;
+} zerr_domain;
+
+#define ZERR__DOMAIN_ENUM(code, text, sev, retry) code,
+#define ZERR__DOMAIN_DESC(code, text, sev, retry) { code, #code, text, sev, retry },
+
+/*
+ * LIST is an X-macro: #define HTTP_ERRORS(X) X(HTTP_NOT_FOUND, "Not found", ZERR_SEV_WARN, false) ...
+ * The codes become enum constants, so switch statements and ZERR_IN_DOMAIN fold
+ * to integer compares. The array typedef fails to build if LIST outgrows the span.
+ */
+#define ZERR_DEFINE_DOMAIN(name, id, LIST)                                                  \
+    enum { zerr__##name##_id = (id) };                                                      \
+    enum { zerr__##name##_first = (id) * ZERR_DOMAIN_SPAN - 1, LIST(ZERR__DOMAIN_ENUM) zerr__##name##_end }; \
+    typedef char zerr__##name##_fits[(zerr__##name##_end - (id) * ZERR_DOMAIN_SPAN <= ZERR_DOMAIN_SPAN) ? 1 : -1]; \
+    static const zerr_code_desc zerr__##name##_codes[] = { LIST(ZERR__DOMAIN_DESC) };     \
+    static const zerr_domain zerr_domain_##name =                                           \
+    {                                                                                       \
+        #name, (id), zerr__##name##_codes,                                                  \
+        sizeof(zerr__##name##_codes) / sizeof(zerr__##name##_codes[0])                      \
+    }
+
+#define ZERR_IN_DOMAIN(code, name) ((code) > 0 && (code) / ZERR_DOMAIN_SPAN == zerr__##name##_id)
+
+bool zerr_domain_register(const zerr_domain *domain);
+const zerr_code_desc *zerr_code_lookup(int code);
+const char *zerr_code_name(int code);
+zerr_severity zerr_code_severity(int code);
+bool zerr_code_retryable(int code);
+int zerr_code_domain(int code);
+
 // Result types.
 
 #define DEFINE_RESULT(T, Name)                                                              \
@@ -180,7 +799,7 @@ static inline zres zres_ok(void)
     return (zres)
     { 
         .is_ok = true, 
-        .err = {0, NULL, NULL, 0, NULL, NULL} 
+        .err = ZERROR_NO_ERROR 
     }; 
 }
 
@@ -193,6 +812,96 @@ static inline zres zres_err(zerr e)
     }; 
 }
 
+/// @section Slim Results
+/// @table Register-sized results
+/// @columns Item | Description
+/// @row `DEFINE_RESULT_SLIM(T, Name)` | Like `DEFINE_RESULT`, but the error arm is a `zerr_ref`; for `T` up to 8 bytes the result is returned in two registers.
+/// @row `zerr_ref_new(e)` | Parks `e` in the calling thread's ref pool and returns its handle.
+/// @row `zerr_ref_get(r)` | The parked error (an expired placeholder with `r.code` once its slot was reused).
+/// @row `zerr_ref_set(r, e)` | Replaces the parked error in place and returns the handle.
+/// @endgroup
+
+// Handle to an error parked in the calling thread's ref pool; 'code' is always readable.
+typedef struct
+{
+    int code;
+    unsigned id;
+} zerr_ref;
+
+zerr_ref zerr_ref_new(zerr e);
+zerr zerr_ref_get(zerr_ref r);
+zerr_ref zerr_ref_set(zerr_ref r, zerr e);
+
+/// @section Owned Errors
+/// @table Handing errors to other threads
+/// @columns Function | Description
+/// @row `zerr_clone(e)` | Copies `e`, its frames and its cause chain into one block from the owned error pool; `NULL` if allocation fails or the pool is at its limit.
+/// @row `zerr_clone_size(e)` / `zerr_clone_into(e, mem, size)` | The same, into caller-provided memory (e.g. a pool); `NULL` if `size` is too small.
+/// @row `zerr_free(o)` | Releases a block made by `zerr_clone` (`NULL` is ignored). Memory given to `zerr_clone_into` stays the caller's.
+/// @row `zerr_owned_code(o)` / `zerr_owned_msg(o)` | The outermost code and message, readable on any thread.
+/// @row `zerr_owned_get(o)` | Rebuilds the error on the calling thread; its messages stay valid until `o` is freed.
+/// @endgroup
+
+// An error detached from the thread that made it: every layer, frame and message in one block.
+typedef struct zerr_owned zerr_owned;
+
+size_t zerr_clone_size(zerr e);
+zerr_owned *zerr_clone_into(zerr e, void *mem, size_t size);
+zerr_owned *zerr_clone(zerr e);
+void zerr_free(zerr_owned *o);
+int zerr_owned_code(const zerr_owned *o);
+const char *zerr_owned_msg(const zerr_owned *o);
+zerr zerr_owned_get(const zerr_owned *o);
+
+/// @table Owned error pool
+/// @columns Function | Description
+/// @row `zerr_pool_stats(out)` | Fills `out` with the bytes held from `Z_MALLOC`, slow-path counters and per-class block counts.
+/// @row `zerr_pool_trim()` | Hands the calling thread's cached blocks and every idle global block back to `Z_FREE` (e.g. before a thread exits).
+/// @endgroup
+
+// Size classes of the pool: 128, 256, ... 4096 bytes. Larger blocks bypass it.
+#define ZERR_POOL_CLASSES 6
+
+typedef struct
+{
+    size_t size;                    // Block size of the class.
+    unsigned long long reserved;    // Blocks taken from Z_MALLOC and not returned: live or cached.
+    unsigned long long peak;        // Highest 'reserved' so far.
+    unsigned long long idle;        // Blocks waiting in the global list.
+} zerr_pool_class;
+
+typedef struct
+{
+    unsigned long long reserved_bytes;  // Bytes held from Z_MALLOC (live, cached and idle blocks).
+    unsigned long long peak_bytes;      // Highest 'reserved_bytes' so far.
+    unsigned long long limit_bytes;     // ZERROR_POOL_LIMIT (0 = none).
+    unsigned long long sys_allocs;      // Z_MALLOC calls.
+    unsigned long long sys_frees;       // Z_FREE calls.
+    unsigned long long refills;         // Thread caches refilled from the global lists.
+    unsigned long long spills;          // Thread caches that overflowed into the global lists.
+    unsigned long long oversize;        // Blocks too large for a class.
+    unsigned long long denied;          // Allocations refused by the limit.
+    zerr_pool_class classes[ZERR_POOL_CLASSES];
+} zerr_pool_stat;
+
+void zerr_pool_stats(zerr_pool_stat *out);
+void zerr_pool_trim(void);
+
+/*
+ * The 8-byte union member keeps 'is_ok' alone in the first register: GCC builds
+ * a register that mixes it with a small 'val' through the stack. Name##_err
+ * parks the error, so ZERROR_CHECK_INTO / ZERROR_TRY_INTO can target slim types too.
+ */
+#define DEFINE_RESULT_SLIM(T, Name)                                                         \
+    typedef struct                                                                          \
+    {                                                                                       \
+        bool is_ok;                                                                         \
+        union { T val; zerr_ref ref; unsigned long long zerr__word; };                      \
+    } Name;                                                                                 \
+    static inline Name Name##_ok(T v) { Name r; r.is_ok = true; r.val = v; return r; }      \
+    static inline Name Name##_err(zerr e)                                                   \
+    { Name r; r.is_ok = false; r.ref = zerr_ref_new(e); return r; }
+
 DEFINE_RESULT(int,      ResInt)
 DEFINE_RESULT(float,    ResFloat)
 DEFINE_RESULT(double,   ResDouble)
@@ -209,8 +918,30 @@ DEFINE_RESULT(char*,    ResStr)
 #   define ZERROR_TRAP() ((void)0)
 #endif
 
-#define zerr_create(code, ...) (ZERROR_TRAP(), zerr_create_impl((code), __FILE__, __LINE__, __func__, __VA_ARGS__))
-#define zerr_errno(code, ...) (ZERROR_TRAP(), zerr_errno_impl((code), __FILE__, __LINE__, __func__, __VA_ARGS__))
+#ifdef ZERROR_COMPACT
+
+#   if !defined(__GNUC__) && !defined(__clang__)
+#       error "ZERROR_COMPACT needs statement expressions (GCC or Clang)."
+#   endif
+
+// Emits the call site once, as static data, and passes its address.
+#   define ZERROR__AT_SITE(fn, code, ...)                                                  \
+        ({  static const zerr_site ZERROR_UID(_site) = { __func__, __FILE__, __LINE__ };    \
+            fn((code), &ZERROR_UID(_site), __VA_ARGS__); })
+
+#   define zerr_create(code, ...) (ZERROR_TRAP(), ZERROR__AT_SITE(zerr_create_at, code, __VA_ARGS__))
+#   define zerr_errno(code, ...) (ZERROR_TRAP(), ZERROR__AT_SITE(zerr_errno_at, code, __VA_ARGS__))
+#   define zerr_wrap_code(e, code, ...)                                                     \
+        ({  static const zerr_site ZERROR_UID(_site) = { __func__, __FILE__, __LINE__ };    \
+            zerr_wrap_at((e), (code), &ZERROR_UID(_site), __VA_ARGS__); })
+#   define zerr_wrap(e, ...) zerr_wrap_code(e, 0, __VA_ARGS__)
+
+#else
+
+#   define zerr_create(code, ...) (ZERROR_TRAP(), zerr_create_impl((code), __FILE__, __LINE__, __func__, __VA_ARGS__))
+#   define zerr_errno(code, ...) (ZERROR_TRAP(), zerr_errno_impl((code), __FILE__, __LINE__, __func__, __VA_ARGS__))
+#   define zerr_wrap_code(e, code, ...) zerr_wrap_impl((e), (code), __FILE__, __LINE__, __func__, __VA_ARGS__)
+#   define zerr_wrap(e, ...) zerr_wrap_code(e, 0, __VA_ARGS__)
 
 // Runtime helpers
 static inline zerr zerr_with_src(zerr e, const char *src) 
@@ -222,12 +953,23 @@ static inline zerr zerr_with_src(zerr e, const char *src)
     return e;
 }
 
+#endif
+
 #ifdef ZERROR_ENABLE_TRACE
 #   define ZERROR_TRACE_OP(e) zerr_add_trace(e, __func__, __FILE__, __LINE__)
 #else
 #   define ZERROR_TRACE_OP(e) (e)
 #endif
 
+#ifdef ZERROR_ENABLE_STATS
+#   define ZERROR_STATS_OP(e) zerr_stats_propagate(e)
+#else
+#   define ZERROR_STATS_OP(e) (e)
+#endif
+
+// What the propagating macros do to an error on its way out of a frame.
+#define ZERROR_PROPAGATE_OP(e) ZERROR_STATS_OP(ZERROR_TRACE_OP(e))
+
 int zerr_run(zres result);
 #define ZERROR_RUN(expr) zerr_run(expr)
 
@@ -238,7 +980,7 @@ int zerr_run(zres result);
         if (!(cond))                                \
         {                                           \
             zerr _e = zerr_create((code), (msg));   \
-            _e.source = src;                        \
+            _e = zerr_with_src(_e, src);            \
             return zres_err(_e);                    \
         }                                           \
     } while(0)
@@ -248,7 +990,7 @@ int zerr_run(zres result);
         if (!(cond))                                        \
         {                                                   \
             zerr _e = zerr_create((code), (msg));           \
-            _e.source = src;                                \
+            _e = zerr_with_src(_e, src);                    \
             return RetType##_err(_e);                       \
         }                                                   \
     } while(0)
@@ -271,7 +1013,7 @@ int zerr_run(zres result);
             if (!ZERROR_UID(_r).is_ok)                                          \
             {                                                                   \
                 ZERROR_UID(_r).err = zerr_with_src(ZERROR_UID(_r).err, src);    \
-                ZERROR_UID(_r).err = ZERROR_TRACE_OP(ZERROR_UID(_r).err);       \
+                ZERROR_UID(_r).err = ZERROR_PROPAGATE_OP(ZERROR_UID(_r).err);   \
                 return zres_err(ZERROR_UID(_r).err);                            \
             }                                                                   \
         } while(0)
@@ -282,7 +1024,7 @@ int zerr_run(zres result);
             if (!ZERROR_UID(_r).is_ok)                                          \
             {                                                                   \
                 ZERROR_UID(_r).err = zerr_with_src(ZERROR_UID(_r).err, src);    \
-                ZERROR_UID(_r).err = ZERROR_TRACE_OP(ZERROR_UID(_r).err);       \
+                ZERROR_UID(_r).err = ZERROR_PROPAGATE_OP(ZERROR_UID(_r).err);   \
                 return RetType##_err(ZERROR_UID(_r).err);                       \
             }                                                                   \
         } while(0)
@@ -293,7 +1035,7 @@ int zerr_run(zres result);
             if (!ZERROR_UID(_r).is_ok)                                              \
             {                                                                       \
                 ZERROR_UID(_r).err = zerr_with_src(ZERROR_UID(_r).err, src);        \
-                ZERROR_UID(_r).err = ZERROR_TRACE_OP(ZERROR_UID(_r).err);           \
+                ZERROR_UID(_r).err = ZERROR_PROPAGATE_OP(ZERROR_UID(_r).err);       \
                 return zres_err(zerr_wrap(ZERROR_UID(_r).err, fmt, ##__VA_ARGS__)); \
             }                                                                       \
         } while(0)
@@ -304,7 +1046,7 @@ int zerr_run(zres result);
             if (!ZERROR_UID(_r).is_ok)                                                  \
             {                                                                           \
                 ZERROR_UID(_r).err = zerr_with_src(ZERROR_UID(_r).err, src);            \
-                ZERROR_UID(_r).err = ZERROR_TRACE_OP(ZERROR_UID(_r).err);               \
+                ZERROR_UID(_r).err = ZERROR_PROPAGATE_OP(ZERROR_UID(_r).err);           \
                 ZERROR_UID(_r).err = zerr_wrap(ZERROR_UID(_r).err, fmt, ##__VA_ARGS__); \
                 return zres_err(ZERROR_UID(_r).err);                                    \
             }                                                                           \
@@ -315,7 +1057,7 @@ int zerr_run(zres result);
             if (!ZERROR_UID(_res).is_ok)                                            \
             {                                                                       \
                 ZERROR_UID(_res).err = zerr_with_src(ZERROR_UID(_res).err, src);    \
-                ZERROR_UID(_res).err = ZERROR_TRACE_OP(ZERROR_UID(_res).err);       \
+                ZERROR_UID(_res).err = ZERROR_PROPAGATE_OP(ZERROR_UID(_res).err);   \
                 return ZERROR_UID(_res);                                            \
             }                                                                       \
             ZERROR_UID(_res).val;                                                   \
@@ -326,12 +1068,48 @@ int zerr_run(zres result);
             if (!ZERROR_UID(_res).is_ok)                                            \
             {                                                                       \
                 ZERROR_UID(_res).err = zerr_with_src(ZERROR_UID(_res).err, src);    \
-                ZERROR_UID(_res).err = ZERROR_TRACE_OP(ZERROR_UID(_res).err);       \
+                ZERROR_UID(_res).err = ZERROR_PROPAGATE_OP(ZERROR_UID(_res).err);   \
                 return RetType##_err(ZERROR_UID(_res).err);                         \
             }                                                                       \
             ZERROR_UID(_res).val;                                                   \
         })
     
+// Slim results: the parked error is updated in place and the same handle goes up.
+#   define ZERROR_CHECK_SLIM(expr, src)                                                 \
+        do {                                                                            \
+            Z_TYPEOF(expr) ZERROR_UID(_r) = (expr);                                     \
+            if (!ZERROR_UID(_r).is_ok)                                                  \
+            {                                                                           \
+                zerr ZERROR_UID(_e) = zerr_ref_get(ZERROR_UID(_r).ref);                 \
+                ZERROR_UID(_e) = zerr_with_src(ZERROR_UID(_e), src);                    \
+                return zres_err(ZERROR_PROPAGATE_OP(ZERROR_UID(_e)));                   \
+            }                                                                           \
+        } while(0)
+
+#   define ZERROR_TRY_SLIM(expr, src)                                                   \
+        ({  Z_TYPEOF(expr) ZERROR_UID(_res) = (expr);                                   \
+            if (!ZERROR_UID(_res).is_ok)                                                \
+            {                                                                           \
+                zerr ZERROR_UID(_e) = zerr_ref_get(ZERROR_UID(_res).ref);               \
+                ZERROR_UID(_e) = zerr_with_src(ZERROR_UID(_e), src);                    \
+                ZERROR_UID(_e) = ZERROR_PROPAGATE_OP(ZERROR_UID(_e));                   \
+                ZERROR_UID(_res).ref = zerr_ref_set(ZERROR_UID(_res).ref, ZERROR_UID(_e)); \
+                return ZERROR_UID(_res);                                                \
+            }                                                                           \
+            ZERROR_UID(_res).val;                                                       \
+        })
+
+#   define ZERROR_TRY_SLIM_INTO(RetType, expr, src)                                     \
+        ({  Z_TYPEOF(expr) ZERROR_UID(_res) = (expr);                                   \
+            if (!ZERROR_UID(_res).is_ok)                                                \
+            {                                                                           \
+                zerr ZERROR_UID(_e) = zerr_ref_get(ZERROR_UID(_res).ref);               \
+                ZERROR_UID(_e) = zerr_with_src(ZERROR_UID(_e), src);                    \
+                return RetType##_err(ZERROR_PROPAGATE_OP(ZERROR_UID(_e)));              \
+            }                                                                           \
+            ZERROR_UID(_res).val;                                                       \
+        })
+
 #   define ZERROR_EXPECT(expr, msg)                         \
         ({  Z_TYPEOF(expr) ZERROR_UID(_res) = (expr);       \
             if (!ZERROR_UID(_res).is_ok)                    \
@@ -352,29 +1130,30 @@ int zerr_run(zres result);
 #else
     // Strict fallback (Standard C / MSVC).
     
-#   define ZERROR_CHECK(expr, src)                                      \
-        do {                                                            \
-            zres ZERROR_UID(_r) = (expr);                               \
-            if (!ZERROR_UID(_r).is_ok)                                  \
-            {                                                           \
-                return zres_err(ZERROR_TRACE_OP(ZERROR_UID(_r).err));   \
-            }                                                           \
-        } while(0)
-
-    #   define ZERROR_CHECK_INTO(RetType, expr, src)                        \
+#   define ZERROR_CHECK(expr, src)                                          \
         do {                                                                \
             zres ZERROR_UID(_r) = (expr);                                   \
             if (!ZERROR_UID(_r).is_ok)                                      \
             {                                                               \
-                return RetType##_err(ZERROR_TRACE_OP(ZERROR_UID(_r).err));  \
+                return zres_err(ZERROR_PROPAGATE_OP(ZERROR_UID(_r).err));   \
             }                                                               \
         } while(0)
+
+    #   define ZERROR_CHECK_INTO(RetType, expr, src)                            \
+        do {                                                                    \
+            zres ZERROR_UID(_r) = (expr);                                       \
+            if (!ZERROR_UID(_r).is_ok)                                          \
+            {                                                                   \
+                return RetType##_err(ZERROR_PROPAGATE_OP(ZERROR_UID(_r).err));  \
+            }                                                                   \
+        } while(0)
     
 #   define ZERROR_CHECK_WRAP(expr, src, fmt, ...)                                   \
         do {                                                                        \
             zres ZERROR_UID(_r) = (expr);                                           \
             if (!ZERROR_UID(_r).is_ok)                                              \
             {                                                                       \
+                ZERROR_UID(_r).err = ZERROR_STATS_OP(ZERROR_UID(_r).err);           \
                 return zres_err(zerr_wrap(ZERROR_UID(_r).err, fmt, ##__VA_ARGS__)); \
             }                                                                       \
         } while(0)
@@ -384,6 +1163,7 @@ int zerr_run(zres result);
             zres ZERROR_UID(_r) = (expr);                                               \
             if (!ZERROR_UID(_r).is_ok)                                                  \
             {                                                                           \
+                ZERROR_UID(_r).err = ZERROR_STATS_OP(ZERROR_UID(_r).err);               \
                 ZERROR_UID(_r).err = zerr_wrap(ZERROR_UID(_r).err, fmt, ##__VA_ARGS__); \
                 return zres_err(ZERROR_UID(_r).err);                                    \
             }                                                                           \
@@ -403,6 +1183,7 @@ int zerr_run(zres result);
     /// @row `try(expr)` | Evaluates `expr`. If error, returns it. Else returns the unwrapped value.
     /// @row `try_into(Type, expr)` | Same as `try`, but converts the error return type.
     /// @row `expect(expr, msg)` | Evaluates `expr`. If error, panics with `msg`.
+    /// @row `check_slim(expr)` / `try_slim(expr)` / `try_slim_into(Type, expr)` | `check`, `try` and `try_into` for `DEFINE_RESULT_SLIM` results.
     /// @row `ensure(cond, code, msg)` | Returns an error if `cond` is false.
     /// @row `run(expr)` | Executes entry point function (returning `zres`), printing errors on failure.
     /// @endgroup
@@ -421,6 +1202,9 @@ int zerr_run(zres result);
 #       define try_into(T, expr)    ZERROR_TRY_INTO(T, expr, #expr)
 #       define unwrap(expr)         ZERROR_EXPECT(expr, "unwrap() failed")
 #       define expect(e, m)         ZERROR_EXPECT(e, m)
+#       define check_slim(expr)     ZERROR_CHECK_SLIM(expr, #expr)
+#       define try_slim(expr)       ZERROR_TRY_SLIM(expr, #expr)
+#       define try_slim_into(T, expr) ZERROR_TRY_SLIM_INTO(T, expr, #expr)
 #   endif
 
 #   ifdef ZERROR_DEFER_HK
@@ -444,428 +1228,6419 @@ namespace z_log
     inline void error(const std::string &s) { log_error("%s", s.c_str()); }
 }
 
-/// @section API Reference (C++)
-/// 
-/// @section C++ Helpers
-/// @table Namespace z_log
-/// @columns Function | Description
-/// @row `z_log::info(fmt, ...)` | Logs an info message using C-style formatting.
-/// @row `z_log::warn(fmt, ...)` | Logs a warning message using C-style formatting.
-/// @row `z_log::error(fmt, ...)` | Logs an error message using C-style formatting.
-/// @row `z_log::info(str)` | Logs a `std::string` as info.
-/// @row `z_log::error(str)` | Logs a `std::string` as error.
-/// @endgroup
-///
-/// @section Result Type
-/// @table Class z_error::result<T>
-/// @columns Method | Description
-/// @row `result(val)` | Constructors for creating a success result (move or copy).
-/// @row `result(err)` | Constructors for creating a failure result from `zerr` or `zres`.
-/// @row `ok()` | Returns `true` if the result contains a value (success).
-/// @row `unwrap_val()` | Returns the contained value or panics if it is an error.
-/// @row `err` | Public member accessing the underlying `zerr` struct (valid only if !ok()).
-/// @row `operator bool()` | Implicit conversion to boolean (true = success).
-/// @endgroup
-///
-/// @section C++ Macros
-/// @table Shortcuts
-/// @columns Macro | Description
-/// @row `ztry(expr)` | Statement expression that unwraps a `result<T>` or returns the error immediately.
-/// @endgroup
+// Type-safe C++ front end: "{}" placeholders, formatted on the stack and handed
+// to the C pipeline as one "%s" argument, so sinks, levels, rate limits and the
+// flight recorder all apply unchanged.
+#ifndef ZLOG_FMT_MAX
+#   define ZLOG_FMT_MAX (ZLOG_ASYNC_RECORD_MAX / 2)
+#endif
 
-namespace z_error 
+#if defined(__cpp_consteval) && __cpp_consteval >= 201811L
+#   define ZLOG_FMT_CHECKED 1
+#else
+#   define ZLOG_FMT_CHECKED 0
+#endif
+
+namespace z_log
 {
-    template <typename T> 
-    class result 
+    // Appends into a fixed buffer, truncating (never overflowing) and keeping
+    // it NUL-terminated.
+    class writer
     {
-        bool is_ok_;
-        union 
-        { 
-            T val_; 
-            ::zerr err_; 
-        };
+        char *buf_;
+        size_t cap_;
+        size_t len_;
      public:
-        ::zerr err;
-        result(T &&v) : is_ok_(true), err{} 
+        writer(char *buf, size_t cap) noexcept : buf_(buf), cap_(cap), len_(0) 
+        { 
+            if (cap_) 
+            {
+                buf_[0] = '\0'; 
+            }
+        }
+
+        void append(const char *s, size_t n) noexcept
+        {
+            if (len_ + 1 >= cap_) 
+            {
+                return;
+            }
+            size_t room = cap_ - 1 - len_;
+            n = (n < room) ? n : room;
+            memcpy(buf_ + len_, s, n);
+            len_ += n;
+            buf_[len_] = '\0';
+        }
+
+        void append(const char *s) noexcept 
         { 
-            new (&val_) T(std::move(v)); 
+            append(s, strlen(s)); 
         }
 
-        result(const T &v) : is_ok_(true), err{} 
+        void put(char c) noexcept 
         { 
-            new (&val_) T(v); 
+            append(&c, 1); 
         }
-    
-        result(::zerr e) : is_ok_(false), err_(e), err(e) {}
 
-        result(::zres r) : is_ok_(false), err{} 
+        template <typename... A>
+        void printf(const char *fmt, A... a) noexcept
         {
-            if (r.is_ok) 
+            if (len_ + 1 >= cap_) 
             {
-                ::zerr_panic("Constructed result<T> from zres_ok", __FILE__, __LINE__);
+                return;
+            }
+            int n = snprintf(buf_ + len_, cap_ - len_, fmt, a...);
+            if (n > 0) 
+            {
+                len_ += ((size_t)n < cap_ - len_) ? (size_t)n : cap_ - len_ - 1;
+            }
+        }
+
+        const char *c_str() const noexcept 
+        { 
+            return buf_; 
+        }
+
+        size_t size() const noexcept 
+        { 
+            return len_; 
+        }
+    };
+
+    // The text between ':' and '}' of a placeholder ("" for "{}").
+    struct format_spec
+    {
+        const char *data;
+        size_t size;
+    };
+
+    // Specialize for your own types:
+    //   template <> struct z_log::formatter<point> 
+    //   { static void format(z_log::writer &w, const point &p, z_log::format_spec) { ... } };
+    template <typename T, typename Enable = void>
+    struct formatter;
+
+    namespace detail
+    {
+        // What a placeholder spec may hold for an argument type.
+        enum spec_kind 
+        { 
+            spec_free = 0,      // Not checked: the formatter reads its own specs.
+            spec_integer = 1,   // [flags][width][.precision][d i o u x X]
+            spec_floating = 2   // [flags][width][.precision][e E f F g G a A]
+        };
+
+        template <typename T>
+        struct spec_kind_of
+        {
+            typedef typename std::decay<T>::type U;
+            static const int value = std::is_floating_point<U>::value ? spec_floating
+                                   : (std::is_integral<U>::value && !std::is_same<U, bool>::value && 
+                                      !std::is_same<U, char>::value) ? spec_integer 
+                                   : spec_free;
+        };
+
+        // A parsed number spec. Every field is checked, so the printf format
+        // built from it can only hold what the argument type allows.
+        struct number_spec
+        {
+            char flags[6];      // Any of "-+ #0", NUL-terminated.
+            int width;          // -1 = none (at most 3 digits).
+            int precision;      // -1 = none (at most 3 digits).
+            char conv;          // 0 = the type's default.
+            bool ok;
+        };
+
+#if ZLOG_FMT_CHECKED
+#   define ZLOG__SPEC_FN constexpr
+#else
+#   define ZLOG__SPEC_FN inline
+#endif
+
+        ZLOG__SPEC_FN bool spec_has(const char *set, char c)
+        {
+            for (; *set; set++)
+            {
+                if (*set == c)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        ZLOG__SPEC_FN int spec_digits(const char *s, size_t n, size_t &i)
+        {
+            int v = 0;
+            size_t start = i;
+            while (i < n && i - start < 4 && s[i] >= '0' && s[i] <= '9')
+            {
+                v = v * 10 + (s[i++] - '0');
+            }
+            return (i - start > 3) ? -2 : v;
+        }
+
+        ZLOG__SPEC_FN number_spec parse_number_spec(const char *s, size_t n, int kind)
+        {
+            number_spec r = { { 0, 0, 0, 0, 0, 0 }, -1, -1, 0, false };
+            size_t i = 0;
+            size_t f = 0;
+            while (i < n && f < 5 && spec_has("-+ #0", s[i]))
+            {
+                r.flags[f++] = s[i++];
+            }
+            if (i < n && s[i] >= '1' && s[i] <= '9')
+            {
+                r.width = spec_digits(s, n, i);
+            }
+            if (i < n && '.' == s[i])
+            {
+                i++;
+                r.precision = spec_digits(s, n, i);
+            }
+            if (i < n && spec_has(spec_integer == kind ? "diouxX" : "eEfFgGaA", s[i]))
+            {
+                r.conv = s[i++];
+            }
+            // '#' is undefined for d, i and u.
+            bool alt_ok = spec_floating == kind || (r.conv && spec_has("oxX", r.conv));
+            r.ok = i == n && r.width != -2 && r.precision != -2 && (alt_ok || !spec_has(r.flags, '#'));
+            return r;
+        }
+
+        // Whether every spec of 'fmt' suits its argument ('kinds', one per argument).
+        ZLOG__SPEC_FN bool specs_match(const char *fmt, const int *kinds, size_t count)
+        {
+            size_t next = 0;
+            for (const char *p = fmt; *p; p++)
+            {
+                if (('{' == p[0] && '{' == p[1]) || ('}' == p[0] && '}' == p[1]))
+                {
+                    p++;
+                    continue;
+                }
+                if ('{' != *p || next >= count)
+                {
+                    continue;
+                }
+                const char *close = p;
+                while (*close && '}' != *close)
+                {
+                    close++;
+                }
+                if (!*close)
+                {
+                    return true;
+                }
+                int kind = kinds[next++];
+                if (':' == p[1] && spec_free != kind && 
+                    !parse_number_spec(p + 2, (size_t)(close - p - 2), kind).ok)
+                {
+                    return false;
+                }
+                p = close;
+            }
+            return true;
+        }
+
+#undef ZLOG__SPEC_FN
+
+        // Builds the printf format itself from a checked spec; a spec that
+        // does not suit the type is printed as written.
+        template <typename V>
+        void format_number(writer &w, V v, format_spec s, int kind, const char *length, char conv)
+        {
+            number_spec ns = parse_number_spec(s.data, s.size, kind);
+            if (!ns.ok)
+            {
+                w.append("{:");
+                w.append(s.data, s.size);
+                w.put('}');
+                return;
+            }
+            char f[32];
+            int n = snprintf(f, sizeof(f), "%%%s", ns.flags);
+            if (ns.width >= 0)
+            {
+                n += snprintf(f + n, sizeof(f) - (size_t)n, "%d", ns.width);
+            }
+            if (ns.precision >= 0)
+            {
+                n += snprintf(f + n, sizeof(f) - (size_t)n, ".%d", ns.precision);
             }
-            err_ = r.err; err = r.err;
+            char c = ns.conv ? ns.conv : conv;
+            if (spec_integer == kind && std::is_unsigned<V>::value && ('d' == c || 'i' == c))
+            {
+                c = 'u';
+            }
+            snprintf(f + n, sizeof(f) - (size_t)n, "%s%c", length, c);
+            if (spec_integer == kind && std::is_signed<V>::value && spec_has("oux", c | 0x20))
+            {
+                // Unsigned conversions of a signed value take its bits, as printf would.
+                w.printf(f, (unsigned long long)v);
+                return;
+            }
+            w.printf(f, v);
         }
 
-        result(result &&other) : is_ok_(other.is_ok_), err(other.err) 
+        // Plain "{}" integers skip snprintf.
+        inline void format_decimal(writer &w, unsigned long long v, bool neg)
         {
-            if (is_ok_) 
+            char digits[24];
+            char *p = digits + sizeof(digits);
+            do 
             {
-                new (&val_) T(std::move(other.val_)); 
+                *--p = (char)('0' + v % 10);
+                v /= 10;
+            } while (v);
+            if (neg) 
+            {
+                *--p = '-';
             }
-            else 
+            w.append(p, (size_t)(digits + sizeof(digits) - p));
+        }
+    }
+
+    template <typename T>
+    struct formatter<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value &&
+                                                !std::is_same<T, char>::value>::type>
+    {
+        static void format(writer &w, T v, format_spec s) 
+        { 
+            if (0 == s.size) 
             {
-                err_ = other.err_;
+                unsigned long long u = (unsigned long long)(long long)v;
+                detail::format_decimal(w, v < 0 ? 0 - u : u, v < 0);
+                return;
             }
+            detail::format_number(w, (long long)v, s, detail::spec_integer, "ll", 'd'); 
         }
+    };
 
-        ~result() 
+    template <typename T>
+    struct formatter<T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value &&
+                                                !std::is_same<T, bool>::value>::type>
+    {
+        static void format(writer &w, T v, format_spec s) 
         { 
-            if (is_ok_) 
+            if (0 == s.size) 
             {
-                val_.~T(); 
+                detail::format_decimal(w, (unsigned long long)v, false);
+                return;
             }
+            detail::format_number(w, (unsigned long long)v, s, detail::spec_integer, "ll", 'u'); 
         }
+    };
 
-        bool ok() const 
+    template <typename T>
+    struct formatter<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+    {
+        static void format(writer &w, T v, format_spec s) 
         { 
-            return is_ok_; 
+            detail::format_number(w, (double)v, s, detail::spec_floating, "", 'g'); 
         }
+    };
 
-        operator bool() const 
+    template <>
+    struct formatter<bool>
+    {
+        static void format(writer &w, bool v, format_spec) 
         { 
-            return is_ok_; 
+            w.append(v ? "true" : "false"); 
         }
+    };
 
-        T &unwrap_val() 
+    template <>
+    struct formatter<char>
+    {
+        static void format(writer &w, char v, format_spec) 
         { 
-            if (!is_ok_) 
-            { 
-                ::zerr_print(err_); 
-                abort(); 
-            } 
-            return val_; 
+            w.put(v); 
         }
     };
 
-    template <> 
-    class result<void> 
+    template <>
+    struct formatter<const char *>
     {
-        bool is_ok_;
-        ::zerr err_;
+        static void format(writer &w, const char *v, format_spec) 
+        { 
+            w.append(v ? v : "(null)"); 
+        }
+    };
+
+    template <>
+    struct formatter<char *> : formatter<const char *> {};
+
+    template <>
+    struct formatter<std::string>
+    {
+        static void format(writer &w, const std::string &v, format_spec) 
+        { 
+            w.append(v.data(), v.size()); 
+        }
+    };
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+    template <>
+    struct formatter<std::string_view>
+    {
+        static void format(writer &w, std::string_view v, format_spec) 
+        { 
+            w.append(v.data(), v.size()); 
+        }
+    };
+#endif
+
+    template <typename T>
+    struct formatter<T *, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type>
+    {
+        static void format(writer &w, const T *v, format_spec) 
+        { 
+            w.printf("%p", (const void *)v); 
+        }
+    };
+
+    template <>
+    struct formatter<::zerr>
+    {
+        static void format(writer &w, const ::zerr &e, format_spec) 
+        { 
+            const char *name = ::zerr_code_name(e.code);
+            if (name)
+            {
+                w.printf("%s (%s)", ::zerr_msg(e), name);
+                return;
+            }
+            w.printf("%s (code %d)", ::zerr_msg(e), e.code); 
+        }
+    };
+
+    namespace detail
+    {
+        // One type-erased argument; the scanning loop below is shared by
+        // every call instead of being instantiated per signature.
+        struct format_arg
+        {
+            const void *ptr;
+            void (*fn)(writer &w, const void *ptr, format_spec s);
+        };
+
+        template <typename A>
+        void format_erased(writer &w, const void *ptr, format_spec s)
+        {
+            formatter<typename std::decay<A>::type>::format(w, *static_cast<const A *>(ptr), s);
+        }
+
+        template <typename A>
+        format_arg make_arg(const A &a) noexcept
+        {
+            format_arg arg = { &a, &format_erased<A> };
+            return arg;
+        }
+
+        // Unmatched placeholders are copied through as written.
+        inline void vformat(writer &w, const char *fmt, const format_arg *args, size_t count)
+        {
+            size_t next = 0;
+            const char *lit = fmt;
+            const char *p = fmt;
+            while (*p)
+            {
+                if (('{' == p[0] && '{' == p[1]) || ('}' == p[0] && '}' == p[1]))
+                {
+                    w.append(lit, (size_t)(p - lit) + 1);
+                    p += 2;
+                    lit = p;
+                    continue;
+                }
+                if ('{' != *p)
+                {
+                    p++;
+                    continue;
+                }
+                const char *close = strchr(p, '}');
+                if (!close || next >= count)
+                {
+                    p++;
+                    continue;
+                }
+                w.append(lit, (size_t)(p - lit));
+                format_spec s = { p + 1, 0 };
+                if (':' == p[1])
+                {
+                    s.data = p + 2;
+                    s.size = (size_t)(close - p - 2);
+                }
+                args[next].fn(w, args[next].ptr, s);
+                next++;
+                p = close + 1;
+                lit = p;
+            }
+            w.append(lit, (size_t)(p - lit));
+        }
+
+        constexpr int count_closing(const char *s, int n);
+
+        // Number of "{...}" placeholders, or -1 if a brace is unbalanced.
+        constexpr int count_placeholders(const char *s, int n = 0)
+        {
+            return !*s ? n
+                 : ('{' == s[0] && '{' == s[1]) || ('}' == s[0] && '}' == s[1]) ? count_placeholders(s + 2, n)
+                 : '}' == s[0] ? -1
+                 : '{' == s[0] ? count_closing(s + 1, n)
+                 : count_placeholders(s + 1, n);
+        }
+
+        constexpr int count_closing(const char *s, int n)
+        {
+            return !*s || '{' == *s ? -1
+                 : '}' == *s ? count_placeholders(s + 1, n + 1)
+                 : count_closing(s + 1, n);
+        }
+
+        template <typename T>
+        struct identity 
+        { 
+            typedef T type; 
+        };
+
+        // Not constexpr: reaching them during constant evaluation is the error.
+        inline void format_string_does_not_match_arguments() {}
+        inline void format_spec_does_not_suit_argument() {}
+    }
+
+    // A format string for Args... . Under C++20 the placeholder count, and
+    // the spec of each number placeholder, are checked at compile time.
+    template <typename... Args>
+    class basic_format_string
+    {
+        const char *str_;
      public:
-        ::zerr err; 
+#if ZLOG_FMT_CHECKED
+        template <typename S>
+        consteval basic_format_string(const S &s) : str_(s)
+        {
+            if (detail::count_placeholders(str_) != (int)sizeof...(Args))
+            {
+                detail::format_string_does_not_match_arguments();
+            }
+            const int kinds[] = { detail::spec_kind_of<Args>::value..., 0 };
+            if (!detail::specs_match(str_, kinds, sizeof...(Args)))
+            {
+                detail::format_spec_does_not_suit_argument();
+            }
+        }
+#else
+        basic_format_string(const char *s) noexcept : str_(s) {}
+#endif
+
+        const char *get() const noexcept 
+        { 
+            return str_; 
+        }
+    };
+
+    template <typename... Args>
+    using format_string = basic_format_string<typename detail::identity<Args>::type...>;
+
+    // Formats into 'buf' (always NUL-terminated); returns the length written.
+    template <typename... Args>
+    size_t format_to(char *buf, size_t size, format_string<Args...> fmt, const Args &...args)
+    {
+        writer w(buf, size);
+        const detail::format_arg list[] = { detail::make_arg(args)..., { NULL, NULL } };
+        detail::vformat(w, fmt.get(), list, sizeof...(Args));
+        return w.size();
+    }
+
+    namespace detail
+    {
+        template <typename... Args>
+        void emit(zlog_level level, const char *file, int line, const char *func,
+                  format_string<Args...> fmt, const Args &...args)
+        {
+            char buf[ZLOG_FMT_MAX];
+            format_to<Args...>(buf, sizeof(buf), fmt, args...);
+            zlog_msg(level, file, line, func, "%s", buf);
+        }
+    }
+}
+
+// Same gate as the C macros: the level test runs before any argument is formatted.
+#define ZLOG__FMT(lvl, ...)                                             \
+    do                                                                  \
+    {                                                                   \
+        if ((lvl) >= ZLOG_COMPILE_LEVEL && ZERROR_UNLIKELY((lvl) >= zlog__gate)) \
+        {                                                               \
+            z_log::detail::emit(lvl, __FILE__, __LINE__, __func__, __VA_ARGS__); \
+        }                                                               \
+    } while (0)
+
+#define log_trace_fmt(...) ZLOG__FMT(ZLOG_TRACE, __VA_ARGS__)
+#define log_debug_fmt(...) ZLOG__FMT(ZLOG_DEBUG, __VA_ARGS__)
+#define log_info_fmt(...)  ZLOG__FMT(ZLOG_INFO,  __VA_ARGS__)
+#define log_warn_fmt(...)  ZLOG__FMT(ZLOG_WARN,  __VA_ARGS__)
+#define log_error_fmt(...) ZLOG__FMT(ZLOG_ERROR, __VA_ARGS__)
+#define log_fatal_fmt(...) ZLOG__FMT(ZLOG_FATAL, __VA_ARGS__)
+
+/// @section API Reference (C++)
+/// 
+/// @section C++ Helpers
+/// @table Namespace z_log
+/// @columns Function | Description
+/// @row `z_log::info(fmt, ...)` | Logs an info message using C-style formatting.
+/// @row `z_log::warn(fmt, ...)` | Logs a warning message using C-style formatting.
+/// @row `z_log::error(fmt, ...)` | Logs an error message using C-style formatting.
+/// @row `z_log::info(str)` | Logs a `std::string` as info.
+/// @row `z_log::error(str)` | Logs a `std::string` as error.
+/// @row `log_info_fmt(fmt, ...)` | Logs with `{}` placeholders (also `_trace`, `_debug`, `_warn`, `_error`, `_fatal`). Checked at compile time under C++20.
+/// @row `z_log::format_to(buf, size, fmt, ...)` | Formats with `{}` placeholders into a buffer; returns the length written.
+/// @row `z_log::formatter<T>` | Trait to specialize with `static void format(z_log::writer &, const T &, z_log::format_spec)`.
+/// @endgroup
+///
+/// @section Result Type
+/// @table Class z_error::result<T>
+/// @columns Method | Description
+/// @row `result(val)` | Constructors for creating a success result (move or copy).
+/// @row `result(err)` | Constructors for creating a failure result from `zerr` or `zres`.
+/// @row `result(other)` | Copy and move constructors and assignment; copies exist only when `T` is copyable.
+/// @row `ok()` | Returns `true` if the result contains a value (success).
+/// @row `unwrap_val()` | Returns the contained value or panics if it is an error.
+/// @row `err` | Public member accessing the underlying `zerr` struct (valid only if !ok()).
+/// @row `operator bool()` | Implicit conversion to boolean (true = success).
+/// @row `has_value()`, `value()`, `error()`, `*r`, `r->` | `std::expected`-style accessors; `value()` panics on error.
+/// @row `value_or(def)` | Returns the value, or `def` converted to `T` on error.
+/// @row `and_then(f)` | Calls `f(value)` returning `result<U>`; an error is passed through.
+/// @row `transform(f)` / `map(f)` | Wraps `f(value)` in a `result<U>` (`result<void>` if `f` returns nothing).
+/// @row `or_else(f)` | Calls `f(err)` returning `result<T>` on error; a value is passed through.
+/// @row `transform_error(f)` | Replaces the error with `f(err)`, which returns a `zerr`.
+/// @endgroup
+///
+/// @table Class z_error::owned
+/// @columns Method | Description
+/// @row `owned(e)` | Clones `e` with `zerr_clone`. Move-only; the destructor calls `zerr_free`.
+/// @row `code()` / `msg()` | The outermost code and message, readable on any thread.
+/// @row `get()` | Rebuilds the error on the calling thread; valid while the `owned` lives.
+/// @row `operator bool()` | `false` if empty, moved from, or the clone could not be allocated.
+/// @endgroup
+///
+/// @section C++ Macros
+/// @table Shortcuts
+/// @columns Macro | Description
+/// @row `ztry(expr)` | Statement expression that unwraps a `result<T>` or returns the error immediately.
+/// @endgroup
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#   define ZERROR_NODISCARD [[nodiscard]]
+#else
+#   define ZERROR_NODISCARD
+#endif
+
+namespace z_error 
+{
+    template <typename T> class result;
+    template <> class result<void>;
+
+    namespace detail
+    {
+        // Result type of calling F with A... (std::invoke_result_t, C++11).
+        template <typename F, typename... A>
+        using invoke_t = decltype(std::declval<F>()(std::declval<A>()...));
+
+        template <typename R>
+        struct is_result : std::false_type {};
+
+        template <typename U>
+        struct is_result<result<U>> : std::true_type {};
+
+        // transform(): wraps the callable's return value, or builds a
+        // result<void> when it returns nothing. Defined after result<void>.
+        template <typename U>
+        struct map_apply;
+
+        template <typename F, typename... A>
+        using map_t = result<typename std::decay<invoke_t<F, A...>>::type>;
+
+        // The value and the error share one slot; 'is_ok_' says which one
+        // is live. Trivially destructible T keeps the implicit destructor.
+        template <typename T, bool = std::is_trivially_destructible<T>::value>
+        struct result_storage
+        {
+            union 
+            { 
+                T val_; 
+                ::zerr err; 
+            };
+            bool is_ok_;
+
+            // Starts empty: if T's constructor throws, nothing is destroyed.
+            result_storage() noexcept : is_ok_(false) {}
+        };
+
+        template <typename T>
+        struct result_storage<T, false>
+        {
+            union 
+            { 
+                T val_; 
+                ::zerr err; 
+            };
+            bool is_ok_;
 
-        result() : is_ok_(true), err_{0, NULL, NULL, 0, NULL, NULL}, err{} {}
+            result_storage() noexcept : is_ok_(false) {}
 
-        result(::zerr e) : is_ok_(false), err_(e), err(e) {}
+            ~result_storage() 
+            { 
+                if (is_ok_) 
+                {
+                    val_.~T(); 
+                }
+            }
+        };
+
+        // Copy and move. Trivially copyable T gets the defaulted (trivial)
+        // members, so result<int> is memcpy-able and returned in registers
+        // where the ABI allows it.
+        template <typename T, bool = std::is_trivially_copyable<T>::value>
+        struct result_copy : result_storage<T>
+        {
+        };
+
+        template <typename T>
+        struct result_copy<T, false> : result_storage<T>
+        {
+            result_copy() noexcept {}
+
+            result_copy(const result_copy &other) 
+                noexcept(std::is_nothrow_copy_constructible<T>::value)
+            {
+                this->is_ok_ = other.is_ok_;
+                if (other.is_ok_) 
+                {
+                    new (&this->val_) T(other.val_); 
+                }
+                else 
+                {
+                    this->err = other.err;
+                }
+            }
+
+            result_copy(result_copy &&other) 
+                noexcept(std::is_nothrow_move_constructible<T>::value)
+            {
+                this->is_ok_ = other.is_ok_;
+                if (other.is_ok_) 
+                {
+                    new (&this->val_) T(std::move(other.val_)); 
+                }
+                else 
+                {
+                    this->err = other.err;
+                }
+            }
+
+            result_copy &operator=(const result_copy &other) 
+                noexcept(std::is_nothrow_copy_constructible<T>::value &&
+                         std::is_nothrow_copy_assignable<T>::value)
+            {
+                if (this != &other)
+                {
+                    assign(other.is_ok_, other.val_, other.err);
+                }
+                return *this;
+            }
+
+            result_copy &operator=(result_copy &&other) 
+                noexcept(std::is_nothrow_move_constructible<T>::value &&
+                         std::is_nothrow_move_assignable<T>::value)
+            {
+                if (this != &other)
+                {
+                    assign(other.is_ok_, std::move(other.val_), other.err);
+                }
+                return *this;
+            }
+
+         private:
+            template <typename U>
+            void assign(bool ok, U &&val, const ::zerr &e)
+            {
+                if (this->is_ok_ && ok) 
+                {
+                    this->val_ = std::forward<U>(val);
+                }
+                else if (ok) 
+                {
+                    // Construct first: if T throws, we still hold the error.
+                    new (&this->val_) T(std::forward<U>(val));
+                    this->is_ok_ = true;
+                }
+                else 
+                {
+                    if (this->is_ok_) 
+                    {
+                        this->val_.~T();
+                        this->is_ok_ = false;
+                    }
+                    this->err = e;
+                }
+            }
+        };
+
+        // Deletes the copy members of result<T> when T cannot be copied, so
+        // std::is_copy_constructible<result<std::unique_ptr<X>>> is false.
+        template <bool Copyable>
+        struct result_copy_gate 
+        {
+        };
+
+        template <>
+        struct result_copy_gate<false>
+        {
+            result_copy_gate() = default;
+            result_copy_gate(const result_copy_gate &) = delete;
+            result_copy_gate(result_copy_gate &&) = default;
+            result_copy_gate &operator=(const result_copy_gate &) = delete;
+            result_copy_gate &operator=(result_copy_gate &&) = default;
+        };
+    }
+
+    template <typename T> 
+    class ZERROR_NODISCARD result 
+        : private detail::result_copy<T>,
+          private detail::result_copy_gate<std::is_copy_constructible<T>::value>
+    {
+     public:
+        using detail::result_storage<T>::err;
+
+        result(T &&v) noexcept(std::is_nothrow_move_constructible<T>::value)
+        { 
+            new (&this->val_) T(std::move(v)); 
+            this->is_ok_ = true;
+        }
+
+        result(const T &v) noexcept(std::is_nothrow_copy_constructible<T>::value)
+        { 
+            new (&this->val_) T(v); 
+            this->is_ok_ = true;
+        }
+    
+        result(::zerr e) noexcept
+        {
+            this->err = e;
+            this->is_ok_ = false;
+        }
+
+        result(::zres r) 
+        {
+            if (r.is_ok) 
+            {
+                ::zerr_panic("Constructed result<T> from zres_ok", __FILE__, __LINE__);
+            }
+            this->err = r.err;
+            this->is_ok_ = false;
+        }
+
+        bool ok() const noexcept
+        { 
+            return this->is_ok_; 
+        }
+
+        operator bool() const noexcept
+        { 
+            return this->is_ok_; 
+        }
+
+        T &unwrap_val() 
+        { 
+            if (!this->is_ok_) 
+            { 
+                ::zerr_print(this->err); 
+                abort(); 
+            } 
+            return this->val_; 
+        }
+
+        // std::expected-compatible accessors. value() panics like
+        // unwrap_val() instead of throwing.
+        bool has_value() const noexcept
+        {
+            return this->is_ok_;
+        }
+
+        T &value() &
+        {
+            return unwrap_val();
+        }
+
+        const T &value() const &
+        {
+            return const_cast<result *>(this)->unwrap_val();
+        }
+
+        T &&value() &&
+        {
+            return std::move(unwrap_val());
+        }
+
+        const ::zerr &error() const noexcept
+        {
+            return this->err;
+        }
+
+        T &operator*() & noexcept
+        {
+            return this->val_;
+        }
+
+        const T &operator*() const & noexcept
+        {
+            return this->val_;
+        }
+
+        T &&operator*() && noexcept
+        {
+            return std::move(this->val_);
+        }
+
+        T *operator->() noexcept
+        {
+            return &this->val_;
+        }
+
+        const T *operator->() const noexcept
+        {
+            return &this->val_;
+        }
+
+        template <typename U>
+        T value_or(U &&def) const &
+        {
+            return this->is_ok_ ? this->val_ : static_cast<T>(std::forward<U>(def));
+        }
+
+        template <typename U>
+        T value_or(U &&def) &&
+        {
+            return this->is_ok_ ? std::move(this->val_) : static_cast<T>(std::forward<U>(def));
+        }
+
+        // Combinators. Each is a single branch once inlined; the && overloads
+        // move the value into the callable.
+
+        // f(T) -> result<U>. Errors pass through unchanged.
+        template <typename F>
+        detail::invoke_t<F, T &> and_then(F &&f) &
+        {
+            static_assert(detail::is_result<detail::invoke_t<F, T &>>::value, "and_then() callable must return a result<U>");
+            if (this->is_ok_)
+            {
+                return std::forward<F>(f)(this->val_);
+            }
+            return detail::invoke_t<F, T &>(this->err);
+        }
+
+        template <typename F>
+        detail::invoke_t<F, const T &> and_then(F &&f) const &
+        {
+            static_assert(detail::is_result<detail::invoke_t<F, const T &>>::value, "and_then() callable must return a result<U>");
+            if (this->is_ok_)
+            {
+                return std::forward<F>(f)(this->val_);
+            }
+            return detail::invoke_t<F, const T &>(this->err);
+        }
+
+        template <typename F>
+        detail::invoke_t<F, T &&> and_then(F &&f) &&
+        {
+            static_assert(detail::is_result<detail::invoke_t<F, T &&>>::value, "and_then() callable must return a result<U>");
+            if (this->is_ok_)
+            {
+                return std::forward<F>(f)(std::move(this->val_));
+            }
+            return detail::invoke_t<F, T &&>(this->err);
+        }
+
+        // f(T) -> U, giving result<U> (result<void> if f returns void).
+        template <typename F>
+        detail::map_t<F, T &> transform(F &&f) &
+        {
+            typedef typename std::decay<detail::invoke_t<F, T &>>::type U;
+            if (this->is_ok_)
+            {
+                return detail::map_apply<U>::apply(std::forward<F>(f), this->val_);
+            }
+            return result<U>(this->err);
+        }
+
+        template <typename F>
+        detail::map_t<F, const T &> transform(F &&f) const &
+        {
+            typedef typename std::decay<detail::invoke_t<F, const T &>>::type U;
+            if (this->is_ok_)
+            {
+                return detail::map_apply<U>::apply(std::forward<F>(f), this->val_);
+            }
+            return result<U>(this->err);
+        }
+
+        template <typename F>
+        detail::map_t<F, T &&> transform(F &&f) &&
+        {
+            typedef typename std::decay<detail::invoke_t<F, T &&>>::type U;
+            if (this->is_ok_)
+            {
+                return detail::map_apply<U>::apply(std::forward<F>(f), std::move(this->val_));
+            }
+            return result<U>(this->err);
+        }
+
+        // Alias of transform().
+        template <typename F>
+        detail::map_t<F, T &> map(F &&f) &
+        {
+            return transform(std::forward<F>(f));
+        }
+
+        template <typename F>
+        detail::map_t<F, const T &> map(F &&f) const &
+        {
+            return transform(std::forward<F>(f));
+        }
+
+        template <typename F>
+        detail::map_t<F, T &&> map(F &&f) &&
+        {
+            return std::move(*this).transform(std::forward<F>(f));
+        }
+
+        // f(zerr) -> result<T>, called only on error (recovery).
+        template <typename F>
+        result or_else(F &&f) const &
+        {
+            static_assert(std::is_same<detail::invoke_t<F, const ::zerr &>, result>::value, "or_else() callable must return the same result<T>");
+            if (this->is_ok_)
+            {
+                return *this;
+            }
+            return std::forward<F>(f)(this->err);
+        }
+
+        template <typename F>
+        result or_else(F &&f) &&
+        {
+            static_assert(std::is_same<detail::invoke_t<F, const ::zerr &>, result>::value, "or_else() callable must return the same result<T>");
+            if (this->is_ok_)
+            {
+                return std::move(*this);
+            }
+            return std::forward<F>(f)(this->err);
+        }
+
+        // f(zerr) -> zerr, called only on error. The error type is always
+        // zerr, so unlike std::expected the result type does not change.
+        template <typename F>
+        result transform_error(F &&f) const &
+        {
+            if (this->is_ok_)
+            {
+                return *this;
+            }
+            return result(static_cast<::zerr>(std::forward<F>(f)(this->err)));
+        }
+
+        template <typename F>
+        result transform_error(F &&f) &&
+        {
+            if (this->is_ok_)
+            {
+                return std::move(*this);
+            }
+            return result(static_cast<::zerr>(std::forward<F>(f)(this->err)));
+        }
+    };
+
+    template <> 
+    class ZERROR_NODISCARD result<void> 
+    {
+        bool is_ok_;
+     public:
+        ::zerr err; 
+
+        result() noexcept : is_ok_(true), err{} {}
+
+        result(::zerr e) noexcept : is_ok_(false), err(e) {}
+
+        result(::zres r) noexcept : is_ok_(r.is_ok), err(r.err) {}
+
+        static result<void> success() noexcept
+        { 
+            return result<void>(); 
+        }
+
+        bool ok() const noexcept
+        { 
+            return is_ok_; 
+        }
+
+        operator bool() const noexcept
+        { 
+            return is_ok_; 
+        }
+
+        void unwrap_val() 
+        { 
+            if (!is_ok_) 
+            { 
+                ::zerr_print(err);
+                abort(); 
+            } 
+        }
+
+        bool has_value() const noexcept
+        {
+            return is_ok_;
+        }
+
+        void value() const
+        {
+            const_cast<result *>(this)->unwrap_val();
+        }
+
+        const ::zerr &error() const noexcept
+        {
+            return err;
+        }
+
+        // f() -> result<U>.
+        template <typename F>
+        detail::invoke_t<F> and_then(F &&f) const
+        {
+            static_assert(detail::is_result<detail::invoke_t<F>>::value, "and_then() callable must return a result<U>");
+            if (is_ok_)
+            {
+                return std::forward<F>(f)();
+            }
+            return detail::invoke_t<F>(err);
+        }
+
+        // f() -> U, giving result<U>.
+        template <typename F>
+        detail::map_t<F> transform(F &&f) const
+        {
+            typedef typename std::decay<detail::invoke_t<F>>::type U;
+            if (is_ok_)
+            {
+                return detail::map_apply<U>::apply(std::forward<F>(f));
+            }
+            return result<U>(err);
+        }
+
+        template <typename F>
+        detail::map_t<F> map(F &&f) const
+        {
+            return transform(std::forward<F>(f));
+        }
+
+        template <typename F>
+        result or_else(F &&f) const
+        {
+            static_assert(std::is_same<detail::invoke_t<F, const ::zerr &>, result>::value, "or_else() callable must return result<void>");
+            if (is_ok_)
+            {
+                return *this;
+            }
+            return std::forward<F>(f)(err);
+        }
+
+        template <typename F>
+        result transform_error(F &&f) const
+        {
+            if (is_ok_)
+            {
+                return *this;
+            }
+            return result(static_cast<::zerr>(std::forward<F>(f)(err)));
+        }
+    };
+    
+    namespace detail
+    {
+        template <typename U>
+        struct map_apply
+        {
+            template <typename F, typename... A>
+            static result<U> apply(F &&f, A &&...a)
+            {
+                return result<U>(std::forward<F>(f)(std::forward<A>(a)...));
+            }
+        };
+
+        template <>
+        struct map_apply<void>
+        {
+            template <typename F, typename... A>
+            static result<void> apply(F &&f, A &&...a)
+            {
+                std::forward<F>(f)(std::forward<A>(a)...);
+                return result<void>();
+            }
+        };
+    }
+
+    template <typename T> inline result<T> from_c_res(T val) 
+    { 
+        return result<T>(val); 
+    }
+
+    // A zerr_clone block with a single owner, for handing an error to another thread.
+    class owned
+    {
+    public:
+        owned() noexcept : o_(nullptr) {}
+        explicit owned(const ::zerr &e) : o_(::zerr_clone(e)) {}
+        owned(owned &&other) noexcept : o_(other.o_) 
+        { 
+            other.o_ = nullptr; 
+        }
+        owned(const owned &) = delete;
+        owned &operator=(const owned &) = delete;
+
+        owned &operator=(owned &&other) noexcept
+        {
+            if (this != &other)
+            {
+                ::zerr_free(o_);
+                o_ = other.o_;
+                other.o_ = nullptr;
+            }
+            return *this;
+        }
+
+        ~owned() 
+        { 
+            ::zerr_free(o_); 
+        }
+
+        explicit operator bool() const noexcept { return nullptr != o_; }
+        int code() const noexcept               { return ::zerr_owned_code(o_); }
+        const char *msg() const noexcept        { return ::zerr_owned_msg(o_); }
+        ::zerr get() const                      { return ::zerr_owned_get(o_); }
+
+    private:
+        ::zerr_owned *o_;
+    };
+}
+
+#if ZERROR_HAS_COROUTINES
+
+/// @section Coroutines (C++20)
+/// @table Class z_error::task<T>
+/// @columns Member | Description
+/// @row `co_await r` | Inside a `task<U>`: yields the value of a `result<T>`, or ends the coroutine with its error.
+/// @row `co_return v` | Completes the task with a value, a `zerr` or a `zres`.
+/// @row `co_await t` | Runs a `task<T>` and yields its value, or ends the awaiting task with its error.
+/// @row `co_await t.as_result()` | Runs a `task<T>` and yields its whole `result<T>`, from any coroutine.
+/// @row `get()` | Runs the task on the calling thread and returns its `result<T>`.
+/// @row `done()` | Returns `true` once the task has finished.
+/// @endgroup
+
+namespace z_error
+{
+    template <typename T> class task;
+
+    namespace detail
+    {
+        // Ends an awaiting task with an error; type-erased on its promise so a
+        // child task can fail its parent without knowing the parent's type.
+        typedef std::coroutine_handle<> (*coro_fail_fn)(void *frame, const ::zerr &e);
+
+        template <typename P>
+        std::coroutine_handle<> coro_fail(void *frame, const ::zerr &e) noexcept
+        {
+            return std::coroutine_handle<P>::from_address(frame).promise().fail(e);
+        }
+
+        inline ::zerr coro_nomem()
+        {
+            return zerr_create(Z_ENOMEM, "Coroutine frame allocation failed");
+        }
+
+        template <typename T>
+        struct task_promise_base
+        {
+            result<T> res_ = result<T>(::zerr{});
+            std::coroutine_handle<> continuation_;
+            coro_fail_fn fail_parent_ = nullptr;
+            bool done_ = false;
+
+            // Frames go through the library allocator. A failed allocation
+            // gives a task whose result is Z_ENOMEM, never an exception.
+            static void *operator new(size_t n) noexcept 
+            { 
+                return Z_MALLOC(n); 
+            }
+
+            static void operator delete(void *p) noexcept 
+            { 
+                Z_FREE(p); 
+            }
+
+            std::suspend_always initial_suspend() const noexcept 
+            { 
+                return {}; 
+            }
+
+            struct final_awaiter
+            {
+                bool await_ready() const noexcept 
+                { 
+                    return false; 
+                }
+
+                template <typename P>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+                {
+                    return h.promise().finish();
+                }
+
+                void await_resume() const noexcept {}
+            };
+
+            final_awaiter final_suspend() const noexcept 
+            { 
+                return {}; 
+            }
+
+            void unhandled_exception()
+            {
+#if defined(__cpp_exceptions)
+                throw;
+#else
+                abort();
+#endif
+            }
+
+            // Stores the error and ends the coroutine where it stands; the
+            // frame is destroyed with the task.
+            std::coroutine_handle<> fail(const ::zerr &e) noexcept
+            {
+                res_ = result<T>(ZERROR_STATS_OP(e));
+                return finish();
+            }
+
+            std::coroutine_handle<> finish() noexcept
+            {
+                done_ = true;
+                if (!continuation_)
+                {
+                    return std::noop_coroutine();
+                }
+                if (fail_parent_ && !res_.has_value())
+                {
+                    return fail_parent_(continuation_.address(), res_.error());
+                }
+                return continuation_;
+            }
+        };
+
+        template <typename T>
+        struct task_promise : task_promise_base<T>
+        {
+            task<T> get_return_object() noexcept;
+
+            static task<T> get_return_object_on_allocation_failure() noexcept;
+
+            void return_value(T v) 
+            { 
+                this->res_ = result<T>(std::move(v)); 
+            }
+
+            void return_value(result<T> r) 
+            { 
+                this->res_ = std::move(r); 
+            }
+        };
+
+        template <>
+        struct task_promise<void> : task_promise_base<void>
+        {
+            task<void> get_return_object() noexcept;
+
+            static task<void> get_return_object_on_allocation_failure() noexcept;
+
+            void return_void() noexcept 
+            { 
+                res_ = result<void>(); 
+            }
+        };
+
+        // co_await on a result: no suspension on success; on error the
+        // awaiting task ends with the error. Rvalue results yield by value.
+        template <typename R>
+        using await_value_t = typename std::conditional<std::is_lvalue_reference<R>::value,
+            decltype(std::declval<R>().value()),
+            typename std::decay<decltype(std::declval<R>().value())>::type>::type;
+
+        template <typename R>
+        struct result_awaiter
+        {
+            typename std::remove_reference<R>::type *r_;
+
+            bool await_ready() const noexcept 
+            { 
+                return r_->has_value(); 
+            }
+
+            template <typename P>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+            {
+                return h.promise().fail(r_->error());
+            }
+
+            await_value_t<R> await_resume() 
+            { 
+                return static_cast<R>(*r_).value(); 
+            }
+        };
+    }
+
+    template <typename T>
+    detail::result_awaiter<result<T> &> operator co_await(result<T> &r) noexcept 
+    { 
+        return { &r }; 
+    }
+
+    template <typename T>
+    detail::result_awaiter<const result<T> &> operator co_await(const result<T> &r) noexcept 
+    { 
+        return { &r }; 
+    }
+
+    template <typename T>
+    detail::result_awaiter<result<T> &&> operator co_await(result<T> &&r) noexcept 
+    { 
+        return { &r }; 
+    }
+
+    // Lazy coroutine carrying a result<T>. It starts when awaited or on
+    // get(), and resumes its awaiter by symmetric transfer when it ends.
+    template <typename T>
+    class ZERROR_NODISCARD task
+    {
+     public:
+        typedef detail::task_promise<T> promise_type;
+        typedef std::coroutine_handle<promise_type> handle;
+
+        template <bool Unwrap>
+        struct awaiter
+        {
+            handle h_;
+
+            bool await_ready() const noexcept
+            {
+                return !Unwrap && (!h_ || h_.promise().done_);
+            }
+
+            template <typename P>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<P> parent) noexcept
+            {
+                if constexpr (Unwrap)
+                {
+                    if (!h_)
+                    {
+                        return parent.promise().fail(detail::coro_nomem());
+                    }
+                    h_.promise().fail_parent_ = &detail::coro_fail<P>;
+                }
+                h_.promise().continuation_ = parent;
+                if (h_.promise().done_)
+                {
+                    return h_.promise().finish();
+                }
+                return h_;
+            }
+
+            typename std::conditional<Unwrap, T, result<T>>::type await_resume()
+            {
+                if constexpr (Unwrap)
+                {
+                    return std::move(h_.promise().res_).value();
+                }
+                else
+                {
+                    if (!h_)
+                    {
+                        return result<T>(detail::coro_nomem());
+                    }
+                    return std::move(h_.promise().res_);
+                }
+            }
+        };
+
+        explicit task(handle h = handle()) noexcept : h_(h) {}
+
+        task(task &&other) noexcept : h_(other.h_) 
+        { 
+            other.h_ = handle(); 
+        }
+
+        task &operator=(task &&other) noexcept
+        {
+            if (this != &other)
+            {
+                if (h_) 
+                {
+                    h_.destroy();
+                }
+                h_ = other.h_;
+                other.h_ = handle();
+            }
+            return *this;
+        }
+
+        task(const task &) = delete;
+        task &operator=(const task &) = delete;
+
+        ~task() 
+        { 
+            if (h_) 
+            {
+                h_.destroy(); 
+            }
+        }
+
+        bool done() const noexcept 
+        { 
+            return !h_ || h_.promise().done_; 
+        }
+
+        // Runs the task to completion on this thread. Panics if it suspends
+        // on something other than zerror results and tasks.
+        result<T> get()
+        {
+            if (!h_)
+            {
+                return result<T>(detail::coro_nomem());
+            }
+            if (!h_.promise().done_)
+            {
+                h_.resume();
+                if (!h_.promise().done_)
+                {
+                    ::zerr_panic("task<T>::get() on a task suspended outside zerror", __FILE__, __LINE__);
+                }
+            }
+            return std::move(h_.promise().res_);
+        }
+
+        awaiter<true> operator co_await() && noexcept 
+        { 
+            return { h_ }; 
+        }
+
+        awaiter<false> as_result() && noexcept 
+        { 
+            return { h_ }; 
+        }
+
+     private:
+        handle h_;
+    };
+
+    namespace detail
+    {
+        template <typename T>
+        task<T> task_promise<T>::get_return_object() noexcept
+        {
+            return task<T>(task<T>::handle::from_promise(*this));
+        }
+
+        template <typename T>
+        task<T> task_promise<T>::get_return_object_on_allocation_failure() noexcept
+        {
+            return task<T>();
+        }
+
+        inline task<void> task_promise<void>::get_return_object() noexcept
+        {
+            return task<void>(task<void>::handle::from_promise(*this));
+        }
+
+        inline task<void> task_promise<void>::get_return_object_on_allocation_failure() noexcept
+        {
+            return task<void>();
+        }
+    }
+}
+
+#endif // ZERROR_HAS_COROUTINES
+
+#if defined(ZERROR_SHORT_NAMES) && (defined(__GNUC__) || defined(__clang__))
+#   define ztry(expr) ({ auto _r = (expr); if (!_r.ok()) return ZERROR_STATS_OP(_r.err); std::move(_r.unwrap_val()); })
+#endif
+
+#endif // __cplusplus
+
+#endif // ZERROR_H
+
+#ifdef ZERROR_IMPLEMENTATION
+#ifndef ZERROR_IMPLEMENTATION_GUARD
+#define ZERROR_IMPLEMENTATION_GUARD
+
+#include <time.h> 
+
+#if defined(_WIN32)
+#   define WIN32_LEAN_AND_MEAN
+#   include <windows.h>
+#else
+#   include <pthread.h>
+#   include <sched.h>
+#   include <sys/time.h>
+#   include <unistd.h>
+#   include <fcntl.h>
+#   include <sys/socket.h>
+#   include <sys/un.h>
+#   include <signal.h>
+#   if defined(__GLIBC__) || defined(__APPLE__)
+#       include <execinfo.h>
+#       define ZERROR_HAS_BACKTRACE 1
+#   endif
+#endif
+
+// Atomics (64-bit counters only), and a full fence for store-then-load handshakes.
+#if defined(_MSC_VER) && !defined(__clang__)
+static bool zerr__cas(volatile unsigned long long *p, unsigned long long *expected, unsigned long long desired)
+{
+    LONG64 prev = InterlockedCompareExchange64((volatile LONG64 *)p, (LONG64)desired, (LONG64)*expected);
+    if ((unsigned long long)prev == *expected)
+    {
+        return true;
+    }
+    *expected = (unsigned long long)prev;
+    return false;
+}
+#   define ZERROR_ATOMIC_LOAD(p)      ((unsigned long long)InterlockedCompareExchange64((volatile LONG64 *)(p), 0, 0))
+#   define ZERROR_ATOMIC_STORE(p, v)  ((void)InterlockedExchange64((volatile LONG64 *)(p), (LONG64)(v)))
+#   define ZERROR_ATOMIC_ADD(p, v)    ((unsigned long long)InterlockedExchangeAdd64((volatile LONG64 *)(p), (LONG64)(v)))
+#   define ZERROR_ATOMIC_CAS(p, e, d) zerr__cas((p), (e), (d))
+#   define ZERROR_ATOMIC_FENCE()      MemoryBarrier()
+#else
+#   define ZERROR_ATOMIC_LOAD(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#   define ZERROR_ATOMIC_STORE(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#   define ZERROR_ATOMIC_ADD(p, v)    __atomic_fetch_add((p), (v), __ATOMIC_ACQ_REL)
+#   define ZERROR_ATOMIC_CAS(p, e, d) __atomic_compare_exchange_n((p), (e), (d), true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#   define ZERROR_ATOMIC_FENCE()      __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+zlog_level zlog__level = ZLOG_INFO;
+zlog_level zlog__gate = ZLOG_INFO;
+static zlog_level zlog__flight_level = ZLOG_NONE;
+
+static void zlog__gate_update(void)
+{
+    zlog__gate = (zlog__flight_level < zlog__level) ? zlog__flight_level : zlog__level;
+}
+
+static struct 
+{
+    bool init;
+#   if defined(_WIN32)
+    CRITICAL_SECTION mutex;
+#   else
+    pthread_mutex_t mutex;
+#   endif
+#   pragma GCC diagnostic push
+#   pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+} zlog__state = { false };
+#pragma GCC diagnostic pop
+
+/*
+ * A record ready to be written to the sinks. Text records hold the formatted
+ * message in 'text'. Binary records set 'fmt' and hold the captured argument
+ * blob in 'text' instead ('size' bytes); nothing is formatted. Structured
+ * fields follow as a blob of their own ('kv', 'kv_size' bytes); 'kv_text' says
+ * whether the text layouts show them or only the structured ones do.
+ */
+typedef struct
+{
+    zlog_level level;
+    const char *label;
+    const char *file;
+    int line;
+    const char *func;
+    const char *fmt;
+    const char *extra;
+    size_t size;
+    unsigned long long ts;
+    const unsigned char *kv;
+    size_t kv_size;
+    unsigned kv_count;
+    bool kv_text;
+    char text[ZLOG_ASYNC_RECORD_MAX];
+} zlog__record;
+
+// Fields handed down from zlog_kv / zerr_print to the record.
+typedef struct
+{
+    const zkv *items;
+    size_t count;
+    bool text;
+} zlog__fields;
+
+/*
+ * Binary log layout (host byte order, described by the header):
+ *   header  "ZLOGBIN1", u8 sizeof(long double), u8 little-endian flag
+ *   'S'     u32 id, u8 level, i32 line, str label, str file, str func, str fmt
+ *   'R'     u64 ns since epoch, u8 level, u32 site id, u16 blob size, blob, str extra
+ *   'K'     u8 count, u8 shown-in-text flag, u16 size, field blob; fields of the next 'R'
+ * where 'str' is a u16 length followed by the bytes. A field is u8 type, u16 key
+ * length, key, NUL, then 8 value bytes or (strings) u32 length, bytes, NUL. A site is written the first
+ * time it logs; a header restarts the id space (files are appended to).
+ */
+#define ZLOG_BIN_MAGIC "ZLOGBIN1"
+
+typedef struct
+{
+    uintptr_t key;
+    const char *file;
+    const char *func;
+    const char *label;
+    char *fmt;
+    int line;
+    unsigned id;
+} zlog__site;
+
+typedef struct
+{
+    zlog__site *items;
+    size_t cap;
+    unsigned count;
+} zlog__site_table;
+
+/*
+ * Sink registry. Slots are only touched under the state mutex; the writer walks
+ * them once per record. 'binary' counts binary sinks so producers know whether
+ * to keep arguments raw (it is read without the lock).
+ */
+typedef struct
+{
+    bool used;
+    zlog_sink_config cfg;
+    char *path;
+    FILE *fp;
+    size_t written;
+    unsigned long long opened;
+    unsigned long long flushed;
+    bool dirty;
+    zlog__site_table sites;
+    char *ring;
+    size_t ring_total;
+    int fd;
+} zlog__sink;
+
+static struct
+{
+    zlog__sink items[ZLOG_SINK_MAX];
+    bool ready;
+    int file;
+    int bin;
+    unsigned long long binary;
+} zlog__sinks;
+
+// Longest line a text layout produces (message, extra info and decoration).
+#define ZLOG__LINE_MAX (ZLOG_ASYNC_RECORD_MAX + 1024)
+
+// Per-record scratch for the writer: each layout is built on first use.
+static struct
+{
+    zlog_entry entry;
+    bool have_msg;
+    bool have_time;
+    bool built[ZLOG_FORMAT_COUNT];
+    size_t len[ZLOG_FORMAT_COUNT];
+    bool have_line;
+    char time[64];
+    char msg[ZLOG_ASYNC_RECORD_MAX];
+    char line[ZLOG__LINE_MAX];
+    zkv kv[ZLOG_KV_MAX];
+    char text[ZLOG_FORMAT_COUNT][ZLOG__LINE_MAX];
+} zlog__out;
+
+/*
+ * Async queue: bounded MPMC ring (Vyukov). Each slot carries a sequence number;
+ * producers claim 'head', the writer thread claims 'tail'. Producers never take
+ * the state mutex, only the writer does while it prints.
+ */
+typedef struct
+{
+    unsigned long long seq;
+    zlog__record rec;
+} zlog__slot;
+
+static struct
+{
+    zlog__slot *slots;
+    unsigned long long mask;
+    zlog_overflow policy;
+    unsigned long long running;
+    unsigned long long inflight;
+    unsigned long long retired;
+    unsigned long long dropped;
+    char pad0[64];
+    unsigned long long head;
+    char pad1[64];
+    unsigned long long tail;
+    char pad2[64];
+#   if defined(_WIN32)
+    HANDLE thread;
+    CONDITION_VARIABLE wake;
+#   else
+    pthread_t thread;
+    pthread_cond_t wake;
+#   endif
+} zlog__async;
+
+static const char *zlog__colors[] = 
+{
+    "\x1b[94m", 
+    "\x1b[36m", 
+    "\x1b[32m", 
+    "\x1b[33m", 
+    "\x1b[31m", 
+    "\x1b[35m"
+};
+
+static const char *zlog__labels[] = 
+{ 
+    "TRACE", 
+    "DEBUG", 
+    "INFO ", 
+    "WARN ", 
+    "ERROR", 
+    "FATAL" 
+};
+
+/*
+ * Message arena: a per-thread bump allocator used as a ring. When an allocation
+ * does not fit, it restarts at offset 0 and bumps 'gen'. A message is still
+ * intact if it belongs to the current lap, or to the previous lap and lies
+ * above 'top' (not reached yet by the new lap).
+ */
+typedef struct
+{
+    size_t top;
+    size_t last;
+    unsigned gen;
+    char buf[ZERROR_ARENA_SIZE];
+} zerr__arena_t;
+
+#if defined(_MSC_VER)
+    static __declspec(thread) zerr__arena_t zerr__arena;
+#else
+    static __thread zerr__arena_t zerr__arena;
+#endif
+
+static zerr__arena_t *zerr__arena_get(void)
+{
+    zerr__arena_t *a = &zerr__arena;
+    if (0 == a->gen)
+    {
+        a->gen = 1;
+    }
+    return a;
+}
+
+static void zerr__arena_newlap(zerr__arena_t *a)
+{
+    a->top = 0;
+    a->last = 0;
+    a->gen++;
+}
+
+static char *zerr__arena_reserve(size_t size, unsigned *gen)
+{
+    zerr__arena_t *a = zerr__arena_get();
+    if (a->top + size > sizeof(a->buf))
+    {
+        zerr__arena_newlap(a);
+    }
+    char *p = a->buf + a->top;
+    a->last = a->top;
+    a->top += size;
+    *gen = a->gen;
+    return p;
+}
+
+static bool zerr__arena_contains(const char *p)
+{
+    const zerr__arena_t *a = &zerr__arena;
+    return (uintptr_t)p >= (uintptr_t)a->buf && (uintptr_t)p < (uintptr_t)(a->buf + sizeof(a->buf));
+}
+
+// Set in zerr.gen when 'msg' is a deferred message (see zerr__lazy_hdr).
+#define ZERROR_GEN_LAZY 0x80000000u
+
+// Set in zerr.gen when 'msg' follows the link to a cause (see zerr__cause_hdr).
+#define ZERROR_GEN_CAUSE 0x40000000u
+
+static bool zerr__arena_live(const char *p, unsigned gen)
+{
+    const zerr__arena_t *a = &zerr__arena;
+    gen &= ~(ZERROR_GEN_LAZY | ZERROR_GEN_CAUSE);
+    if (0 == gen || !zerr__arena_contains(p))
+    {
+        return false;
+    }
+    if (gen == a->gen)
+    {
+        return true;
+    }
+    return gen + 1 == a->gen && (size_t)(p - a->buf) >= a->top;
+}
+
+/*
+ * Ids of the per-thread pools below. They are unique per thread (the base is
+ * taken from a global counter), which keeps a foreign id from matching a
+ * local entry.
+ */
+static unsigned long long zerr__pool_epoch = 0;
+
+// Next id of a per-thread pool; never 0.
+static unsigned zerr__pool_id(unsigned *next)
+{
+    if (0 == *next)
+    {
+        *next = (unsigned)ZERROR_ATOMIC_ADD(&zerr__pool_epoch, 0x10000ULL) + 1;
+    }
+    unsigned id = (*next)++;
+    if (0 == id)
+    {
+        id = (*next)++;
+    }
+    return id;
+}
+
+#ifdef ZERROR_COMPACT
+
+/*
+ * Node pool for compact errors: a per-thread ring like the frame pool. An
+ * error's message, source, trace frames and (without a static descriptor) call
+ * site are a chain of nodes, newest first, and 'ref' is the head. Changing a
+ * field pushes a node in front, so a hop costs one store and copies of a zerr
+ * stay independent. Each node also records which kinds the chain behind it
+ * holds, and the cause link if there is one, so the link lives as long as the
+ * newest node. An error whose chain was recycled (or that came from another
+ * thread) reads as expired.
+ */
+enum
+{
+    ZERR__NODE_MSG = 1,
+    ZERR__NODE_SOURCE = 2,
+    ZERR__NODE_FRAME = 4,
+    ZERR__NODE_SITE = 8,
+    ZERR__NODE_CAUSE = 16
+};
+
+typedef struct
+{
+    unsigned id;
+    unsigned prev;
+    unsigned kind;
+    unsigned kinds;     // Kinds of this node and every older one.
+    unsigned gen;       // MSG: arena generation of 'text'.
+    const char *text;   // MSG: message. SOURCE: expression.
+    zerr_frame frame;   // FRAME: propagation frame. SITE: where the error was raised.
+    unsigned cause;     // The wrapped error's slot in the cause pool (0 = none).
+    int code;           // The wrapped error's code, kept if the slot is reused.
+} zerr__node;
+
+typedef struct
+{
+    unsigned next;
+    zerr__node nodes[ZERROR_BODY_POOL];
+} zerr__node_pool_t;
+
+#if defined(_MSC_VER)
+    static __declspec(thread) zerr__node_pool_t zerr__nodes;
+#else
+    static __thread zerr__node_pool_t zerr__nodes;
+#endif
+
+static const zerr__node *zerr__node_get(unsigned id)
+{
+    const zerr__node *node = &zerr__nodes.nodes[id % ZERROR_BODY_POOL];
+    return (0 != id && node->id == id) ? node : NULL;
+}
+
+static zerr__node *zerr__node_push(zerr *e, unsigned kind)
+{
+    const zerr__node *head = zerr__node_get(e->ref);
+    unsigned id = zerr__pool_id(&zerr__nodes.next);
+    zerr__node *node = &zerr__nodes.nodes[id % ZERROR_BODY_POOL];
+    node->id = id;
+    node->prev = e->ref;
+    node->kind = kind;
+    node->kinds = kind | (head ? head->kinds : 0);
+    node->cause = head ? head->cause : 0;
+    node->code = head ? head->code : 0;
+    e->ref = id;
+    return node;
+}
+
+static const zerr__node *zerr__node_find(unsigned ref, unsigned kind)
+{
+    const zerr__node *node = zerr__node_get(ref);
+    if (!node || !(node->kinds & kind))
+    {
+        return NULL;
+    }
+    while (node && node->kind != kind)
+    {
+        node = zerr__node_get(node->prev);
+    }
+    return node;
+}
+
+static const zerr_site *zerr__site_of(zerr e)
+{
+    if (e.site)
+    {
+        return e.site;
+    }
+    const zerr__node *node = zerr__node_find(e.ref, ZERR__NODE_SITE);
+    return node ? &node->frame : NULL;
+}
+
+const char *zerr_file(zerr e)
+{
+    const zerr_site *site = zerr__site_of(e);
+    return site ? site->file : "(unknown)";
+}
+
+int zerr_line(zerr e)
+{
+    const zerr_site *site = zerr__site_of(e);
+    return site ? site->line : 0;
+}
+
+const char *zerr_func(zerr e)
+{
+    const zerr_site *site = zerr__site_of(e);
+    return site ? site->func : "(unknown)";
+}
+
+const char *zerr_source(zerr e)
+{
+    const zerr__node *node = zerr__node_find(e.ref, ZERR__NODE_SOURCE);
+    return node ? node->text : NULL;
+}
+
+zerr zerr_with_src(zerr e, const char *src)
+{
+    const zerr__node *head = zerr__node_get(e.ref);
+    if (!head || !(head->kinds & ZERR__NODE_SOURCE))
+    {
+        zerr__node_push(&e, ZERR__NODE_SOURCE)->text = src;
+    }
+    return e;
+}
+
+static const char *zerr__msg_of(zerr e, unsigned *gen)
+{
+    const zerr__node *node = zerr__node_find(e.ref, ZERR__NODE_MSG);
+    *gen = node ? node->gen : 0;
+    if (!node && e.ref)
+    {
+        return "(expired error message)";
+    }
+    return node ? node->text : NULL;
+}
+
+static zerr zerr__set_msg(zerr e, const char *msg, unsigned gen)
+{
+    zerr__node *node = zerr__node_push(&e, ZERR__NODE_MSG);
+    node->text = msg;
+    node->gen = gen;
+    return e;
+}
+
+static zerr zerr__push_frame(zerr e, const char *func, const char *file, int line)
+{
+    zerr__node *node = zerr__node_push(&e, ZERR__NODE_FRAME);
+    node->frame.func = func;
+    node->frame.file = file;
+    node->frame.line = line;
+    return e;
+}
+
+// Copies up to 'max' trace frames of 'e', newest first.
+static int zerr__frames_of(zerr e, zerr_frame *out, int max)
+{
+    int count = 0;
+    const zerr__node *node = zerr__node_get(e.ref);
+    while (node && (node->kinds & ZERR__NODE_FRAME) && count < max)
+    {
+        if (ZERR__NODE_FRAME == node->kind)
+        {
+            out[count++] = node->frame;
+        }
+        node = zerr__node_get(node->prev);
+    }
+    return count;
+}
+
+// Links 'e' to the error it wraps, parked in the cause pool.
+static zerr zerr__set_cause(zerr e, unsigned cause, int code)
+{
+    zerr__node *node = zerr__node_push(&e, ZERR__NODE_CAUSE);
+    node->cause = cause;
+    node->code = code;
+    return e;
+}
+
+static bool zerr__cause_of(zerr e, unsigned *cause, int *code)
+{
+    const zerr__node *node = zerr__node_get(e.ref);
+    if (!node || !node->cause)
+    {
+        return false;
+    }
+    *cause = node->cause;
+    *code = node->code;
+    return true;
+}
+
+// A fresh error raised at 'site', or (without a static descriptor) at file:line.
+static zerr zerr__new(int code, const zerr_site *site, const char *file, int line, const char *func)
+{
+    zerr e = { code, 0, site };
+    if (!site)
+    {
+        zerr__node *node = zerr__node_push(&e, ZERR__NODE_SITE);
+        node->frame.func = func;
+        node->frame.file = file;
+        node->frame.line = line;
+    }
+    return e;
+}
+
+#else
+
+/*
+ * Frame pool: a per-thread ring of trace frames. Each frame links to the one
+ * pushed before it, so a hop costs one store.
+ */
+typedef struct
+{
+    zerr_frame frame;
+    unsigned prev;
+    unsigned id;
+} zerr__frame_node;
+
+typedef struct
+{
+    unsigned next;
+    zerr__frame_node nodes[ZERROR_TRACE_POOL];
+} zerr__frame_pool_t;
+
+#if defined(_MSC_VER)
+    static __declspec(thread) zerr__frame_pool_t zerr__frames;
+#else
+    static __thread zerr__frame_pool_t zerr__frames;
+#endif
+
+static const zerr__frame_node *zerr__frame_get(unsigned id)
+{
+    const zerr__frame_node *node = &zerr__frames.nodes[id % ZERROR_TRACE_POOL];
+    return (0 != id && node->id == id) ? node : NULL;
+}
+
+static const char *zerr__msg_of(zerr e, unsigned *gen)
+{
+    *gen = e.gen;
+    return e.msg;
+}
+
+static zerr zerr__set_msg(zerr e, const char *msg, unsigned gen)
+{
+    e.msg = msg;
+    e.gen = gen;
+    return e;
+}
+
+static zerr zerr__push_frame(zerr e, const char *func, const char *file, int line)
+{
+    zerr__frame_pool_t *pool = &zerr__frames;
+    unsigned id = zerr__pool_id(&pool->next);
+    zerr__frame_node *node = &pool->nodes[id % ZERROR_TRACE_POOL];
+    node->frame.func = func;
+    node->frame.file = file;
+    node->frame.line = line;
+    node->prev = e.trace;
+    node->id = id;
+    e.trace = id;
+    return e;
+}
+
+// Copies up to 'max' trace frames of 'e', newest first.
+static int zerr__frames_of(zerr e, zerr_frame *out, int max)
+{
+    int count = 0;
+    const zerr__frame_node *node = zerr__frame_get(e.trace);
+    while (node && count < max)
+    {
+        out[count++] = node->frame;
+        node = zerr__frame_get(node->prev);
+    }
+    return count;
+}
+
+/*
+ * A wrapping error always has an arena message, and the link to its cause is
+ * kept in front of it: [zerr__cause_hdr][text], with ZERROR_GEN_CAUSE in
+ * zerr.gen. The link leaves zerr at 48 bytes and expires with the message.
+ */
+typedef struct
+{
+    unsigned cause;     // The wrapped error's slot in the cause pool.
+    int code;           // The wrapped error's code, kept if the slot is reused.
+} zerr__cause_hdr;
+
+static bool zerr__cause_of(zerr e, unsigned *cause, int *code)
+{
+    if (!(e.gen & ZERROR_GEN_CAUSE))
+    {
+        return false;
+    }
+    // Recycled along with the message: the cause reads as expired, code unknown.
+    zerr__cause_hdr link = { 0, 0 };
+    const char *h = e.msg - sizeof(zerr__cause_hdr);
+    if (zerr__arena_live(h, e.gen))
+    {
+        memcpy(&link, h, sizeof(link));
+    }
+    *cause = link.cause;
+    *code = link.code;
+    return true;
+}
+
+static zerr zerr__new(int code, const zerr_site *site, const char *file, int line, const char *func)
+{
+    zerr e = { code, 0, NULL, file, line, 0, func, NULL };
+    if (site)
+    {
+        e.file = site->file;
+        e.line = site->line;
+        e.func = site->func;
+    }
+    return e;
+}
+
+#endif
+
+// Message text, or a placeholder if it was recycled by this thread's arena.
+static const char *zerr__msg_text(const char *msg, unsigned gen)
+{
+    if (!msg)
+    {
+        return "Unknown Error";
+    }
+    if (gen && zerr__arena_contains(msg) && !zerr__arena_live(msg, gen))
+    {
+        return "(expired error message)";
+    }
+    return msg;
+}
+
+// Formats into the arena, leaving 'pre' bytes in front of the text for a header.
+static char *zerr__arena_vformat_after(size_t pre, unsigned *gen, const char *fmt, va_list args)
+{
+    zerr__arena_t *a = zerr__arena_get();
+    if (a->top + pre >= sizeof(a->buf))
+    {
+        zerr__arena_newlap(a);
+    }
+    size_t room = sizeof(a->buf) - a->top - pre;
+    if (room > ZERROR_MSG_MAX)
+    {
+        room = ZERROR_MSG_MAX;
+    }
+
+    va_list copy;
+    va_copy(copy, args);
+    char *dst = a->buf + a->top + pre;
+    int n = vsnprintf(dst, room, fmt, copy);
+    va_end(copy);
+
+    // Did not fit in what is left of this lap: start a new one and format again.
+    if (n >= 0 && (size_t)n >= room && a->top > 0)
+    {
+        zerr__arena_newlap(a);
+        room = sizeof(a->buf) - pre < ZERROR_MSG_MAX ? sizeof(a->buf) - pre : ZERROR_MSG_MAX;
+        dst = a->buf + pre;
+        n = vsnprintf(dst, room, fmt, args);
+    }
+    if (n < 0)
+    {
+        n = 0;
+        dst[0] = '\0';
+    }
+    size_t used = ((size_t)n < room ? (size_t)n : room - 1) + 1;
+    return zerr__arena_reserve(pre + used, gen) + pre;
+}
+
+static const char *zerr__arena_vformat(unsigned *gen, const char *fmt, va_list args)
+{
+    return zerr__arena_vformat_after(0, gen, fmt, args);
+}
+
+/*
+ * Returns 'head' followed by 'tail'. If 'head' is the newest allocation of the
+ * current lap the tail is appended in place; otherwise both are copied once.
+ */
+static const char *zerr__arena_join(const char *head, size_t hlen, unsigned hgen,
+                                    const char *tail, size_t tlen, unsigned *gen)
+{
+    zerr__arena_t *a = zerr__arena_get();
+    if (hlen + tlen + 1 > ZERROR_MSG_MAX)
+    {
+        tlen = (hlen + 1 < ZERROR_MSG_MAX) ? ZERROR_MSG_MAX - hlen - 1 : 0;
+    }
+
+    bool newest = (head == a->buf + a->last) && (head + hlen == a->buf + a->top - 1);
+    if (hgen == a->gen && newest && a->top + tlen <= sizeof(a->buf))
+    {
+        memmove(a->buf + a->top - 1, tail, tlen);
+        a->top += tlen;
+        a->buf[a->top - 1] = '\0';
+        *gen = a->gen;
+        return head;
+    }
+
+    if (hlen + tlen + 1 > ZERROR_MSG_MAX)
+    {
+        hlen = ZERROR_MSG_MAX - 1;
+        tlen = 0;
+    }
+    size_t size = hlen + tlen + 1;
+    char *dst = zerr__arena_reserve(size, gen);
+
+    // Sources that live in the region just reserved go through a scratch copy.
+    uintptr_t lo = (uintptr_t)dst, hi = (uintptr_t)(dst + size);
+    bool clash = ((uintptr_t)head < hi && (uintptr_t)(head + hlen) > lo) ||
+                 ((uintptr_t)tail < hi && (uintptr_t)(tail + tlen) > lo);
+    if (clash)
+    {
+        char scratch[ZERROR_MSG_MAX];
+        memcpy(scratch, head, hlen);
+        memcpy(scratch + hlen, tail, tlen);
+        memcpy(dst, scratch, hlen + tlen);
+    }
+    else
+    {
+        memcpy(dst, head, hlen);
+        memcpy(dst + hlen, tail, tlen);
+    }
+    dst[hlen + tlen] = '\0';
+    return dst;
+}
+
+/*
+ * Argument capture. A printf argument list is stored as a packed blob, in
+ * conversion order: integers, pointers and doubles take 8 bytes, long doubles
+ * sizeof(long double), '*' widths 8 bytes, and strings a 4-byte length plus
+ * their bytes. zerr__render replays the blob against the same format string.
+ */
+typedef enum
+{
+    ZERR__LEN_NONE = 0,
+    ZERR__LEN_HH,
+    ZERR__LEN_H,
+    ZERR__LEN_L,
+    ZERR__LEN_LL,
+    ZERR__LEN_Z,
+    ZERR__LEN_J,
+    ZERR__LEN_T,
+    ZERR__LEN_BIG_L
+} zerr__len;
+
+typedef struct
+{
+    char flags[8];
+    int width;          // -1 if absent.
+    int prec;           // -1 if absent.
+    bool width_star;
+    bool prec_star;
+    zerr__len len;
+    char conv;          // 0 if the spec is malformed or unsupported.
+} zerr__spec;
+
+#define ZERROR_STR_NULL 0xFFFFFFFFu
+
+static const char *zerr__parse_spec(const char *p, zerr__spec *sp)
+{
+    size_t nf = 0;
+    sp->width = -1;
+    sp->prec = -1;
+    sp->width_star = false;
+    sp->prec_star = false;
+    sp->len = ZERR__LEN_NONE;
+    sp->conv = 0;
+
+    while ('-' == *p || '+' == *p || ' ' == *p || '#' == *p || '0' == *p)
+    {
+        if (nf < sizeof(sp->flags) - 1)
+        {
+            sp->flags[nf++] = *p;
+        }
+        p++;
+    }
+    sp->flags[nf] = '\0';
+    if ('*' == *p)
+    {
+        sp->width_star = true;
+        p++;
+    }
+    else
+    {
+        for (; *p >= '0' && *p <= '9'; p++)
+        {
+            sp->width = (sp->width < 0 ? 0 : sp->width * 10) + (*p - '0');
+        }
+    }
+    if ('.' == *p)
+    {
+        p++;
+        sp->prec = 0;
+        if ('*' == *p)
+        {
+            sp->prec_star = true;
+            p++;
+        }
+        for (; *p >= '0' && *p <= '9'; p++)
+        {
+            sp->prec = sp->prec * 10 + (*p - '0');
+        }
+    }
+    switch (*p)
+    {
+        case 'h': p++; sp->len = ('h' == *p) ? (p++, ZERR__LEN_HH) : ZERR__LEN_H; break;
+        case 'l': p++; sp->len = ('l' == *p) ? (p++, ZERR__LEN_LL) : ZERR__LEN_L; break;
+        case 'z': p++; sp->len = ZERR__LEN_Z; break;
+        case 'j': p++; sp->len = ZERR__LEN_J; break;
+        case 't': p++; sp->len = ZERR__LEN_T; break;
+        case 'L': p++; sp->len = ZERR__LEN_BIG_L; break;
+        default: break;
+    }
+    switch (*p)
+    {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c': case 's': case 'p': 
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': case '%':
+            sp->conv = *p++;
+            break;
+        default:
+            break;
+    }
+    // Wide characters/strings are not captured.
+    if (ZERR__LEN_L == sp->len && ('c' == sp->conv || 's' == sp->conv))
+    {
+        sp->conv = 0;
+    }
+    return p;
+}
+
+static bool zerr__blob_put(unsigned char *blob, size_t cap, size_t *used, const void *src, size_t n)
+{
+    if (*used + n > cap)
+    {
+        return false;
+    }
+    memcpy(blob + *used, src, n);
+    *used += n;
+    return true;
+}
+
+static bool zerr__blob_get(const unsigned char *blob, size_t blen, size_t *pos, void *dst, size_t n)
+{
+    if (*pos + n > blen)
+    {
+        return false;
+    }
+    memcpy(dst, blob + *pos, n);
+    *pos += n;
+    return true;
+}
+
+// Returns the blob size, or -1 if the format cannot be captured (caller formats eagerly).
+static int zerr__capture(const char *fmt, va_list args, unsigned char *blob, size_t cap)
+{
+    size_t used = 0;
+    const char *p = fmt;
+    while ((p = strchr(p, '%')) != NULL)
+    {
+        zerr__spec sp;
+        p = zerr__parse_spec(p + 1, &sp);
+        if (0 == sp.conv)
+        {
+            return -1;
+        }
+        if ('%' == sp.conv)
+        {
+            continue;
+        }
+        bool ok = true;
+        int prec = sp.prec;
+        if (sp.width_star)
+        {
+            long long w = va_arg(args, int);
+            ok = zerr__blob_put(blob, cap, &used, &w, sizeof(w));
+        }
+        if (ok && sp.prec_star)
+        {
+            long long pr = va_arg(args, int);
+            prec = (int)pr;
+            ok = zerr__blob_put(blob, cap, &used, &pr, sizeof(pr));
+        }
+        if (!ok)
+        {
+            return -1;
+        }
+
+        unsigned long long u = 0;
+        switch (sp.conv)
+        {
+            case 'd': case 'i': case 'c':
+                switch (sp.len)
+                {
+                    case ZERR__LEN_L:  u = (unsigned long long)(long long)va_arg(args, long); break;
+                    case ZERR__LEN_LL: u = (unsigned long long)va_arg(args, long long); break;
+                    case ZERR__LEN_Z:  u = (unsigned long long)va_arg(args, size_t); break;
+                    case ZERR__LEN_J:  u = (unsigned long long)va_arg(args, intmax_t); break;
+                    case ZERR__LEN_T:  u = (unsigned long long)(long long)va_arg(args, ptrdiff_t); break;
+                    default:           u = (unsigned long long)(long long)va_arg(args, int); break;
+                }
+                ok = zerr__blob_put(blob, cap, &used, &u, sizeof(u));
+                break;
+
+            case 'o': case 'u': case 'x': case 'X':
+                switch (sp.len)
+                {
+                    case ZERR__LEN_L:  u = va_arg(args, unsigned long); break;
+                    case ZERR__LEN_LL: u = va_arg(args, unsigned long long); break;
+                    case ZERR__LEN_Z:  u = va_arg(args, size_t); break;
+                    case ZERR__LEN_J:  u = va_arg(args, uintmax_t); break;
+                    case ZERR__LEN_T:  u = (unsigned long long)va_arg(args, ptrdiff_t); break;
+                    default:           u = va_arg(args, unsigned int); break;
+                }
+                ok = zerr__blob_put(blob, cap, &used, &u, sizeof(u));
+                break;
+
+            case 'p':
+                u = (unsigned long long)(uintptr_t)va_arg(args, void *);
+                ok = zerr__blob_put(blob, cap, &used, &u, sizeof(u));
+                break;
+
+            case 's':
+            {
+                const char *str = va_arg(args, const char *);
+                unsigned n = ZERROR_STR_NULL;
+                if (str)
+                {
+                    size_t len = 0;
+                    while (str[len] && (prec < 0 || len < (size_t)prec))
+                    {
+                        len++;
+                    }
+                    n = (unsigned)len;
+                }
+                ok = zerr__blob_put(blob, cap, &used, &n, sizeof(n)) &&
+                     (!str || zerr__blob_put(blob, cap, &used, str, n));
+                break;
+            }
+
+            default:
+                if (ZERR__LEN_BIG_L == sp.len)
+                {
+                    long double ld = va_arg(args, long double);
+                    ok = zerr__blob_put(blob, cap, &used, &ld, sizeof(ld));
+                }
+                else
+                {
+                    double d = va_arg(args, double);
+                    ok = zerr__blob_put(blob, cap, &used, &d, sizeof(d));
+                }
+                break;
+        }
+        if (!ok)
+        {
+            return -1;
+        }
+    }
+    return (int)used;
+}
+
+static int zerr__capturef(unsigned char *blob, size_t cap, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = zerr__capture(fmt, args, blob, cap);
+    va_end(args);
+    return n;
+}
+
+// Formats 'fmt' with a captured blob. Returns the length needed, like snprintf.
+static size_t zerr__render(const char *fmt, const unsigned char *blob, size_t blen, char *out, size_t size)
+{
+    size_t pos = 0, at = 0;
+    const char *p = fmt;
+
+#   define ZERROR_RENDER_ADD(n)  do { int _n = (n); pos += (_n > 0) ? (size_t)_n : 0; } while (0)
+#   define ZERROR_RENDER_DST     (pos < size ? out + pos : NULL), (pos < size ? size - pos : 0)
+
+    while (*p)
+    {
+        const char *pct = strchr(p, '%');
+        size_t lit = pct ? (size_t)(pct - p) : strlen(p);
+        if (pos < size)
+        {
+            size_t room = size - pos - 1;
+            memcpy(out + pos, p, lit < room ? lit : room);
+        }
+        pos += lit;
+        if (!pct)
+        {
+            break;
+        }
+
+        zerr__spec sp;
+        p = zerr__parse_spec(pct + 1, &sp);
+        if (0 == sp.conv || '%' == sp.conv)
+        {
+            if (size && pos < size - 1)
+            {
+                out[pos] = '%';
+            }
+            pos++;
+            continue;
+        }
+
+        long long w = sp.width, pr = sp.prec;
+        if (sp.width_star && !zerr__blob_get(blob, blen, &at, &w, sizeof(w)))
+        {
+            break;
+        }
+        if (sp.prec_star && !zerr__blob_get(blob, blen, &at, &pr, sizeof(pr)))
+        {
+            break;
+        }
+
+        // Rebuild the spec with the '*' values substituted.
+        static const char *lens[] = { "", "hh", "h", "l", "ll", "z", "j", "t", "L" };
+        char spec[64];
+        char flags[10];
+        bool left = sp.width_star && w < 0;
+        snprintf(flags, sizeof(flags), "%s%s", sp.flags, left ? "-" : "");
+        if (left)
+        {
+            w = -w;
+        }
+        char wbuf[24] = "", pbuf[24] = "";
+        if (w >= 0)
+        {
+            snprintf(wbuf, sizeof(wbuf), "%lld", w);
+        }
+
+        if ('s' == sp.conv)
+        {
+            unsigned n = 0;
+            if (!zerr__blob_get(blob, blen, &at, &n, sizeof(n)))
+            {
+                break;
+            }
+            if (ZERROR_STR_NULL == n)
+            {
+                if (pr >= 0)
+                {
+                    snprintf(pbuf, sizeof(pbuf), ".%lld", pr);
+                }
+                snprintf(spec, sizeof(spec), "%%%s%s%ss", flags, wbuf, pbuf);
+                ZERROR_RENDER_ADD(snprintf(ZERROR_RENDER_DST, spec, (const char *)NULL));
+                continue;
+            }
+            if (at + n > blen)
+            {
+                break;
+            }
+            snprintf(spec, sizeof(spec), "%%%s%s.*s", flags, wbuf);
+            ZERROR_RENDER_ADD(snprintf(ZERROR_RENDER_DST, spec, (int)n, (const char *)(blob + at)));
+            at += n;
+            continue;
+        }
+
+        if (pr >= 0)
+        {
+            snprintf(pbuf, sizeof(pbuf), ".%lld", pr);
+        }
+        snprintf(spec, sizeof(spec), "%%%s%s%s%s%c", flags, wbuf, pbuf, lens[sp.len], sp.conv);
+
+        if (strchr("fFeEgGaA", sp.conv))
+        {
+            if (ZERR__LEN_BIG_L == sp.len)
+            {
+                long double ld;
+                if (!zerr__blob_get(blob, blen, &at, &ld, sizeof(ld)))
+                {
+                    break;
+                }
+                ZERROR_RENDER_ADD(snprintf(ZERROR_RENDER_DST, spec, ld));
+            }
+            else
+            {
+                double d;
+                if (!zerr__blob_get(blob, blen, &at, &d, sizeof(d)))
+                {
+                    break;
+                }
+                ZERROR_RENDER_ADD(snprintf(ZERROR_RENDER_DST, spec, d));
+            }
+            continue;
+        }
+
+        unsigned long long u;
+        if (!zerr__blob_get(blob, blen, &at, &u, sizeof(u)))
+        {
+            break;
+        }
+        bool is_signed = ('d' == sp.conv || 'i' == sp.conv || 'c' == sp.conv);
+        if ('p' == sp.conv)
+        {
+            ZERROR_RENDER_ADD(snprintf(ZERROR_RENDER_DST, spec, (void *)(uintptr_t)u));
+            continue;
+        }
+        switch (sp.len)
+        {
+            case ZERR__LEN_L:
+                if (is_signed) ZERROR_RENDER_ADD(snprintf(ZERROR_RENDER_DST, spec, (long)u));
+                else           ZERROR_RENDER_ADD(snprintf(ZERROR_RENDER_DST, spec, (unsigned long)u));
+                break;
+            case ZERR__LEN_LL:
+                if (is_signed) ZERROR_RENDER_ADD(snprintf(ZERROR_RENDER_DST, spec, (long long)u));
+                else           ZERROR_RENDER_ADD(snprintf(ZERROR_RENDER_DST, spec, u));
+                break;
+            case ZERR__LEN_Z:
+                ZERROR_RENDER_ADD(snprintf(ZERROR_RENDER_DST, spec, (size_t)u));
+                break;
+            case ZERR__LEN_J:
+                if (is_signed) ZERROR_RENDER_ADD(snprintf(ZERROR_RENDER_DST, spec, (intmax_t)u));
+                else           ZERROR_RENDER_ADD(snprintf(ZERROR_RENDER_DST, spec, (uintmax_t)u));
+                break;
+            case ZERR__LEN_T:
+                ZERROR_RENDER_ADD(snprintf(ZERROR_RENDER_DST, spec, (ptrdiff_t)u));
+                break;
+            default:
+                if (is_signed) ZERROR_RENDER_ADD(snprintf(ZERROR_RENDER_DST, spec, (int)u));
+                else           ZERROR_RENDER_ADD(snprintf(ZERROR_RENDER_DST, spec, (unsigned int)u));
+                break;
+        }
+    }
+
+#   undef ZERROR_RENDER_ADD
+#   undef ZERROR_RENDER_DST
+
+    if (size)
+    {
+        out[pos < size ? pos : size - 1] = '\0';
+    }
+    return pos;
+}
+
+/*
+ * Deferred messages. The arena holds [header][blob][u32 blob size][fmt copy],
+ * and 'msg' points at the format copy, so reading the field directly still
+ * shows the template. zerr_msg() renders the text once and caches it.
+ */
+typedef struct
+{
+    const char *fmt;
+    const char *text;
+    unsigned text_gen;
+} zerr__lazy_hdr;
+
+#if defined(ZERROR_LAZY_FORMAT)
+static bool zerr__lazy_enabled = true;
+#else
+static bool zerr__lazy_enabled = false;
+#endif
+
+static bool zerr__lazy_create(const char **msg, unsigned *gen, const char *fmt, va_list args)
+{
+    // Capture on the stack first: a failed capture must not touch the arena,
+    // where bytes above 'top' may still hold messages of the previous lap.
+    unsigned char blob[ZERROR_LAZY_ARGS_MAX];
+    int blen = zerr__capture(fmt, args, blob, sizeof(blob));
+    if (blen < 0)
+    {
+        return false;
+    }
+    unsigned n = (unsigned)blen;
+    size_t flen = strlen(fmt);
+    size_t size = sizeof(zerr__lazy_hdr) + n + sizeof(n) + flen + 1;
+    if (size > sizeof(zerr__arena.buf))
+    {
+        return false;
+    }
+
+    char *p = zerr__arena_reserve(size, gen);
+    zerr__lazy_hdr hdr = { fmt, NULL, 0 };
+    memcpy(p, &hdr, sizeof(hdr));
+    p += sizeof(hdr);
+    memcpy(p, blob, n);
+    p += n;
+    memcpy(p, &n, sizeof(n));
+    p += sizeof(n);
+    memcpy(p, fmt, flen + 1);
+
+    *msg = p;
+    *gen |= ZERROR_GEN_LAZY;
+    return true;
+}
+
+// Helpers.
+static void zlog__init_mutex(void) 
+{
+    if (zlog__state.init) 
+    {
+        return;
+    }
+#   if defined(_WIN32)
+    InitializeCriticalSection(&zlog__state.mutex);
+    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD dwMode = 0;
+    GetConsoleMode(hOut, &dwMode);
+    SetConsoleMode(hOut, dwMode | 0x0004);
+#   else
+    pthread_mutex_init(&zlog__state.mutex, NULL);
+#   endif
+    zlog__state.init = true;
+}
+
+static void zlog__lock(void) 
+{
+    if (!zlog__state.init) 
+    {
+        zlog__init_mutex();
+    }
+#   if defined(_WIN32)
+    EnterCriticalSection(&zlog__state.mutex);
+#   else
+    pthread_mutex_lock(&zlog__state.mutex);
+#   endif
+}
+
+static void zlog__unlock(void) 
+{
+    if (!zlog__state.init) 
+    {
+        return;
+    }
+#   if defined(_WIN32)
+    LeaveCriticalSection(&zlog__state.mutex);
+#   else
+    pthread_mutex_unlock(&zlog__state.mutex);
+#   endif
+}
+
+static void zlog__yield(void)
+{
+#   if defined(_WIN32)
+    SwitchToThread();
+#   else
+    sched_yield();
+#   endif
+}
+
+static unsigned long long zlog__now_ns(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+/*
+ * Timestamps.
+ * Each thread caches the "YYYY-MM-DD HH:MM:SS" text of the last second it logged
+ * in, so formatting is a copy plus the fractional digits. Dates come from plain
+ * calendar arithmetic; the C library is only asked for the local zone offset,
+ * once per quarter hour (DST changes land on those boundaries).
+*/
+typedef struct
+{
+    long long sec;
+    long long zone_until;
+    long zone;
+    int mode;
+    size_t len;
+    char text[32];
+} zlog__clock_t;
+
+static zlog_time_mode zlog__time_mode = ZLOG_TIME_LOCAL;
+
+#if defined(_MSC_VER)
+    static __declspec(thread) zlog__clock_t zlog__clock = { -1, 0, 0, 0, 0, {0} };
+#else
+    static __thread zlog__clock_t zlog__clock = { -1, 0, 0, 0, 0, {0} };
+#endif
+
+// Days since 1970-01-01 for a proleptic Gregorian date, and back.
+static long long zlog__days_from_civil(long long y, unsigned m, unsigned d)
+{
+    y -= (m <= 2);
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (long long)doe - 719468;
+}
+
+static void zlog__civil_from_days(long long z, long long *y, unsigned *m, unsigned *d)
+{
+    z += 719468;
+    long long era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = (unsigned)(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = (long long)yoe + era * 400 + (*m <= 2);
+}
+
+// Seconds east of UTC at 't'.
+static long zlog__zone_offset(time_t t)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+#   if defined(_WIN32)
+    localtime_s(&tm, &t);
+#   elif defined(_POSIX_C_SOURCE) || defined(__APPLE__) || defined(__unix__) && !defined(__STRICT_ANSI__)
+    localtime_r(&t, &tm);
+#   else
+    struct tm *ptr = localtime(&t);
+    if (ptr)
+    {
+        tm = *ptr;
+    }
+    else
+    {
+        return 0;
+    }
+#   endif
+    long long local = zlog__days_from_civil(tm.tm_year + 1900LL, (unsigned)tm.tm_mon + 1, (unsigned)tm.tm_mday) * 86400 
+                    + tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+    return (long)(local - (long long)t);
+}
+
+static void zlog__get_time(unsigned long long ns, char *buf, size_t size) 
+{
+    int mode = (int)zlog__time_mode;
+    if (ZLOG_TIME_EPOCH_NS == mode)
+    {
+        snprintf(buf, size, "%llu", ns);
+        return;
+    }
+
+    zlog__clock_t *c = &zlog__clock;
+    long long sec = (long long)(ns / 1000000000ULL);
+    if (sec != c->sec || mode != c->mode)
+    {
+        long long local = sec;
+        if (ZLOG_TIME_LOCAL == mode)
+        {
+            if (sec >= c->zone_until || ZLOG_TIME_LOCAL != c->mode)
+            {
+                c->zone = zlog__zone_offset((time_t)sec);
+                c->zone_until = sec - sec % 900 + 900;
+            }
+            local += c->zone;
+        }
+        long long days = (local >= 0 ? local : local - 86399) / 86400;
+        long long rem = local - days * 86400;
+        long long y;
+        unsigned m, d;
+        zlog__civil_from_days(days, &y, &m, &d);
+        int n = snprintf(c->text, sizeof(c->text), "%04lld-%02u-%02u %02u:%02u:%02u", y, m, d,
+                         (unsigned)(rem / 3600), (unsigned)(rem / 60 % 60), (unsigned)(rem % 60));
+        c->len = (n > 0 && (size_t)n < sizeof(c->text)) ? (size_t)n : 0;
+        c->sec = sec;
+        c->mode = mode;
+    }
+
+    // Prefix, fractional digits, and a 'Z' for UTC.
+    char tail[12];
+    size_t tn = 0;
+#   if ZLOG_TIME_DIGITS > 0
+    unsigned frac = (unsigned)(ns % 1000000000ULL);
+    for (int i = ZLOG_TIME_DIGITS; i < 9; i++)
+    {
+        frac /= 10;
+    }
+    tail[tn++] = '.';
+    for (int i = ZLOG_TIME_DIGITS - 1; i >= 0; i--)
+    {
+        tail[tn + (size_t)i] = (char)('0' + frac % 10);
+        frac /= 10;
+    }
+    tn += ZLOG_TIME_DIGITS;
+#   endif
+    if (ZLOG_TIME_UTC == mode)
+    {
+        tail[tn++] = 'Z';
+    }
+    if (c->len + tn >= size)
+    {
+        snprintf(buf, size, "%llu", ns);
+        return;
+    }
+    memcpy(buf, c->text, c->len);
+    memcpy(buf + c->len, tail, tn);
+    buf[c->len + tn] = '\0';
+}
+
+void zlog_set_time_mode(zlog_time_mode mode)
+{
+    zlog__time_mode = mode;
+}
+
+void zlog_set_level(zlog_level level) 
+{ 
+    zlog__level = level; 
+    zlog__gate_update();
+}
+
+static void zlog__bin_put(zlog__sink *sink, const void *p, size_t n)
+{
+    fwrite(p, 1, n, sink->fp);
+    sink->written += n;
+}
+
+static void zlog__bin_str(zlog__sink *sink, const char *str)
+{
+    size_t len = str ? strlen(str) : 0;
+    unsigned short n = (unsigned short)(len > 0xFFFF ? 0xFFFF : len);
+    zlog__bin_put(sink, &n, sizeof(n));
+    if (n)
+    {
+        zlog__bin_put(sink, str, n);
+    }
+}
+
+static void zlog__bin_header(zlog__sink *sink)
+{
+    unsigned char info[2];
+    unsigned probe = 1;
+    info[0] = (unsigned char)sizeof(long double);
+    info[1] = (unsigned char)(1 == *(unsigned char *)&probe);
+    zlog__bin_put(sink, ZLOG_BIN_MAGIC, 8);
+    zlog__bin_put(sink, info, sizeof(info));
+}
+
+static void zlog__bin_reset_sites(zlog__site_table *t)
+{
+    for (size_t i = 0; i < t->cap; i++)
+    {
+        Z_FREE(t->items[i].fmt);
+    }
+    Z_FREE(t->items);
+    t->items = NULL;
+    t->cap = 0;
+    t->count = 0;
+}
+
+static size_t zlog__bin_hash(uintptr_t key, const char *file, int line)
+{
+    uintptr_t h = key ^ ((uintptr_t)file * 31u) ^ (uintptr_t)line;
+    h ^= h >> 17;
+    h *= 0x9E3779B1u;
+    return (size_t)(h ^ (h >> 15));
+}
+
+static bool zlog__bin_grow(zlog__site_table *t)
+{
+    size_t cap = t->cap ? t->cap * 2 : 256;
+    zlog__site *items = (zlog__site *)Z_CALLOC(cap, sizeof(zlog__site));
+    if (!items)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < t->cap; i++)
+    {
+        zlog__site *old = &t->items[i];
+        if (old->id)
+        {
+            size_t j = zlog__bin_hash(old->key, old->file, old->line) & (cap - 1);
+            while (items[j].id)
+            {
+                j = (j + 1) & (cap - 1);
+            }
+            items[j] = *old;
+        }
+    }
+    Z_FREE(t->items);
+    t->items = items;
+    t->cap = cap;
+    return true;
+}
+
+// Id of the record's call site; registers it (and writes its 'S' entry) on first use.
+static unsigned zlog__bin_site(zlog__sink *sink, const zlog__record *rec, const char *fmt)
+{
+    zlog__site_table *t = &sink->sites;
+    uintptr_t key = (uintptr_t)fmt;
+    if (t->count * 2 >= t->cap && !zlog__bin_grow(t))
+    {
+        return 0;
+    }
+    size_t mask = t->cap - 1;
+    size_t i = zlog__bin_hash(key, rec->file, rec->line) & mask;
+    for (; t->items[i].id; i = (i + 1) & mask)
+    {
+        const zlog__site *site = &t->items[i];
+        // The format is compared by content too, in case a buffer got reused.
+        if (site->key == key && site->line == rec->line && site->file == rec->file &&
+            site->func == rec->func && site->label == rec->label && 0 == strcmp(site->fmt, fmt))
+        {
+            return site->id;
+        }
+    }
+
+    size_t flen = strlen(fmt);
+    char *copy = (char *)Z_MALLOC(flen + 1);
+    if (!copy)
+    {
+        return 0;
+    }
+    memcpy(copy, fmt, flen + 1);
+
+    zlog__site *site = &t->items[i];
+    site->key = key;
+    site->file = rec->file;
+    site->func = rec->func;
+    site->label = rec->label;
+    site->fmt = copy;
+    site->line = rec->line;
+    site->id = ++t->count;
+
+    unsigned char level = (unsigned char)rec->level;
+    int line = rec->line;
+    zlog__bin_put(sink, "S", 1);
+    zlog__bin_put(sink, &site->id, sizeof(site->id));
+    zlog__bin_put(sink, &level, sizeof(level));
+    zlog__bin_put(sink, &line, sizeof(line));
+    zlog__bin_str(sink, rec->label);
+    zlog__bin_str(sink, rec->file);
+    zlog__bin_str(sink, rec->func);
+    zlog__bin_str(sink, fmt);
+    return site->id;
+}
+
+static void zlog__bin_write(zlog__sink *sink, const zlog__record *rec)
+{
+    // A text record (queued before this sink existed) is stored as a "%s" argument.
+    unsigned char blob[ZLOG_ASYNC_RECORD_MAX];
+    const char *fmt = rec->fmt;
+    const void *data = rec->text;
+    size_t size = rec->size;
+    if (!fmt)
+    {
+        int n = zerr__capturef(blob, sizeof(blob), "%s", rec->text);
+        fmt = "%s";
+        data = blob;
+        size = (n < 0) ? 0 : (size_t)n;
+    }
+
+    unsigned id = zlog__bin_site(sink, rec, fmt);
+    if (rec->kv_count)
+    {
+        unsigned char count = (unsigned char)rec->kv_count;
+        unsigned char shown = (unsigned char)rec->kv_text;
+        unsigned short kv_size = (unsigned short)rec->kv_size;
+        zlog__bin_put(sink, "K", 1);
+        zlog__bin_put(sink, &count, sizeof(count));
+        zlog__bin_put(sink, &shown, sizeof(shown));
+        zlog__bin_put(sink, &kv_size, sizeof(kv_size));
+        zlog__bin_put(sink, rec->kv, kv_size);
+    }
+    unsigned char level = (unsigned char)rec->level;
+    unsigned short len = (unsigned short)size;
+    zlog__bin_put(sink, "R", 1);
+    zlog__bin_put(sink, &rec->ts, sizeof(rec->ts));
+    zlog__bin_put(sink, &level, sizeof(level));
+    zlog__bin_put(sink, &id, sizeof(id));
+    zlog__bin_put(sink, &len, sizeof(len));
+    zlog__bin_put(sink, data, len);
+    zlog__bin_str(sink, rec->extra);
+    sink->dirty = true;
+}
+
+static bool zlog__sink_open_file(zlog__sink *sink, const char *mode)
+{
+    sink->fp = fopen(sink->path, mode);
+    if (!sink->fp)
+    {
+        return false;
+    }
+    // Lines pile up in a larger stdio buffer; flushes happen by size, age or level.
+    setvbuf(sink->fp, NULL, _IOFBF, sink->cfg.flush_bytes ? sink->cfg.flush_bytes : ZLOG_FLUSH_BYTES);
+    fseek(sink->fp, 0, SEEK_END);
+    long pos = ftell(sink->fp);
+    sink->written = (pos > 0) ? (size_t)pos : 0;
+    sink->opened = zlog__now_ns();
+    sink->flushed = sink->opened;
+    if (ZLOG_FORMAT_BINARY == sink->cfg.format)
+    {
+        zlog__bin_reset_sites(&sink->sites);
+        zlog__bin_header(sink);
+    }
+    return true;
+}
+
+static bool zlog__rename(const char *from, const char *to)
+{
+#   if defined(ZFILE_H)
+    return 0 == zfile_rename(from, to);
+#   else
+    return 0 == rename(from, to);
+#   endif
+}
+
+static bool zlog__sink_rotate_due(const zlog__sink *sink, size_t incoming, unsigned long long now)
+{
+    if (ZLOG_SINK_ROTATING != sink->cfg.kind || !sink->fp || 0 == sink->written)
+    {
+        return false;
+    }
+    if (sink->cfg.size && sink->written + incoming > sink->cfg.size)
+    {
+        return true;
+    }
+    return sink->cfg.max_age && now - sink->opened >= sink->cfg.max_age * 1000000000ULL;
+}
+
+/*
+ * Shifts "<path>.1".."<path>.N-1" up by one (dropping ".N"), renames the live
+ * file to "<path>.1" and starts a new one. Each rename is atomic, so readers see
+ * either the old file or the new one under every name.
+ */
+static void zlog__sink_rotate(zlog__sink *sink)
+{
+    unsigned keep = sink->cfg.keep ? sink->cfg.keep : ZLOG_ROTATE_KEEP;
+    size_t n = strlen(sink->path) + 16;
+    char *from = (char *)Z_MALLOC(n);
+    char *to = (char *)Z_MALLOC(n);
+    if (!from || !to)
+    {
+        Z_FREE(from);
+        Z_FREE(to);
+        return;
+    }
+
+    fclose(sink->fp);
+    sink->fp = NULL;
+    sink->dirty = false;
+    snprintf(to, n, "%s.%u", sink->path, keep);
+    remove(to);
+    for (unsigned i = keep; i > 1; i--)
+    {
+        snprintf(from, n, "%s.%u", sink->path, i - 1);
+        snprintf(to, n, "%s.%u", sink->path, i);
+        zlog__rename(from, to);
+    }
+    snprintf(to, n, "%s.1", sink->path);
+    bool moved = zlog__rename(sink->path, to);
+    zlog__sink_open_file(sink, ZLOG_FORMAT_BINARY == sink->cfg.format ? "ab" : "a");
+
+    // Compression and upload belong to the application, off this thread.
+    if (moved && sink->cfg.rotated)
+    {
+        sink->cfg.rotated(to, sink->cfg.user);
+    }
+    Z_FREE(from);
+    Z_FREE(to);
+}
+
+static bool zlog__sink_open_socket(zlog__sink *sink)
+{
+#   if defined(_WIN32)
+    (void)sink;
+    return false;
+#   else
+    const char *path = sink->path ? sink->path : "/dev/log";
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    // A stalled reader costs us dropped lines, never a blocked logger.
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    sink->fd = fd;
+    return true;
+#   endif
+}
+
+static void zlog__sink_close(zlog__sink *sink)
+{
+    if (!sink->used)
+    {
+        return;
+    }
+    if (sink->fp)
+    {
+        fclose(sink->fp);
+    }
+#   if !defined(_WIN32)
+    if (sink->fd >= 0)
+    {
+        close(sink->fd);
+    }
+#   endif
+    if (ZLOG_FORMAT_BINARY == sink->cfg.format)
+    {
+        ZERROR_ATOMIC_ADD(&zlog__sinks.binary, (unsigned long long)-1);
+    }
+    zlog__bin_reset_sites(&sink->sites);
+    Z_FREE(sink->path);
+    Z_FREE(sink->ring);
+    memset(sink, 0, sizeof(*sink));
+    sink->fd = -1;
+}
+
+// Lock held. Sets up the default stderr sink the first time the registry is used.
+static void zlog__sinks_ready(void)
+{
+    if (zlog__sinks.ready)
+    {
+        return;
+    }
+    for (int i = 0; i < ZLOG_SINK_MAX; i++)
+    {
+        memset(&zlog__sinks.items[i], 0, sizeof(zlog__sinks.items[i]));
+        zlog__sinks.items[i].fd = -1;
+    }
+    zlog__sink *console = &zlog__sinks.items[ZLOG_CONSOLE_SINK];
+    console->used = true;
+    console->cfg.kind = ZLOG_SINK_STDERR;
+    console->cfg.level = ZLOG_TRACE;
+    console->cfg.format = ZLOG_FORMAT_COLOR;
+    zlog__sinks.file = -1;
+    zlog__sinks.bin = -1;
+    zlog__sinks.ready = true;
+}
+
+// Lock held. Returns the new sink's id, or -1.
+static int zlog__sink_add(const zlog_sink_config *cfg)
+{
+    zlog__sinks_ready();
+    bool binary = (ZLOG_FORMAT_BINARY == cfg->format);
+    bool is_file = (ZLOG_SINK_FILE == cfg->kind || ZLOG_SINK_ROTATING == cfg->kind);
+    if ((binary && !is_file) || (is_file && !cfg->path) || (ZLOG_SINK_CALLBACK == cfg->kind && !cfg->fn) ||
+        cfg->format < 0 || cfg->format >= ZLOG_FORMAT_COUNT)
+    {
+        return -1;
+    }
+
+    int id = -1;
+    for (int i = 0; i < ZLOG_SINK_MAX; i++)
+    {
+        if (!zlog__sinks.items[i].used)
+        {
+            id = i;
+            break;
+        }
+    }
+    if (id < 0)
+    {
+        return -1;
+    }
+
+    zlog__sink *sink = &zlog__sinks.items[id];
+    sink->cfg = *cfg;
+    sink->fd = -1;
+    if (cfg->path)
+    {
+        size_t n = strlen(cfg->path) + 1;
+        sink->path = (char *)Z_MALLOC(n);
+        if (!sink->path)
+        {
+            return -1;
+        }
+        memcpy(sink->path, cfg->path, n);
+    }
+
+    bool ok = true;
+    switch (cfg->kind)
+    {
+        case ZLOG_SINK_FILE:
+        case ZLOG_SINK_ROTATING:
+            ok = zlog__sink_open_file(sink, binary ? "ab" : "a");
+            break;
+        case ZLOG_SINK_RING:
+            sink->cfg.size = cfg->size ? cfg->size : 65536;
+            sink->ring = (char *)Z_MALLOC(sink->cfg.size);
+            ok = (NULL != sink->ring);
+            break;
+        case ZLOG_SINK_SOCKET:
+            ok = zlog__sink_open_socket(sink);
+            break;
+        default:
+            break;
+    }
+    sink->cfg.path = sink->path;
+    if (!ok)
+    {
+        zlog__bin_reset_sites(&sink->sites);
+        Z_FREE(sink->path);
+        Z_FREE(sink->ring);
+        memset(sink, 0, sizeof(*sink));
+        sink->fd = -1;
+        return -1;
+    }
+    sink->used = true;
+    if (binary)
+    {
+        ZERROR_ATOMIC_ADD(&zlog__sinks.binary, 1);
+    }
+    return id;
+}
+
+// Lock held. Flushes file sinks whose batch is due, or every written one if 'force'.
+static void zlog__sinks_flush(bool force, unsigned long long now)
+{
+    for (int i = 0; i < ZLOG_SINK_MAX; i++)
+    {
+        zlog__sink *sink = &zlog__sinks.items[i];
+        if (!sink->used || !sink->dirty || !sink->fp)
+        {
+            continue;
+        }
+        unsigned long long every = (sink->cfg.flush_ms ? sink->cfg.flush_ms : ZLOG_FLUSH_MS) * 1000000ULL;
+        if (force || now - sink->flushed >= every)
+        {
+            fflush(sink->fp);
+            sink->dirty = false;
+            sink->flushed = now;
+        }
+    }
+}
+
+static void zlog__ring_put(zlog__sink *sink, const char *text, size_t len)
+{
+    size_t cap = sink->cfg.size;
+    if (len > cap)
+    {
+        text += len - cap;
+        sink->ring_total += len - cap;
+        len = cap;
+    }
+    size_t at = sink->ring_total % cap;
+    size_t first = (len < cap - at) ? len : cap - at;
+    memcpy(sink->ring + at, text, first);
+    memcpy(sink->ring, text + first, len - first);
+    sink->ring_total += len;
+}
+
+static const char *zlog__out_time(const zlog__record *rec)
+{
+    if (!zlog__out.have_time)
+    {
+        zlog__get_time(rec->ts, zlog__out.time, sizeof(zlog__out.time));
+        zlog__out.have_time = true;
+    }
+    return zlog__out.time;
+}
+
+// Bounded string builder for the layouts; output past 'cap' is dropped.
+typedef struct
+{
+    char *p;
+    size_t n;
+    size_t cap;
+} zlog__buf;
+
+static void zlog__buf_put(zlog__buf *b, const char *s, size_t n)
+{
+    size_t room = (b->n + 1 < b->cap) ? b->cap - b->n - 1 : 0;
+    if (n > room)
+    {
+        n = room;
+    }
+    memcpy(b->p + b->n, s, n);
+    b->n += n;
+    b->p[b->n] = '\0';
+}
+
+static void zlog__buf_str(zlog__buf *b, const char *s)
+{
+    zlog__buf_put(b, s, strlen(s));
+}
+
+static void zlog__buf_int(zlog__buf *b, long long v)
+{
+    char tmp[24];
+    char *end = tmp + sizeof(tmp);
+    char *p = end;
+    unsigned long long u = (v < 0) ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+    do
+    {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (v < 0)
+    {
+        *--p = '-';
+    }
+    zlog__buf_put(b, p, (size_t)(end - p));
+}
+
+static void zlog__buf_json(zlog__buf *b, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+    zlog__buf_put(b, "\"", 1);
+    const char *run = s;
+    for (; *s; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+        zlog__buf_put(b, run, (size_t)(s - run));
+        run = s + 1;
+        switch (c)
+        {
+            case '"':  zlog__buf_put(b, "\\\"", 2); break;
+            case '\\': zlog__buf_put(b, "\\\\", 2); break;
+            case '\n': zlog__buf_put(b, "\\n", 2); break;
+            case '\t': zlog__buf_put(b, "\\t", 2); break;
+            case '\r': zlog__buf_put(b, "\\r", 2); break;
+            default:
+            {
+                char u[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+                zlog__buf_put(b, u, sizeof(u));
+                break;
+            }
+        }
+    }
+    zlog__buf_put(b, run, (size_t)(s - run));
+    zlog__buf_put(b, "\"", 1);
+}
+
+// logfmt values are bare unless they hold spaces, quotes, '=' or control bytes.
+static void zlog__buf_logfmt(zlog__buf *b, const char *s)
+{
+    bool bare = (s[0] != '\0');
+    for (const char *q = s; *q && bare; q++)
+    {
+        unsigned char c = (unsigned char)*q;
+        bare = (c > ' ' && c != '"' && c != '=' && c != '\\');
+    }
+    if (bare)
+    {
+        zlog__buf_str(b, s);
+    }
+    else
+    {
+        zlog__buf_json(b, s);
+    }
+}
+
+static void zlog__buf_value(zlog__buf *b, const zkv *f, bool json)
+{
+    char tmp[32];
+    switch (f->type)
+    {
+        case ZKV_T_INT:
+            zlog__buf_int(b, f->v.i);
+            break;
+        case ZKV_T_UINT:
+            snprintf(tmp, sizeof(tmp), "%llu", f->v.u);
+            zlog__buf_str(b, tmp);
+            break;
+        case ZKV_T_DOUBLE:
+            // JSON has no NaN or infinity.
+            if (json && (f->v.d != f->v.d || f->v.d - f->v.d != 0.0))
+            {
+                zlog__buf_str(b, "null");
+                break;
+            }
+            snprintf(tmp, sizeof(tmp), "%.17g", f->v.d);
+            zlog__buf_str(b, tmp);
+            break;
+        case ZKV_T_BOOL:
+            zlog__buf_str(b, f->v.i ? "true" : "false");
+            break;
+        case ZKV_T_STR:
+            if (!f->v.s)
+            {
+                zlog__buf_str(b, "null");
+            }
+            else if (json)
+            {
+                zlog__buf_json(b, f->v.s);
+            }
+            else
+            {
+                zlog__buf_logfmt(b, f->v.s);
+            }
+            break;
+    }
+}
+
+// Appends " key=value" for each field.
+static void zlog__buf_pairs(zlog__buf *b, const zkv *fields, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        zlog__buf_put(b, " ", 1);
+        zlog__buf_str(b, fields[i].key);
+        zlog__buf_put(b, "=", 1);
+        zlog__buf_value(b, &fields[i], false);
+    }
+}
+
+// Serializes fields into 'blob' (layout in the binary format comment). Returns bytes used.
+static size_t zlog__kv_pack(unsigned char *blob, size_t cap, const zkv *fields, size_t count, unsigned *packed)
+{
+    size_t used = 0;
+    unsigned n = 0;
+    for (size_t i = 0; i < count && n < ZLOG_KV_MAX; i++)
+    {
+        const zkv *f = &fields[i];
+        const char *key = f->key ? f->key : "";
+        size_t klen = strlen(key);
+        unsigned char type = (unsigned char)f->type;
+        unsigned short k = (unsigned short)(klen > 0xFFFF ? 0xFFFF : klen);
+        size_t mark = used;
+        bool ok = zerr__blob_put(blob, cap, &used, &type, 1) && zerr__blob_put(blob, cap, &used, &k, sizeof(k)) &&
+                  zerr__blob_put(blob, cap, &used, key, k) && zerr__blob_put(blob, cap, &used, "", 1);
+        if (ok && ZKV_T_STR == f->type)
+        {
+            unsigned slen = f->v.s ? (unsigned)strlen(f->v.s) : ZERROR_STR_NULL;
+            ok = zerr__blob_put(blob, cap, &used, &slen, sizeof(slen));
+            if (ok && f->v.s)
+            {
+                ok = zerr__blob_put(blob, cap, &used, f->v.s, slen) && zerr__blob_put(blob, cap, &used, "", 1);
+            }
+        }
+        else if (ok)
+        {
+            ok = zerr__blob_put(blob, cap, &used, &f->v, 8);
+        }
+        if (!ok)
+        {
+            used = mark;
+            break;
+        }
+        n++;
+    }
+    *packed = n;
+    return used;
+}
+
+// Views packed fields as zkv items pointing into the blob. Returns how many were read.
+static size_t zlog__kv_unpack(const unsigned char *blob, size_t size, unsigned count, zkv *out, size_t max)
+{
+    size_t pos = 0;
+    size_t n = 0;
+    for (; n < count && n < max; n++)
+    {
+        unsigned char type;
+        unsigned short k;
+        if (!zerr__blob_get(blob, size, &pos, &type, 1) || !zerr__blob_get(blob, size, &pos, &k, sizeof(k)) ||
+            pos + (size_t)k + 1 > size || type > ZKV_T_STR)
+        {
+            break;
+        }
+        zkv *f = &out[n];
+        f->key = (const char *)blob + pos;
+        f->type = (zkv_type)type;
+        pos += (size_t)k + 1;
+        if (ZKV_T_STR == type)
+        {
+            unsigned slen;
+            if (!zerr__blob_get(blob, size, &pos, &slen, sizeof(slen)))
+            {
+                break;
+            }
+            f->v.s = NULL;
+            if (ZERROR_STR_NULL != slen)
+            {
+                if (pos + (size_t)slen + 1 > size)
+                {
+                    break;
+                }
+                f->v.s = (const char *)blob + pos;
+                pos += (size_t)slen + 1;
+            }
+        }
+        else if (!zerr__blob_get(blob, size, &pos, &f->v, 8))
+        {
+            break;
+        }
+    }
+    return n;
+}
+
+// The message as the text layouts show it: followed by its fields, when it has visible ones.
+static const char *zlog__out_line(const zlog__record *rec)
+{
+    const zlog_entry *e = &zlog__out.entry;
+    if (!rec->kv_text || 0 == e->field_count)
+    {
+        return e->msg;
+    }
+    if (!zlog__out.have_line)
+    {
+        zlog__buf b = { zlog__out.line, 0, sizeof(zlog__out.line) };
+        zlog__buf_str(&b, e->msg);
+        zlog__buf_pairs(&b, e->fields, e->field_count);
+        zlog__out.have_line = true;
+    }
+    return zlog__out.line;
+}
+
+static const char *const zlog__level_names[] = { "trace", "debug", "info", "warn", "error", "fatal" };
+
+// Builds (once per record) the text of one layout.
+static const char *zlog__out_text(const zlog__record *rec, zlog_format format, size_t *len)
+{
+    if (zlog__out.built[format])
+    {
+        *len = zlog__out.len[format];
+        return zlog__out.text[format];
+    }
+
+    const zlog_entry *e = &zlog__out.entry;
+    const char *func = e->func ? e->func : "?";
+    const char *extra = e->extra ? e->extra : "";
+    char *buf = zlog__out.text[format];
+    zlog__buf b = { buf, 0, ZLOG__LINE_MAX };
+    buf[0] = '\0';
+    int n = -1;
+    switch (format)
+    {
+        case ZLOG_FORMAT_COLOR:
+            n = snprintf(buf, ZLOG__LINE_MAX, "\n%s[%s] %s:%s %s\n    \x1b[90mat\x1b[0m %s (%s:%d)%s\n",
+                         zlog__colors[e->level], zlog__out_time(rec), e->label, "\x1b[0m", zlog__out_line(rec), 
+                         func, e->file, e->line, extra);
+            break;
+        case ZLOG_FORMAT_SYSLOG:
+        {
+            // Facility "user" (1); severities follow RFC 5424.
+            static const int sev[] = { 7, 7, 6, 4, 3, 2 };
+            n = snprintf(buf, ZLOG__LINE_MAX, "<%d>zlog: %s: %s (%s:%d)%s", 8 + sev[e->level], 
+                         e->label, zlog__out_line(rec), e->file, e->line, extra);
+            break;
+        }
+        case ZLOG_FORMAT_JSON:
+            zlog__buf_str(&b, "{\"time\":");
+            zlog__buf_json(&b, zlog__out_time(rec));
+            zlog__buf_str(&b, ",\"level\":\"");
+            zlog__buf_str(&b, zlog__level_names[e->level]);
+            zlog__buf_str(&b, "\",\"msg\":");
+            zlog__buf_json(&b, e->msg);
+            zlog__buf_str(&b, ",\"file\":");
+            zlog__buf_json(&b, e->file);
+            zlog__buf_str(&b, ",\"line\":");
+            zlog__buf_int(&b, e->line);
+            zlog__buf_str(&b, ",\"func\":");
+            zlog__buf_json(&b, func);
+            for (size_t i = 0; i < e->field_count; i++)
+            {
+                zlog__buf_put(&b, ",", 1);
+                zlog__buf_json(&b, e->fields[i].key);
+                zlog__buf_put(&b, ":", 1);
+                zlog__buf_value(&b, &e->fields[i], true);
+            }
+            if (extra[0])
+            {
+                zlog__buf_str(&b, ",\"trace\":");
+                zlog__buf_json(&b, extra);
+            }
+            zlog__buf_str(&b, "}\n");
+            break;
+        case ZLOG_FORMAT_LOGFMT:
+            zlog__buf_str(&b, "time=");
+            zlog__buf_logfmt(&b, zlog__out_time(rec));
+            zlog__buf_str(&b, " level=");
+            zlog__buf_str(&b, zlog__level_names[e->level]);
+            zlog__buf_str(&b, " msg=");
+            zlog__buf_logfmt(&b, e->msg);
+            zlog__buf_str(&b, " file=");
+            zlog__buf_logfmt(&b, e->file);
+            zlog__buf_str(&b, " line=");
+            zlog__buf_int(&b, e->line);
+            zlog__buf_str(&b, " func=");
+            zlog__buf_logfmt(&b, func);
+            zlog__buf_pairs(&b, e->fields, e->field_count);
+            if (extra[0])
+            {
+                zlog__buf_str(&b, " trace=");
+                zlog__buf_logfmt(&b, extra);
+            }
+            zlog__buf_put(&b, "\n", 1);
+            break;
+        default:
+            n = snprintf(buf, ZLOG__LINE_MAX, "\n[%s] %s: %s\n    at %s (%s:%d)%s\n",
+                         zlog__out_time(rec), e->label, zlog__out_line(rec), func, e->file, e->line, extra);
+            break;
+    }
+    size_t used = (n < 0) ? b.n : (size_t)n;
+    if (used >= ZLOG__LINE_MAX)
+    {
+        used = ZLOG__LINE_MAX - 1;
+    }
+    zlog__out.built[format] = true;
+    zlog__out.len[format] = used;
+    *len = used;
+    return buf;
+}
+
+// Lock held. Hands one record to every sink that wants it.
+static void zlog__print_internal(const zlog__record *rec) 
+{
+    zlog__sinks_ready();
+
+    zlog_entry *e = &zlog__out.entry;
+    e->level = rec->level;
+    e->label = rec->label;
+    e->file = rec->file;
+    e->line = rec->line;
+    e->func = rec->func;
+    e->msg = rec->text;
+    e->extra = rec->extra;
+    e->ts = rec->ts;
+    e->fields = zlog__out.kv;
+    e->field_count = rec->kv_count ? zlog__kv_unpack(rec->kv, rec->kv_size, rec->kv_count, zlog__out.kv, ZLOG_KV_MAX) : 0;
+    zlog__out.have_msg = (NULL == rec->fmt);
+    zlog__out.have_time = false;
+    zlog__out.have_line = false;
+    memset(zlog__out.built, 0, sizeof(zlog__out.built));
+
+    for (int i = 0; i < ZLOG_SINK_MAX; i++)
+    {
+        zlog__sink *sink = &zlog__sinks.items[i];
+        if (!sink->used || rec->level < sink->cfg.level)
+        {
+            continue;
+        }
+        if (ZLOG_FORMAT_BINARY == sink->cfg.format)
+        {
+            if (zlog__sink_rotate_due(sink, rec->size, rec->ts))
+            {
+                zlog__sink_rotate(sink);
+            }
+            if (sink->fp)
+            {
+                zlog__bin_write(sink, rec);
+            }
+            continue;
+        }
+
+        // Binary records are rendered once, for the first text sink.
+        if (!zlog__out.have_msg)
+        {
+            zerr__render(rec->fmt, (const unsigned char *)rec->text, rec->size, zlog__out.msg, sizeof(zlog__out.msg));
+            e->msg = zlog__out.msg;
+            zlog__out.have_msg = true;
+        }
+        size_t len;
+        const char *text = zlog__out_text(rec, sink->cfg.format, &len);
+        switch (sink->cfg.kind)
+        {
+            case ZLOG_SINK_STDERR:
+                fwrite(text, 1, len, stderr);
+                break;
+            case ZLOG_SINK_ROTATING:
+                if (zlog__sink_rotate_due(sink, len, rec->ts))
+                {
+                    zlog__sink_rotate(sink);
+                }
+                /* fallthrough */
+            case ZLOG_SINK_FILE:
+                if (sink->fp)
+                {
+                    fwrite(text, 1, len, sink->fp);
+                    sink->written += len;
+                    sink->dirty = true;
+                }
+                break;
+            case ZLOG_SINK_RING:
+                zlog__ring_put(sink, text, len);
+                break;
+            case ZLOG_SINK_CALLBACK:
+                sink->cfg.fn(e, text, len, sink->cfg.user);
+                break;
+            case ZLOG_SINK_SOCKET:
+#               if !defined(_WIN32)
+                // Failures (reader gone, buffer full) drop the line.
+                (void)send(sink->fd, text, len, 0);
+#               endif
+                break;
+        }
+    }
+}
+
+void zlog_init(const char *file_path, zlog_level min_level) 
+{
+    zlog__init_mutex();
+    zlog__level = min_level;
+    zlog__gate_update();
+    zlog__lock();
+    zlog__sinks_ready();
+    if (zlog__sinks.file >= 0)
+    {
+        zlog__sink_close(&zlog__sinks.items[zlog__sinks.file]);
+        zlog__sinks.file = -1;
+    }
+    if (file_path) 
+    {
+        zlog_sink_config cfg;
+        memset(&cfg, 0, sizeof(cfg));
+        cfg.kind = ZLOG_SINK_FILE;
+        cfg.level = ZLOG_TRACE;
+        cfg.format = ZLOG_FORMAT_TEXT;
+        cfg.path = file_path;
+        zlog__sinks.file = zlog__sink_add(&cfg);
+    }
+    zlog__unlock();
+}
+
+int zlog_add_sink(const zlog_sink_config *config)
+{
+    if (!config)
+    {
+        return -1;
+    }
+    zlog__lock();
+    int id = zlog__sink_add(config);
+    zlog__unlock();
+    return id;
+}
+
+void zlog_remove_sink(int id)
+{
+    if (id < 0 || id >= ZLOG_SINK_MAX)
+    {
+        return;
+    }
+    zlog__lock();
+    zlog__sinks_ready();
+    zlog__sink_close(&zlog__sinks.items[id]);
+    if (id == zlog__sinks.file)
+    {
+        zlog__sinks.file = -1;
+    }
+    if (id == zlog__sinks.bin)
+    {
+        zlog__sinks.bin = -1;
+    }
+    zlog__unlock();
+}
+
+void zlog_set_sink_level(int id, zlog_level level)
+{
+    if (id < 0 || id >= ZLOG_SINK_MAX)
+    {
+        return;
+    }
+    zlog__lock();
+    zlog__sinks_ready();
+    zlog__sinks.items[id].cfg.level = level;
+    zlog__unlock();
+}
+
+size_t zlog_ring_read(int id, char *buf, size_t size)
+{
+    if (id < 0 || id >= ZLOG_SINK_MAX || !buf || !size)
+    {
+        return 0;
+    }
+    size_t n = 0;
+    zlog__lock();
+    zlog__sinks_ready();
+    const zlog__sink *sink = &zlog__sinks.items[id];
+    if (sink->used && ZLOG_SINK_RING == sink->cfg.kind)
+    {
+        size_t cap = sink->cfg.size;
+        n = sink->ring_total < cap ? sink->ring_total : cap;
+        if (n > size - 1)
+        {
+            n = size - 1;
+        }
+        // Oldest byte we return, then copy across the wrap.
+        size_t at = (sink->ring_total - n) % cap;
+        size_t first = (n < cap - at) ? n : cap - at;
+        memcpy(buf, sink->ring + at, first);
+        memcpy(buf + first, sink->ring, n - first);
+    }
+    buf[n] = '\0';
+    zlog__unlock();
+    return n;
+}
+
+// Timestamp given to the next record built on this thread (0 = now); set while the flight recorder replays.
+#if defined(_MSC_VER)
+    static __declspec(thread) unsigned long long zlog__replay_ts;
+#else
+    static __thread unsigned long long zlog__replay_ts;
+#endif
+
+static void zlog__fill(zlog__record *rec, zlog_level level, const char *label, const char *file, int line, 
+                       const char *func, const char *extra, const zlog__fields *kv, const char *fmt, va_list args)
+{
+    rec->level = level;
+    rec->label = label;
+    rec->file = file;
+    rec->line = line;
+    rec->func = func;
+    rec->fmt = NULL;
+    rec->extra = NULL;
+    rec->ts = zlog__replay_ts ? zlog__replay_ts : zlog__now_ns();
+    rec->kv = NULL;
+    rec->kv_size = 0;
+    rec->kv_count = 0;
+    rec->kv_text = kv ? kv->text : false;
+
+    size_t used;
+    if (ZERROR_ATOMIC_LOAD(&zlog__sinks.binary))
+    {
+        // Binary: keep the arguments raw. Formats that cannot be captured are stored as text.
+        va_list copy;
+        va_copy(copy, args);
+        int n = zerr__capture(fmt, copy, (unsigned char *)rec->text, sizeof(rec->text) / 2);
+        va_end(copy);
+        rec->fmt = fmt;
+        if (n < 0)
+        {
+            char msg[ZLOG_ASYNC_RECORD_MAX / 2];
+            vsnprintf(msg, sizeof(msg), fmt, args);
+            rec->fmt = "%s";
+            n = zerr__capturef((unsigned char *)rec->text, sizeof(rec->text) / 2, "%s", msg);
+        }
+        rec->size = (size_t)n;
+        used = rec->size;
+        rec->text[used] = '\0';
+    }
+    else
+    {
+        int n = vsnprintf(rec->text, sizeof(rec->text), fmt, args);
+        used = (n < 0) ? 0 : (size_t)n;
+        if (used >= sizeof(rec->text) - 1) 
+        {
+            used = sizeof(rec->text) - 1;
+        }
+        rec->size = used;
+    }
+    // Extra info is stored right after the message terminator, then the fields.
+    size_t end = used + 1;
+    if (extra && extra[0] && end < sizeof(rec->text)) 
+    {
+        char *dst = rec->text + end;
+        int n = snprintf(dst, sizeof(rec->text) - end, "%s", extra);
+        rec->extra = dst;
+        end += (n < 0) ? 0 : (size_t)n + 1;
+    }
+    if (kv && kv->count && end < sizeof(rec->text))
+    {
+        unsigned char *blob = (unsigned char *)rec->text + end;
+        rec->kv = blob;
+        rec->kv_size = zlog__kv_pack(blob, sizeof(rec->text) - end, kv->items, kv->count, &rec->kv_count);
+    }
+}
+
+static zlog__slot *zlog__async_claim(void)
+{
+    unsigned long long pos = ZERROR_ATOMIC_LOAD(&zlog__async.head);
+    for (;;)
+    {
+        zlog__slot *slot = &zlog__async.slots[pos & zlog__async.mask];
+        long long diff = (long long)(ZERROR_ATOMIC_LOAD(&slot->seq) - pos);
+        if (0 == diff)
+        {
+            if (ZERROR_ATOMIC_CAS(&zlog__async.head, &pos, pos + 1))
+            {
+                return slot;
+            }
+        }
+        else if (diff < 0)
+        {
+            return NULL;
+        }
+        else
+        {
+            pos = ZERROR_ATOMIC_LOAD(&zlog__async.head);
+        }
+    }
+}
+
+static void zlog__async_publish(zlog__slot *slot)
+{
+    ZERROR_ATOMIC_STORE(&slot->seq, slot->seq + 1);
+}
+
+static zlog__slot *zlog__async_pop(void)
+{
+    unsigned long long pos = ZERROR_ATOMIC_LOAD(&zlog__async.tail);
+    for (;;)
+    {
+        zlog__slot *slot = &zlog__async.slots[pos & zlog__async.mask];
+        long long diff = (long long)(ZERROR_ATOMIC_LOAD(&slot->seq) - (pos + 1));
+        if (0 == diff)
+        {
+            if (ZERROR_ATOMIC_CAS(&zlog__async.tail, &pos, pos + 1))
+            {
+                return slot;
+            }
+        }
+        else if (diff < 0)
+        {
+            return NULL;
+        }
+        else
+        {
+            pos = ZERROR_ATOMIC_LOAD(&zlog__async.tail);
+        }
+    }
+}
+
+static void zlog__async_release(zlog__slot *slot)
+{
+    // Slot becomes writable again one lap later.
+    ZERROR_ATOMIC_STORE(&slot->seq, slot->seq + zlog__async.mask);
+    ZERROR_ATOMIC_ADD(&zlog__async.retired, 1);
+}
+
+static void zlog__async_wake(void)
+{
+    zlog__lock();
+#   if defined(_WIN32)
+    WakeConditionVariable(&zlog__async.wake);
+#   else
+    pthread_cond_signal(&zlog__async.wake);
+#   endif
+    zlog__unlock();
+}
+
+static void zlog__async_drain(void)
+{
+    bool urgent = false;
+    zlog__slot *slot;
+    zlog__lock();
+    while ((slot = zlog__async_pop()) != NULL)
+    {
+        zlog__print_internal(&slot->rec);
+        urgent |= (slot->rec.level >= ZLOG_FLUSH_LEVEL);
+        zlog__async_release(slot);
+    }
+    // Runs on idle wake-ups too, so a quiet log still reaches disk on time.
+    zlog__sinks_flush(urgent, zlog__now_ns());
+    zlog__unlock();
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI zlog__async_main(LPVOID arg)
+#else
+static void *zlog__async_main(void *arg)
+#endif
+{
+    (void)arg;
+    while (ZERROR_ATOMIC_LOAD(&zlog__async.running))
+    {
+        zlog__async_drain();
+        zlog__lock();
+#       if defined(_WIN32)
+        SleepConditionVariableCS(&zlog__async.wake, &zlog__state.mutex, 1);
+#       else
+        struct timespec ts;
+        timespec_get(&ts, TIME_UTC);
+        ts.tv_nsec += 1000000;
+        if (ts.tv_nsec >= 1000000000L)
+        {
+            ts.tv_sec += 1;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&zlog__async.wake, &zlog__state.mutex, &ts);
+#       endif
+        zlog__unlock();
+    }
+    zlog__async_drain();
+    return 0;
+}
+
+// Returns false if the record must be written synchronously instead.
+static bool zlog__async_push(zlog_level level, const char *label, const char *file, int line, 
+                             const char *func, const char *extra, const zlog__fields *kv, 
+                             const char *fmt, va_list args)
+{
+    bool pushed = false;
+    ZERROR_ATOMIC_ADD(&zlog__async.inflight, 1);
+    // Pairs with the fence in zlog_shutdown: either it sees us in flight, or we see it stopped.
+    ZERROR_ATOMIC_FENCE();
+    while (ZERROR_ATOMIC_LOAD(&zlog__async.running))
+    {
+        zlog__slot *slot = zlog__async_claim();
+        if (slot)
+        {
+            zlog__fill(&slot->rec, level, label, file, line, func, extra, kv, fmt, args);
+            zlog__async_publish(slot);
+            pushed = true;
+            break;
+        }
+        if (ZLOG_OVERFLOW_DROP_NEWEST == zlog__async.policy)
+        {
+            ZERROR_ATOMIC_ADD(&zlog__async.dropped, 1);
+            pushed = true;
+            break;
+        }
+        if (ZLOG_OVERFLOW_DROP_OLDEST == zlog__async.policy)
+        {
+            zlog__slot *old = zlog__async_pop();
+            if (old)
+            {
+                zlog__async_release(old);
+                ZERROR_ATOMIC_ADD(&zlog__async.dropped, 1);
+            }
+            continue;
+        }
+        zlog__yield();
+    }
+    ZERROR_ATOMIC_ADD(&zlog__async.inflight, (unsigned long long)-1);
+    return pushed;
+}
+
+static void zlog__emitv(zlog_level level, const char *label, const char *file, int line, 
+                        const char *func, const char *extra, const zlog__fields *kv, 
+                        const char *fmt, va_list args)
+{
+    if (ZERROR_ATOMIC_LOAD(&zlog__async.running))
+    {
+        va_list copy;
+        va_copy(copy, args);
+        bool pushed = zlog__async_push(level, label, file, line, func, extra, kv, fmt, copy);
+        va_end(copy);
+        if (pushed)
+        {
+            return;
+        }
+    }
+
+    zlog__record rec;
+    zlog__fill(&rec, level, label, file, line, func, extra, kv, fmt, args);
+    zlog__lock();
+    zlog__print_internal(&rec);
+    zlog__sinks_flush(rec.level >= ZLOG_FLUSH_LEVEL, rec.ts);
+    zlog__unlock();
+}
+
+static void zlog__emit(zlog_level level, const char *label, const char *file, int line, 
+                       const char *func, const char *extra, const zlog__fields *kv, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    zlog__emitv(level, label, file, line, func, extra, kv, fmt, args);
+    va_end(args);
+}
+
+static void zlog__async_stop(void);
+
+static void zlog__async_atexit(void)
+{
+    zlog_shutdown();
+}
+
+void zlog_init_async(const char *file_path, zlog_level min_level, size_t capacity, zlog_overflow policy)
+{
+    static bool hooked = false;
+
+    // Sinks added with zlog_add_sink stay registered; only the file sink is replaced.
+    zlog__async_stop();
+    zlog_init(file_path, min_level);
+
+    size_t cap = 2;
+    while (cap < (capacity ? capacity : 1024))
+    {
+        cap <<= 1;
+    }
+    zlog__async.slots = (zlog__slot *)Z_MALLOC(cap * sizeof(zlog__slot));
+    if (!zlog__async.slots)
+    {
+        return;
+    }
+    for (size_t i = 0; i < cap; i++)
+    {
+        zlog__async.slots[i].seq = i;
+    }
+    zlog__async.mask = cap - 1;
+    zlog__async.policy = policy;
+    zlog__async.head = 0;
+    zlog__async.tail = 0;
+    zlog__async.retired = 0;
+    zlog__async.dropped = 0;
+    ZERROR_ATOMIC_STORE(&zlog__async.running, 1);
+
+#   if defined(_WIN32)
+    InitializeConditionVariable(&zlog__async.wake);
+    zlog__async.thread = CreateThread(NULL, 0, zlog__async_main, NULL, 0, NULL);
+    bool started = (NULL != zlog__async.thread);
+#   else
+    pthread_cond_init(&zlog__async.wake, NULL);
+    bool started = (0 == pthread_create(&zlog__async.thread, NULL, zlog__async_main, NULL));
+#   endif
+    if (!started)
+    {
+        ZERROR_ATOMIC_STORE(&zlog__async.running, 0);
+        Z_FREE(zlog__async.slots);
+        zlog__async.slots = NULL;
+        return;
+    }
+
+    if (!hooked)
+    {
+        atexit(zlog__async_atexit);
+        hooked = true;
+    }
+}
+
+void zlog_flush(void)
+{
+    if (ZERROR_ATOMIC_LOAD(&zlog__async.running))
+    {
+        unsigned long long target = ZERROR_ATOMIC_LOAD(&zlog__async.head);
+        zlog__async_wake();
+        while (ZERROR_ATOMIC_LOAD(&zlog__async.retired) < target)
+        {
+            zlog__yield();
+        }
+    }
+    zlog__lock();
+    fflush(stderr);
+    zlog__sinks_flush(true, zlog__now_ns());
+    zlog__unlock();
+}
+
+// Stops the writer thread after it has drained the queue.
+static void zlog__async_stop(void)
+{
+    if (zlog__async.slots)
+    {
+        // Stop new pushes, wait for producers already inside, then let the writer drain.
+        ZERROR_ATOMIC_STORE(&zlog__async.running, 0);
+        ZERROR_ATOMIC_FENCE();
+        while (ZERROR_ATOMIC_LOAD(&zlog__async.inflight))
+        {
+            zlog__yield();
+        }
+        zlog__async_wake();
+#       if defined(_WIN32)
+        WaitForSingleObject(zlog__async.thread, INFINITE);
+        CloseHandle(zlog__async.thread);
+#       else
+        pthread_join(zlog__async.thread, NULL);
+        pthread_cond_destroy(&zlog__async.wake);
+#       endif
+        Z_FREE(zlog__async.slots);
+        zlog__async.slots = NULL;
+    }
+}
+
+void zlog_shutdown(void)
+{
+    zlog__async_stop();
+    // Close every sink; the next record starts over with the default stderr sink.
+    zlog__lock();
+    if (zlog__sinks.ready)
+    {
+        for (int i = 0; i < ZLOG_SINK_MAX; i++)
+        {
+            zlog__sink_close(&zlog__sinks.items[i]);
+        }
+        zlog__sinks.ready = false;
+    }
+    zlog__unlock();
+}
+
+void zlog_init_binary(const char *file_path, zlog_level min_level)
+{
+    zlog__init_mutex();
+    zlog__level = min_level;
+    zlog__gate_update();
+    zlog__lock();
+    zlog__sinks_ready();
+    if (zlog__sinks.bin >= 0)
+    {
+        zlog__sink_close(&zlog__sinks.items[zlog__sinks.bin]);
+        zlog__sinks.bin = -1;
+    }
+    if (file_path)
+    {
+        zlog_sink_config cfg;
+        memset(&cfg, 0, sizeof(cfg));
+        cfg.kind = ZLOG_SINK_FILE;
+        cfg.level = ZLOG_TRACE;
+        cfg.format = ZLOG_FORMAT_BINARY;
+        cfg.path = file_path;
+        zlog__sinks.bin = zlog__sink_add(&cfg);
+    }
+    // The console only echoes what is worth seeing right away.
+    zlog__sinks.items[ZLOG_CONSOLE_SINK].cfg.level = ZLOG_BINARY_ECHO_LEVEL;
+    zlog__unlock();
+}
+
+size_t zlog_dropped(void)
+{
+    return (size_t)ZERROR_ATOMIC_LOAD(&zlog__async.dropped);
+}
+
+/*
+ * Rate limiting. The token bucket is kept as a theoretical arrival time (GCRA):
+ * a call passes if it is no more than one second's worth of tokens ahead of
+ * now, and moves the time on by one interval with a CAS. Sampling is a single
+ * atomic add. Dropped calls are counted and summarized by the next call that
+ * passes, at most every ZLOG_LIMIT_SUMMARY_MS.
+ */
+static bool zlog__limit_take(zlog_limit *site, unsigned long long interval, unsigned long long now)
+{
+    unsigned long long burst = (interval < 1000000000ULL) ? 1000000000ULL - interval : 0;
+    unsigned long long tat = ZERROR_ATOMIC_LOAD(&site->tat);
+    for (;;)
+    {
+        unsigned long long start = (tat > now) ? tat : now;
+        if (start - now > burst)
+        {
+            return false;
+        }
+        if (ZERROR_ATOMIC_CAS(&site->tat, &tat, start + interval))
+        {
+            return true;
+        }
+    }
+}
+
+// Nanoseconds between records at 'per_sec' (> 0): at least 1, at most about 31 years.
+static unsigned long long zlog__limit_interval(double per_sec)
+{
+    if (per_sec >= 1e9)
+    {
+        return 1;
+    }
+    double ns = 1e9 / per_sec;
+    return (ns < 1e18) ? (unsigned long long)ns : 1000000000000000000ULL;
+}
+
+static bool zlog__limit_done(zlog_limit *site, bool pass, zlog_level level, const char *file, int line, 
+                             const char *func, unsigned long long now)
+{
+    if (!pass)
+    {
+        ZERROR_ATOMIC_ADD(&site->suppressed, 1);
+        return false;
+    }
+    if (ZERROR_LIKELY(0 == ZERROR_ATOMIC_LOAD(&site->suppressed)))
+    {
+        return true;
+    }
+    now = now ? now : zlog__now_ns();
+    unsigned long long last = ZERROR_ATOMIC_LOAD(&site->reported);
+    if (now - last >= (unsigned long long)ZLOG_LIMIT_SUMMARY_MS * 1000000ULL && 
+        ZERROR_ATOMIC_CAS(&site->reported, &last, now))
+    {
+        unsigned long long n = ZERROR_ATOMIC_LOAD(&site->suppressed);
+        ZERROR_ATOMIC_ADD(&site->suppressed, 0ULL - n);
+        zlog__emit(level, zlog__labels[level], file, line, func, NULL, NULL, 
+                   "suppressed %llu similar messages", n);
+    }
+    return true;
+}
+
+bool zlog__limit(zlog_limit *site, zlog_level level, const char *file, int line, const char *func,
+                 unsigned long long every, double per_sec)
+{
+    bool pass = true;
+    unsigned long long now = 0;
+    if (every > 1)
+    {
+        pass = 0 == ZERROR_ATOMIC_ADD(&site->count, 1) % every;
+    }
+    if (pass && per_sec > 0)
+    {
+        now = zlog__now_ns();
+        pass = zlog__limit_take(site, zlog__limit_interval(per_sec), now);
+    }
+    return zlog__limit_done(site, pass, level, file, line, func, now);
+}
+
+// Global policy: one bucket per (file, line), claimed like the error stats slots.
+typedef struct
+{
+    unsigned long long tag;
+    unsigned long long ready;
+    const char *file;
+    int line;
+    zlog_limit state;
+} zlog__limit_slot;
+
+static struct
+{
+    unsigned long long interval;
+    zlog__limit_slot sites[ZLOG_LIMIT_SITES];
+} zlog__limits;
+
+static zlog_limit *zlog__limit_site(const char *file, int line)
+{
+    unsigned long long tag = (unsigned long long)(uintptr_t)file ^ ((unsigned long long)(unsigned)line << 32);
+    tag = (tag * 0x9E3779B97F4A7C15ULL) | 1;
+    for (size_t i = 0; i < ZLOG_LIMIT_SITES; i++)
+    {
+        zlog__limit_slot *slot = &zlog__limits.sites[((tag >> 16) + i) % ZLOG_LIMIT_SITES];
+        unsigned long long seen = ZERROR_ATOMIC_LOAD(&slot->tag);
+        if (0 == seen)
+        {
+            while (!ZERROR_ATOMIC_CAS(&slot->tag, &seen, tag) && 0 == seen)
+            {
+            }
+            if (0 == seen)
+            {
+                slot->file = file;
+                slot->line = line;
+                ZERROR_ATOMIC_STORE(&slot->ready, 1);
+                return &slot->state;
+            }
+        }
+        if (seen == tag)
+        {
+            while (!ZERROR_ATOMIC_LOAD(&slot->ready))
+            {
+                zlog__yield();
+            }
+            if (slot->file == file && slot->line == line)
+            {
+                return &slot->state;
+            }
+        }
+    }
+    return NULL;
+}
+
+static bool zlog__limit_global(zlog_level level, const char *file, int line, const char *func)
+{
+    unsigned long long interval = ZERROR_ATOMIC_LOAD(&zlog__limits.interval);
+    if (ZERROR_LIKELY(0 == interval))
+    {
+        return true;
+    }
+    zlog_limit *site = zlog__limit_site(file, line);
+    if (!site)
+    {
+        return true;
+    }
+    unsigned long long now = zlog__now_ns();
+    return zlog__limit_done(site, zlog__limit_take(site, interval, now), level, file, line, func, now);
+}
+
+void zlog_set_rate_limit(double per_sec)
+{
+    unsigned long long interval = 0;
+    if (per_sec > 0)
+    {
+        interval = zlog__limit_interval(per_sec);
+    }
+    ZERROR_ATOMIC_STORE(&zlog__limits.interval, interval);
+}
+
+/*
+ * Flight recorder: a per-thread ring of fixed-size binary records. Writing one
+ * stores the call site and the raw arguments (the zerr__capture encoding), with
+ * no formatting and no lock; only its own thread reads it back, when a dump is
+ * triggered. Records that also went to the sinks are marked and not replayed.
+ */
+enum
+{
+    ZLOG__FLIGHT_RAW = 1,   // The format could not be captured; 'fmt' is shown as is.
+    ZLOG__FLIGHT_KV = 2,    // 'args' holds the message, then the packed fields.
+    ZLOG__FLIGHT_SHOWN = 4  // Already written to the sinks.
+};
+
+typedef struct
+{
+    unsigned long long ts;
+    const char *fmt;
+    const char *file;
+    const char *func;
+    int line;
+    unsigned char level;
+    unsigned char flags;
+    unsigned short size;    // Bytes used in 'args'.
+    unsigned count;         // KV: packed fields.
+    unsigned char args[ZLOG_FLIGHT_ARGS];
+} zlog__flight_rec;
+
+typedef struct
+{
+    unsigned long long total;   // Records ever written; the newest is at (total - 1) % ZLOG_FLIGHT_RECORDS.
+    unsigned long long start;   // Records before this one were dumped or cleared.
+    bool dumping;
+    zlog__flight_rec recs[ZLOG_FLIGHT_RECORDS];
+} zlog__flight_t;
+
+#if defined(_MSC_VER)
+    static __declspec(thread) zlog__flight_t zlog__flight;
+#else
+    static __thread zlog__flight_t zlog__flight;
+#endif
+
+static zlog__flight_rec *zlog__flight_next(zlog_level level, const char *file, int line, const char *func, bool shown)
+{
+    zlog__flight_t *fr = &zlog__flight;
+    zlog__flight_rec *rec = &fr->recs[fr->total % ZLOG_FLIGHT_RECORDS];
+    fr->total++;
+    rec->ts = zlog__now_ns();
+    rec->file = file;
+    rec->line = line;
+    rec->func = func;
+    rec->level = (unsigned char)level;
+    rec->flags = shown ? ZLOG__FLIGHT_SHOWN : 0;
+    rec->size = 0;
+    rec->count = 0;
+    return rec;
+}
+
+static void zlog__flight_msg(zlog_level level, const char *file, int line, const char *func, bool shown,
+                             const char *fmt, va_list args)
+{
+    zlog__flight_rec *rec = zlog__flight_next(level, file, line, func, shown);
+    int n = zerr__capture(fmt, args, rec->args, sizeof(rec->args));
+    rec->fmt = fmt;
+    if (n < 0)
+    {
+        rec->flags |= ZLOG__FLIGHT_RAW;
+        n = 0;
+    }
+    rec->size = (unsigned short)n;
+}
+
+void zlog_set_flight_level(zlog_level level)
+{
+    zlog__flight_level = level;
+    zlog__gate_update();
+}
+
+void zlog_flight_clear(void)
+{
+    zlog__flight.start = zlog__flight.total;
+}
+
+void zlog_flight_dump(void)
+{
+    zlog__flight_t *fr = &zlog__flight;
+    if (fr->dumping)
+    {
+        return;
+    }
+    unsigned long long from = fr->start;
+    if (fr->total - from > ZLOG_FLIGHT_RECORDS)
+    {
+        from = fr->total - ZLOG_FLIGHT_RECORDS;
+    }
+    unsigned pending = 0;
+    for (unsigned long long i = from; i < fr->total; i++)
+    {
+        pending += !(fr->recs[i % ZLOG_FLIGHT_RECORDS].flags & ZLOG__FLIGHT_SHOWN);
+    }
+    if (0 == pending)
+    {
+        fr->start = fr->total;
+        return;
+    }
+
+    // Replaying goes through the normal paths, which must not record again.
+    fr->dumping = true;
+    zlog__emit(ZLOG_INFO, "FLIGHT", "zerror", 0, "zlog_flight_dump", NULL, NULL,
+               "%u earlier records from this thread", pending);
+    char text[ZLOG_ASYNC_RECORD_MAX / 2];
+    zkv fields[ZLOG_KV_MAX];
+    for (unsigned long long i = from; i < fr->total; i++)
+    {
+        const zlog__flight_rec *rec = &fr->recs[i % ZLOG_FLIGHT_RECORDS];
+        if (rec->flags & ZLOG__FLIGHT_SHOWN)
+        {
+            continue;
+        }
+        zlog__fields kv = { fields, 0, true };
+        if (rec->flags & ZLOG__FLIGHT_KV)
+        {
+            size_t mlen = strlen((const char *)rec->args) + 1;
+            kv.count = zlog__kv_unpack(rec->args + mlen, rec->size - mlen, rec->count, fields, ZLOG_KV_MAX);
+            snprintf(text, sizeof(text), "%s", (const char *)rec->args);
+        }
+        else if (rec->flags & ZLOG__FLIGHT_RAW)
+        {
+            snprintf(text, sizeof(text), "%s", rec->fmt);
+        }
+        else
+        {
+            zerr__render(rec->fmt, rec->args, rec->size, text, sizeof(text));
+        }
+        zlog__replay_ts = rec->ts;
+        zlog__emit((zlog_level)rec->level, zlog__labels[rec->level], rec->file, rec->line, rec->func, 
+                   NULL, kv.count ? &kv : NULL, "%s", text);
+    }
+    zlog__replay_ts = 0;
+    fr->start = fr->total;
+    fr->dumping = false;
+}
+
+void zlog_msg(zlog_level level, const char *file, int line, const char *func, const char *fmt, ...) 
+{
+    // Decided before recording: a record the global limit drops must stay replayable.
+    bool show = level >= zlog__level && zlog__limit_global(level, file, line, func);
+    va_list args;
+    va_start(args, fmt);
+    if (level >= zlog__flight_level && !zlog__flight.dumping)
+    {
+        va_list copy;
+        va_copy(copy, args);
+        zlog__flight_msg(level, file, line, func, show, fmt, copy);
+        va_end(copy);
+    }
+    if (show) 
+    {
+        zlog__emitv(level, zlog__labels[level], file, line, func, NULL, NULL, fmt, args);
+    }
+    va_end(args);
+}
+
+void zlog_kv(zlog_level level, const char *file, int line, const char *func, const char *msg, 
+             const zkv *fields, size_t count)
+{
+    bool show = level >= zlog__level && zlog__limit_global(level, file, line, func);
+    if (level >= zlog__flight_level && !zlog__flight.dumping)
+    {
+        // The message is copied too: unlike a format string it need not be a literal.
+        zlog__flight_rec *rec = zlog__flight_next(level, file, line, func, show);
+        size_t mlen = msg ? strlen(msg) : 0;
+        mlen = (mlen < sizeof(rec->args) - 1) ? mlen : sizeof(rec->args) - 1;
+        memcpy(rec->args, msg ? msg : "", mlen);
+        rec->args[mlen] = '\0';
+        rec->fmt = NULL;
+        rec->flags |= ZLOG__FLIGHT_KV;
+        rec->size = (unsigned short)(mlen + 1 + zlog__kv_pack(rec->args + mlen + 1, sizeof(rec->args) - mlen - 1, 
+                                                              fields, count, &rec->count));
+    }
+    if (!show) 
+    {
+        return;
+    }
+    zlog__fields kv = { fields, count, true };
+    zlog__emit(level, zlog__labels[level], file, line, func, NULL, &kv, "%s", msg ? msg : "");
+}
+
+/*
+ * Error code registry. A code's domain is code / ZERR_DOMAIN_SPAN and its row
+ * code % ZERR_DOMAIN_SPAN, so a lookup is two loads and no search. Domains are
+ * published once and never removed, so readers (the crash handler included)
+ * take no lock.
+ */
+static unsigned long long zerr__domains[ZERR_DOMAIN_MAX];
+
+// Indexed by -code.
+static const zerr_code_desc zerr__builtin_codes[] =
+{
+    { Z_OK,        "Z_OK",        "Success",                ZERR_SEV_INFO,  false },
+    { Z_ERR,       "Z_ERR",       "Generic error",          ZERR_SEV_ERROR, false },
+    { Z_ENOMEM,    "Z_ENOMEM",    "Out of memory",          ZERR_SEV_FATAL, true  },
+    { Z_EOOB,      "Z_EOOB",      "Out of bounds",          ZERR_SEV_ERROR, false },
+    { Z_EEMPTY,    "Z_EEMPTY",    "Container is empty",     ZERR_SEV_WARN,  false },
+    { Z_ENOTFOUND, "Z_ENOTFOUND", "Element not found",      ZERR_SEV_WARN,  false },
+    { Z_EINVAL,    "Z_EINVAL",    "Invalid argument",       ZERR_SEV_ERROR, false },
+    { Z_EEXIST,    "Z_EEXIST",    "Element already exists", ZERR_SEV_WARN,  false },
+};
+
+bool zerr_domain_register(const zerr_domain *domain)
+{
+    if (NULL == domain || domain->id <= 0 || domain->id >= ZERR_DOMAIN_MAX || domain->count > ZERR_DOMAIN_SPAN)
+    {
+        return false;
+    }
+    unsigned long long want = (unsigned long long)(uintptr_t)domain;
+    unsigned long long seen = 0;
+    while (!ZERROR_ATOMIC_CAS(&zerr__domains[domain->id], &seen, want))
+    {
+        if (0 != seen)
+        {
+            break;
+        }
+    }
+    if (0 == seen || seen == want)
+    {
+        return true;
+    }
+    // A domain defined in a header has one copy per translation unit; any of them will do.
+    return 0 == strcmp(((const zerr_domain *)(uintptr_t)seen)->name, domain->name);
+}
+
+const zerr_code_desc *zerr_code_lookup(int code)
+{
+    if (code <= 0)
+    {
+        unsigned long long row = (unsigned long long)(-(long long)code);
+        return (row < sizeof(zerr__builtin_codes) / sizeof(zerr__builtin_codes[0])) ? &zerr__builtin_codes[row] : NULL;
+    }
+    unsigned id = (unsigned)code / ZERR_DOMAIN_SPAN;
+    if (id >= ZERR_DOMAIN_MAX)
+    {
+        return NULL;
+    }
+    const zerr_domain *d = (const zerr_domain *)(uintptr_t)ZERROR_ATOMIC_LOAD(&zerr__domains[id]);
+    unsigned row = (unsigned)code % ZERR_DOMAIN_SPAN;
+    return (d && row < d->count) ? &d->codes[row] : NULL;
+}
+
+const char *zerr_code_name(int code)
+{
+    const zerr_code_desc *desc = zerr_code_lookup(code);
+    return desc ? desc->name : NULL;
+}
+
+zerr_severity zerr_code_severity(int code)
+{
+    const zerr_code_desc *desc = zerr_code_lookup(code);
+    return desc ? desc->severity : ZERR_SEV_ERROR;
+}
+
+bool zerr_code_retryable(int code)
+{
+    const zerr_code_desc *desc = zerr_code_lookup(code);
+    return desc ? desc->retryable : false;
+}
+
+int zerr_code_domain(int code)
+{
+    return (code > 0) ? code / ZERR_DOMAIN_SPAN : 0;
+}
+
+/*
+ * Error statistics. Counters live in shards; a thread picks one on first use
+ * (round-robin), so threads only share a shard once they outnumber the shards.
+ * A site slot is claimed by a CAS on its tag and published through 'ready';
+ * counters are atomic adds, so a shared shard needs no lock either. Slots are
+ * keyed by the file pointer; snapshots merge sites whose file names match.
+ */
+enum 
+{ 
+    ZERR__STAT_CREATED, 
+    ZERR__STAT_PROPAGATED, 
+    ZERR__STAT_PRINTED, 
+    ZERR__STAT_COUNT 
+};
+
+typedef struct
+{
+    unsigned long long tag;
+    unsigned long long ready;
+    const char *file;
+    int line;
+    int code;
+    unsigned long long count[ZERR__STAT_COUNT];
+} zerr__stat_slot;
+
+static struct
+{
+    zerr__stat_slot slots[ZERROR_STATS_SHARDS][ZERROR_STATS_SITES];
+    unsigned long long next;
+    unsigned long long dropped;
+} zerr__stats;
+
+#if defined(_MSC_VER)
+    static __declspec(thread) unsigned zerr__stats_shard;
+#else
+    static __thread unsigned zerr__stats_shard;
+#endif
+
+#ifdef ZERROR_ENABLE_STATS
+#   define ZERR__STATS_COUNT(e, what) zerr__stats_count((e), (what))
+#else
+#   define ZERR__STATS_COUNT(e, what) ((void)0)
+#endif
+
+static unsigned long long zerr__stats_tag(const char *file, int line, int code)
+{
+    unsigned long long h = (unsigned long long)(uintptr_t)file;
+    h ^= ((unsigned long long)(unsigned)line << 32) ^ (unsigned)code;
+    h *= 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 29;
+    return h | 1;
+}
+
+static zerr__stat_slot *zerr__stats_slot(const char *file, int line, int code)
+{
+    if (0 == zerr__stats_shard)
+    {
+        zerr__stats_shard = (unsigned)(ZERROR_ATOMIC_ADD(&zerr__stats.next, 1) % ZERROR_STATS_SHARDS) + 1;
+    }
+    zerr__stat_slot *shard = zerr__stats.slots[zerr__stats_shard - 1];
+    unsigned long long tag = zerr__stats_tag(file, line, code);
+    for (size_t i = 0; i < ZERROR_STATS_SITES; i++)
+    {
+        zerr__stat_slot *slot = &shard[(tag + i) % ZERROR_STATS_SITES];
+        unsigned long long seen = ZERROR_ATOMIC_LOAD(&slot->tag);
+        if (0 == seen)
+        {
+            while (!ZERROR_ATOMIC_CAS(&slot->tag, &seen, tag) && 0 == seen)
+            {
+            }
+            if (0 == seen)
+            {
+                slot->file = file;
+                slot->line = line;
+                slot->code = code;
+                ZERROR_ATOMIC_STORE(&slot->ready, 1);
+                return slot;
+            }
+        }
+        if (seen == tag)
+        {
+            // A thread sharing the shard may still be filling in the key.
+            while (!ZERROR_ATOMIC_LOAD(&slot->ready))
+            {
+                zlog__yield();
+            }
+            if (slot->file == file && slot->line == line && slot->code == code)
+            {
+                return slot;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void zerr__stats_count(zerr e, int what)
+{
+    zerr__stat_slot *slot = zerr__stats_slot(zerr_file(e), zerr_line(e), e.code);
+    if (slot)
+    {
+        ZERROR_ATOMIC_ADD(&slot->count[what], 1);
+    }
+    else
+    {
+        ZERROR_ATOMIC_ADD(&zerr__stats.dropped, 1);
+    }
+}
+
+static int zerr__stat_cmp(const void *a, const void *b)
+{
+    const zerr_stat *x = (const zerr_stat *)a;
+    const zerr_stat *y = (const zerr_stat *)b;
+    if (x->code != y->code)
+    {
+        return (x->code < y->code) ? -1 : 1;
+    }
+    int c = strcmp(x->file ? x->file : "", y->file ? y->file : "");
+    if (c != 0)
+    {
+        return c;
+    }
+    return (x->line > y->line) - (x->line < y->line);
+}
+
+// Sums the shards into one sorted array, one entry per site (caller frees).
+static zerr_stat *zerr__stats_collect(size_t *count)
+{
+    size_t cap = 0;
+    *count = 0;
+    for (size_t s = 0; s < ZERROR_STATS_SHARDS; s++)
+    {
+        for (size_t i = 0; i < ZERROR_STATS_SITES; i++)
+        {
+            cap += ZERROR_ATOMIC_LOAD(&zerr__stats.slots[s][i].ready) ? 1 : 0;
+        }
+    }
+    if (0 == cap)
+    {
+        return NULL;
+    }
+    zerr_stat *all = (zerr_stat *)Z_MALLOC(cap * sizeof(zerr_stat));
+    if (!all)
+    {
+        return NULL;
+    }
+
+    size_t n = 0;
+    for (size_t s = 0; s < ZERROR_STATS_SHARDS && n < cap; s++)
+    {
+        for (size_t i = 0; i < ZERROR_STATS_SITES && n < cap; i++)
+        {
+            zerr__stat_slot *slot = &zerr__stats.slots[s][i];
+            if (!ZERROR_ATOMIC_LOAD(&slot->ready))
+            {
+                continue;
+            }
+            zerr_stat *st = &all[n++];
+            st->code = slot->code;
+            st->file = slot->file;
+            st->line = slot->line;
+            st->created = ZERROR_ATOMIC_LOAD(&slot->count[ZERR__STAT_CREATED]);
+            st->propagated = ZERROR_ATOMIC_LOAD(&slot->count[ZERR__STAT_PROPAGATED]);
+            st->printed = ZERROR_ATOMIC_LOAD(&slot->count[ZERR__STAT_PRINTED]);
+        }
+    }
+
+    qsort(all, n, sizeof(zerr_stat), zerr__stat_cmp);
+    size_t out = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (out > 0 && 0 == zerr__stat_cmp(&all[out - 1], &all[i]))
+        {
+            all[out - 1].created += all[i].created;
+            all[out - 1].propagated += all[i].propagated;
+            all[out - 1].printed += all[i].printed;
+        }
+        else
+        {
+            all[out++] = all[i];
+        }
+    }
+    *count = out;
+    return all;
+}
+
+zerr zerr_stats_propagate(zerr e)
+{
+    zerr__stats_count(e, ZERR__STAT_PROPAGATED);
+    return e;
+}
+
+size_t zerr_stats_snapshot(zerr_stat *out, size_t max)
+{
+    size_t count;
+    zerr_stat *all = zerr__stats_collect(&count);
+    size_t n = (count < max) ? count : max;
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i] = all[i];
+    }
+    Z_FREE(all);
+    return count;
+}
+
+void zerr_stats_foreach(zerr_stat_fn fn, void *user)
+{
+    size_t count;
+    zerr_stat *all = zerr__stats_collect(&count);
+    for (size_t i = 0; i < count; i++)
+    {
+        fn(&all[i], user);
+    }
+    Z_FREE(all);
+}
+
+void zerr_stats_reset(void)
+{
+    for (size_t s = 0; s < ZERROR_STATS_SHARDS; s++)
+    {
+        for (size_t i = 0; i < ZERROR_STATS_SITES; i++)
+        {
+            for (int k = 0; k < ZERR__STAT_COUNT; k++)
+            {
+                ZERROR_ATOMIC_STORE(&zerr__stats.slots[s][i].count[k], 0);
+            }
+        }
+    }
+    ZERROR_ATOMIC_STORE(&zerr__stats.dropped, 0);
+}
+
+unsigned long long zerr_stats_dropped(void)
+{
+    return ZERROR_ATOMIC_LOAD(&zerr__stats.dropped);
+}
+
+// Appends at 'used' like snprintf would, and returns the length it wanted.
+static size_t zerr__prom_put(char *buf, size_t size, size_t used, const char *fmt, ...) ZERROR_PRINTF(4, 5);
+
+static size_t zerr__prom_put(char *buf, size_t size, size_t used, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = (used < size) ? vsnprintf(buf + used, size - used, fmt, args) : vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    return (n < 0) ? 0 : (size_t)n;
+}
+
+// Escapes a label value (backslash, quote and newline).
+static void zerr__prom_label(const char *s, char *out, size_t size)
+{
+    size_t n = 0;
+    for (; s && *s && n + 3 < size; s++)
+    {
+        if ('\\' == *s || '"' == *s)
+        {
+            out[n++] = '\\';
+            out[n++] = *s;
+        }
+        else if ('\n' == *s)
+        {
+            out[n++] = '\\';
+            out[n++] = 'n';
+        }
+        else
+        {
+            out[n++] = *s;
+        }
+    }
+    out[n] = '\0';
+}
+
+static const char *zerr__stat_metrics[ZERR__STAT_COUNT][2] =
+{
+    { "zerror_errors_created_total",    "Errors created, by code and creation site." },
+    { "zerror_errors_propagated_total", "Frames errors were propagated through, by code and creation site." },
+    { "zerror_errors_printed_total",    "Errors printed with zerr_print, by code and creation site." }
+};
+
+size_t zerr_stats_prometheus(char *buf, size_t size)
+{
+    size_t count;
+    zerr_stat *all = zerr__stats_collect(&count);
+    size_t n = 0;
+    char file[512];
+    if (buf && size > 0)
+    {
+        buf[0] = '\0';
+    }
+    for (int m = 0; m < ZERR__STAT_COUNT; m++)
+    {
+        const char *name = zerr__stat_metrics[m][0];
+        n += zerr__prom_put(buf, size, n, "# HELP %s %s\n# TYPE %s counter\n", name, zerr__stat_metrics[m][1], name);
+        for (size_t i = 0; i < count; i++)
+        {
+            unsigned long long v = (ZERR__STAT_CREATED == m) ? all[i].created 
+                                 : (ZERR__STAT_PROPAGATED == m) ? all[i].propagated : all[i].printed;
+            zerr__prom_label(all[i].file, file, sizeof(file));
+            n += zerr__prom_put(buf, size, n, "%s{code=\"%d\",file=\"%s\",line=\"%d\"} %llu\n", 
+                                name, all[i].code, file, all[i].line, v);
+        }
+    }
+    n += zerr__prom_put(buf, size, n, "# HELP zerror_stats_dropped_total Error events not counted because a stats shard was full.\n"
+                                      "# TYPE zerror_stats_dropped_total counter\n"
+                                      "zerror_stats_dropped_total %llu\n", zerr_stats_dropped());
+    Z_FREE(all);
+    return n;
+}
+
+void zerr_panic(const char *msg, const char *file, int line) 
+{
+    zlog_flight_dump();
+    zlog__emit(ZLOG_FATAL, "PANIC", file, line, "!", NULL, NULL, "%s", msg);
+    zlog_flush();
+    ZERROR_TRAP();
+    ZERROR_PANIC_ACTION();
+}
+
+void zerr_arena_reset(void)
+{
+    zerr__arena_t *a = zerr__arena_get();
+    zerr__arena_newlap(a);
+    // Skip a generation so nothing from the old lap is treated as intact.
+    a->gen++;
+}
+
+void zerr_set_lazy_format(bool enabled)
+{
+    zerr__lazy_enabled = enabled;
+}
+
+// Renders (or fetches the cached rendering of) a deferred message of this thread.
+static const char *zerr__lazy_text(const char *msg, unsigned msg_gen, unsigned *gen)
+{
+    const char *tag = msg - sizeof(unsigned);
+    *gen = 0;
+    if (!zerr__arena_live(tag, msg_gen))
+    {
+        return "(expired error message)";
+    }
+    unsigned n;
+    memcpy(&n, tag, sizeof(n));
+    const char *blob = tag - n;
+    const char *h = blob - sizeof(zerr__lazy_hdr);
+    if (!zerr__arena_live(h, msg_gen))
+    {
+        return "(expired error message)";
+    }
+
+    zerr__lazy_hdr hdr;
+    memcpy(&hdr, h, sizeof(hdr));
+    if (hdr.text && zerr__arena_live(hdr.text, hdr.text_gen))
+    {
+        *gen = hdr.text_gen;
+        return hdr.text;
+    }
+
+    char buf[ZERROR_MSG_MAX];
+    zerr__render(hdr.fmt, (const unsigned char *)blob, n, buf, sizeof(buf));
+    size_t len = strlen(buf);
+    char *text = zerr__arena_reserve(len + 1, gen);
+    memcpy(text, buf, len + 1);
+
+    // Cache it, unless making room for the text recycled the header.
+    if (zerr__arena_live(h, msg_gen))
+    {
+        hdr.text = text;
+        hdr.text_gen = *gen;
+        memcpy((char *)h, &hdr, sizeof(hdr));
+    }
+    return text;
+}
+
+const char *zerr_msg(zerr e)
+{
+    unsigned gen;
+    const char *msg = zerr__msg_of(e, &gen);
+    const char *text = zerr__msg_text(msg, gen);
+    if (text == msg && (gen & ZERROR_GEN_LAZY) && zerr__arena_contains(msg))
+    {
+        unsigned text_gen;
+        return zerr__lazy_text(msg, gen, &text_gen);
+    }
+    return text;
+}
+
+zerr zerr_resolve(zerr e)
+{
+    unsigned gen;
+    const char *msg = zerr__msg_of(e, &gen);
+    if ((gen & ZERROR_GEN_LAZY) && msg && zerr__arena_contains(msg))
+    {
+        msg = zerr__lazy_text(msg, gen, &gen);
+        e = zerr__set_msg(e, msg, gen);
+    }
+    return e;
+}
+
+// The newest error made or propagated on this thread, for crash reports.
+#if defined(_MSC_VER)
+    static __declspec(thread) zerr zerr__last;
+#else
+    static __thread zerr zerr__last;
+#endif
+
+static zerr zerr__note(zerr e)
+{
+    zerr__last = e;
+    return e;
+}
+
+static zerr zerr__vcreate(zerr e, const char *fmt, va_list args)
+{
+    ZERR__STATS_COUNT(e, ZERR__STAT_CREATED);
+    const char *msg;
+    unsigned gen;
+    if (zerr__lazy_enabled)
+    {
+        // Snapshot the arguments; formatting waits until someone reads the text.
+        va_list copy;
+        va_copy(copy, args);
+        bool deferred = zerr__lazy_create(&msg, &gen, fmt, copy);
+        va_end(copy);
+        if (deferred)
+        {
+            return zerr__note(zerr__set_msg(e, msg, gen));
+        }
+    }
+    msg = zerr__arena_vformat(&gen, fmt, args);
+    return zerr__note(zerr__set_msg(e, msg, gen));
+}
+
+static zerr zerr__verrno(zerr e, const char *fmt, va_list args)
+{
+    const char *sys = strerror(errno);
+    ZERR__STATS_COUNT(e, ZERR__STAT_CREATED);
+    unsigned gen;
+    const char *msg = zerr__arena_vformat(&gen, fmt, args);
+
+    char suffix[256];
+    int n = snprintf(suffix, sizeof(suffix), ": %s", sys);
+    size_t slen = (n < 0) ? 0 : ((size_t)n < sizeof(suffix) ? (size_t)n : sizeof(suffix) - 1);
+    msg = zerr__arena_join(msg, strlen(msg), gen, suffix, slen, &gen);
+    return zerr__note(zerr__set_msg(e, msg, gen));
+}
+
+zerr zerr_create_impl(int code, const char *file, int line, const char *func, const char *fmt, ...) 
+{
+    va_list args;
+    va_start(args, fmt);
+    zerr e = zerr__vcreate(zerr__new(code, NULL, file, line, func), fmt, args);
+    va_end(args);
+    return e;
+}
+
+zerr zerr_errno_impl(int code, const char *file, int line, const char *func, const char *fmt, ...) 
+{
+    va_list args;
+    va_start(args, fmt);
+    zerr e = zerr__verrno(zerr__new(code, NULL, file, line, func), fmt, args);
+    va_end(args);
+    return e;
+}
+
+#ifdef ZERROR_COMPACT
+zerr zerr_create_at(int code, const zerr_site *site, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    zerr e = zerr__vcreate(zerr__new(code, site, NULL, 0, NULL), fmt, args);
+    va_end(args);
+    return e;
+}
+
+zerr zerr_errno_at(int code, const zerr_site *site, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    zerr e = zerr__verrno(zerr__new(code, site, NULL, 0, NULL), fmt, args);
+    va_end(args);
+    return e;
+}
+#endif
+
+zerr zerr_add_trace(zerr e, const char *func, const char *file, int line) 
+{
+    return zerr__note(zerr__push_frame(e, func, file, line));
+}
+
+int zerr_trace(zerr e, zerr_frame *out, int max)
+{
+    zerr_frame frames[ZERROR_TRACE_MAX];
+    int count = zerr__frames_of(e, frames, ZERROR_TRACE_MAX);
+    // Walked newest first; hand them back in propagation order.
+    int n = (count < max) ? count : max;
+    for (int i = 0; i < n; i++)
+    {
+        out[i] = frames[count - 1 - i];
+    }
+    return n;
+}
+
+/*
+ * Cause pool: a per-thread ring of wrapped errors. zerr_wrap parks the inner
+ * error in a slot and links the new outer error to it, so a layer costs one
+ * struct copy whatever the length of the chain. A cause whose slot was reused
+ * (or that came from another thread) reads as expired, but keeps its code.
+ */
+typedef struct
+{
+    unsigned next;
+    struct
+    {
+        unsigned id;
+        zerr err;
+    } slots[ZERROR_CAUSE_POOL];
+} zerr__cause_pool_t;
+
+#if defined(_MSC_VER)
+    static __declspec(thread) zerr__cause_pool_t zerr__causes;
+#else
+    static __thread zerr__cause_pool_t zerr__causes;
+#endif
+
+static unsigned zerr__park_cause(zerr inner)
+{
+    unsigned id = zerr__pool_id(&zerr__causes.next);
+    zerr__causes.slots[id % ZERROR_CAUSE_POOL].id = id;
+    zerr__causes.slots[id % ZERROR_CAUSE_POOL].err = inner;
+    return id;
+}
+
+// Gives 'outer' its message and links it to 'inner', parked as its cause.
+static zerr zerr__vlink(zerr outer, zerr inner, const char *fmt, va_list args)
+{
+    unsigned cause = zerr__park_cause(inner);
+    unsigned gen;
+#ifdef ZERROR_COMPACT
+    outer = zerr__set_cause(outer, cause, inner.code);
+    const char *msg = zerr__arena_vformat(&gen, fmt, args);
+#else
+    zerr__cause_hdr link = { cause, inner.code };
+    char *msg = zerr__arena_vformat_after(sizeof(link), &gen, fmt, args);
+    memcpy(msg - sizeof(link), &link, sizeof(link));
+    gen |= ZERROR_GEN_CAUSE;
+#endif
+    return zerr__set_msg(outer, msg, gen);
+}
+
+static zerr zerr__link(zerr outer, zerr inner, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    outer = zerr__vlink(outer, inner, fmt, args);
+    va_end(args);
+    return outer;
+}
+
+static zerr zerr__vwrap(zerr outer, zerr inner, const char *fmt, va_list args)
+{
+    return zerr__note(zerr__vlink(outer, inner, fmt, args));
+}
+
+zerr zerr_wrap_impl(zerr e, int code, const char *file, int line, const char *func, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    zerr w = zerr__vwrap(zerr__new(code ? code : e.code, NULL, file, line, func), e, fmt, args);
+    va_end(args);
+    return w;
+}
+
+#ifdef ZERROR_COMPACT
+zerr zerr_wrap_at(zerr e, int code, const zerr_site *site, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    zerr w = zerr__vwrap(zerr__new(code ? code : e.code, site, NULL, 0, NULL), e, fmt, args);
+    va_end(args);
+    return w;
+}
+#endif
+
+// The error 'e' wraps, or a placeholder with its code if the slot was reused.
+static bool zerr__cause_get(zerr e, zerr *out)
+{
+    unsigned id;
+    int code;
+    if (!zerr__cause_of(e, &id, &code))
+    {
+        return false;
+    }
+    if (zerr__causes.slots[id % ZERROR_CAUSE_POOL].id == id)
+    {
+        *out = zerr__causes.slots[id % ZERROR_CAUSE_POOL].err;
+        return true;
+    }
+    zerr c = zerr__new(code, NULL, "(unknown)", 0, "(unknown)");
+    *out = zerr__set_msg(c, "(expired error cause)", 0);
+    return true;
+}
+
+zerr zerr_cause(zerr e)
+{
+    zerr c = ZERROR_NO_ERROR;
+    zerr__cause_get(e, &c);
+    return c;
+}
+
+zerr zerr_root_cause(zerr e)
+{
+    // Causes are always older than their wrapper, so a walk cannot loop; the bound is belt and braces.
+    for (int depth = 0; depth < ZERROR_CAUSE_POOL && zerr__cause_get(e, &e); depth++)
+    {
+    }
+    return e;
+}
+
+bool zerr_find_code(zerr e, int code, zerr *out)
+{
+    for (int depth = 0; depth <= ZERROR_CAUSE_POOL; depth++)
+    {
+        if (e.code == code)
+        {
+            if (out)
+            {
+                *out = e;
+            }
+            return true;
+        }
+        if (!zerr__cause_get(e, &e))
+        {
+            break;
+        }
+    }
+    return false;
+}
+
+size_t zerr_chain_text(zerr e, char *buf, size_t size)
+{
+    size_t used = 0;
+    for (int depth = 0; depth <= ZERROR_CAUSE_POOL; depth++)
+    {
+        int n = (used < size) ? snprintf(buf + used, size - used, "%s%s", depth ? ": " : "", zerr_msg(e))
+                              : snprintf(NULL, 0, "%s%s", depth ? ": " : "", zerr_msg(e));
+        used += (n < 0) ? 0 : (size_t)n;
+        if (!zerr__cause_get(e, &e))
+        {
+            break;
+        }
+    }
+    return used;
+}
+
+// Appends the code name, trace and source expression of one layer to a zerr_print report.
+static size_t zerr__print_layer(char *buf, size_t size, size_t used, zerr e, const char *indent)
+{
+    const char *name = zerr_code_name(e.code);
+    if (name && used < size)
+    {
+        int n = snprintf(buf + used, size - used, "\n%s[Code] %s (%d)", indent, name, e.code);
+        used += (n < 0) ? 0 : (size_t)n;
+    }
+
+    // Render the logical trace only now that someone needs the text.
+    zerr_frame frames[ZERROR_TRACE_MAX];
+    int depth = zerr_trace(e, frames, ZERROR_TRACE_MAX);
+    for (int i = 0; i < depth && used < size; i++)
+    {
+        int n = snprintf(buf + used, size - used, "\n%sat %s (%s:%d)", 
+                         indent, frames[i].func, frames[i].file, frames[i].line);
+        used += (n < 0) ? 0 : (size_t)n;
+    }
+    const char *source = zerr_source(e);
+    if (source && used < size) 
+    {
+        int n = snprintf(buf + used, size - used, "\n%s[Expr] %s", indent, source);
+        used += (n < 0) ? 0 : (size_t)n;
+    }
+    return used;
+}
+
+void zerr_print(zerr e) 
+{
+    ZERR__STATS_COUNT(e, ZERR__STAT_PRINTED);
+    zlog_flight_dump();
+
+    char extra_buf[ZERROR_MSG_MAX] = {0};
+    size_t used = zerr__print_layer(extra_buf, sizeof(extra_buf), 0, e, "    ");
+
+    // The whole cause chain, once, after the outermost layer.
+    zerr c = e;
+    for (int depth = 0; depth < ZERROR_CAUSE_POOL && used < sizeof(extra_buf) && zerr__cause_get(c, &c); depth++)
+    {
+        int n = snprintf(extra_buf + used, sizeof(extra_buf) - used, "\n    Caused by: [%d] %s\n        at %s (%s:%d)",
+                         c.code, zerr_msg(c), zerr_func(c), zerr_file(c), zerr_line(c));
+        used += (n < 0) ? 0 : (size_t)n;
+        used = zerr__print_layer(extra_buf, sizeof(extra_buf), used, c, "        ");
+    }
+
+    // Structured layouts get the error as fields; the text layouts already show it.
+    const char *name = zerr_code_name(e.code);
+    const char *source = zerr_source(e);
+    zkv fields[4];
+    size_t count = 0;
+    fields[count++] = zkv_int("code", e.code);
+    if (name)
+    {
+        fields[count++] = zkv_str("name", name);
+    }
+    if (source)
+    {
+        fields[count++] = zkv_str("source", source);
+    }
+    zerr root = zerr_root_cause(e);
+    if (root.code != e.code)
+    {
+        fields[count++] = zkv_int("root_code", root.code);
+    }
+    zlog__fields kv = { fields, count, false };
+    zlog__emit(ZLOG_ERROR, "Error", zerr_file(e), zerr_line(e), zerr_func(e), extra_buf, &kv, "%s", zerr_msg(e));
+}
+
+/*
+ * Ref pool: a per-thread ring of parked errors for slim results. A handle
+ * whose slot was reused (or that came from another thread) reads as expired,
+ * but keeps its code.
+ */
+typedef struct
+{
+    unsigned next;
+    struct
+    {
+        unsigned id;
+        zerr err;
+    } slots[ZERROR_REF_POOL];
+} zerr__ref_pool_t;
+
+#if defined(_MSC_VER)
+    static __declspec(thread) zerr__ref_pool_t zerr__refs;
+#else
+    static __thread zerr__ref_pool_t zerr__refs;
+#endif
+
+zerr_ref zerr_ref_new(zerr e)
+{
+    zerr_ref r;
+    r.code = e.code;
+    r.id = zerr__pool_id(&zerr__refs.next);
+    zerr__refs.slots[r.id % ZERROR_REF_POOL].id = r.id;
+    zerr__refs.slots[r.id % ZERROR_REF_POOL].err = e;
+    return r;
+}
+
+zerr zerr_ref_get(zerr_ref r)
+{
+    if (0 != r.id && zerr__refs.slots[r.id % ZERROR_REF_POOL].id == r.id)
+    {
+        return zerr__refs.slots[r.id % ZERROR_REF_POOL].err;
+    }
+    zerr e = zerr__new(r.code, NULL, "(unknown)", 0, "(unknown)");
+    return zerr__set_msg(e, "(expired error message)", 0);
+}
+
+zerr_ref zerr_ref_set(zerr_ref r, zerr e)
+{
+    if (0 == r.id || zerr__refs.slots[r.id % ZERROR_REF_POOL].id != r.id)
+    {
+        return zerr_ref_new(e);
+    }
+    zerr__refs.slots[r.id % ZERROR_REF_POOL].err = e;
+    r.code = e.code;
+    return r;
+}
+
+/*
+ * Owned error pool. Blocks come in power-of-two size classes. Each thread keeps
+ * a free list per class of up to ZERROR_POOL_CACHE blocks. A dry cache takes
+ * half a cache from the global list, and a full one hands half a cache back,
+ * so the global lock is taken once per batch, not once per error. A block
+ * freed on another thread simply joins that thread's cache. The global lists
+ * hold at most ZERROR_POOL_GLOBAL blocks per class, and Z_MALLOC is refused
+ * once ZERROR_POOL_LIMIT bytes are held, so an error storm cannot grow the heap
+ * without bound. An exiting thread's cache goes to the global lists (POSIX;
+ * elsewhere call zerr_pool_trim). Counters are only touched on slow paths.
+ */
+#if ZERROR_POOL_CACHE < 1
+#   error "ZERROR_POOL_CACHE must be at least 1."
+#endif
+
+#define ZERR__POOL_MIN 128
+#define ZERR__POOL_BATCH ((ZERROR_POOL_CACHE + 1) / 2)
+
+typedef struct
+{
+    void *head;         // Free blocks, linked through their first word.
+    unsigned count;
+} zerr__pool_list;
+
+static struct
+{
+    unsigned long long lock;
+    zerr__pool_list lists[ZERR_POOL_CLASSES];
+    unsigned long long reserved[ZERR_POOL_CLASSES];
+    unsigned long long peak[ZERR_POOL_CLASSES];
+    unsigned long long bytes;
+    unsigned long long peak_bytes;
+    unsigned long long sys_allocs;
+    unsigned long long sys_frees;
+    unsigned long long refills;
+    unsigned long long spills;
+    unsigned long long oversize;
+    unsigned long long denied;
+} zerr__pool;
+
+#if defined(_MSC_VER)
+    static __declspec(thread) zerr__pool_list zerr__pool_cache[ZERR_POOL_CLASSES];
+    static __declspec(thread) bool zerr__pool_watched;
+#else
+    static __thread zerr__pool_list zerr__pool_cache[ZERR_POOL_CLASSES];
+    static __thread bool zerr__pool_watched;
+#endif
+
+static void zerr__pool_lock(void)
+{
+    unsigned long long expected = 0;
+    while (!ZERROR_ATOMIC_CAS(&zerr__pool.lock, &expected, 1ULL))
+    {
+        expected = 0;
+        zlog__yield();
+    }
+}
+
+static void zerr__pool_unlock(void)
+{
+    ZERROR_ATOMIC_STORE(&zerr__pool.lock, 0ULL);
+}
+
+static void *zerr__pool_pop(zerr__pool_list *list)
+{
+    void *p = list->head;
+    if (p)
+    {
+        list->head = *(void **)p;
+        list->count--;
+    }
+    return p;
+}
+
+static void zerr__pool_push(zerr__pool_list *list, void *p)
+{
+    *(void **)p = list->head;
+    list->head = p;
+    list->count++;
+}
+
+// The class whose blocks fit 'size' bytes, or ZERR_POOL_CLASSES if none does.
+static int zerr__pool_class_of(size_t size)
+{
+    int c = 0;
+    while (c < ZERR_POOL_CLASSES && ((size_t)ZERR__POOL_MIN << c) < size)
+    {
+        c++;
+    }
+    return c;
+}
+
+static void zerr__pool_raise(unsigned long long *peak, unsigned long long now)
+{
+    unsigned long long seen = ZERROR_ATOMIC_LOAD(peak);
+    while (now > seen && !ZERROR_ATOMIC_CAS(peak, &seen, now))
+    {
+    }
+}
+
+// 'size' bytes from Z_MALLOC, unless holding them would pass ZERROR_POOL_LIMIT.
+static void *zerr__pool_sys_alloc(size_t size)
+{
+    unsigned long long now = ZERROR_ATOMIC_ADD(&zerr__pool.bytes, (unsigned long long)size) + size;
+    void *p = NULL;
+    if (ZERROR_POOL_LIMIT && now > (unsigned long long)ZERROR_POOL_LIMIT)
+    {
+        ZERROR_ATOMIC_ADD(&zerr__pool.denied, 1ULL);
+    }
+    else
+    {
+        p = Z_MALLOC(size);
+    }
+    if (!p)
+    {
+        ZERROR_ATOMIC_ADD(&zerr__pool.bytes, 0ULL - size);
+        return NULL;
+    }
+    ZERROR_ATOMIC_ADD(&zerr__pool.sys_allocs, 1ULL);
+    zerr__pool_raise(&zerr__pool.peak_bytes, now);
+    return p;
+}
+
+static void zerr__pool_sys_free(void *p, size_t size)
+{
+    Z_FREE(p);
+    ZERROR_ATOMIC_ADD(&zerr__pool.bytes, 0ULL - size);
+    ZERROR_ATOMIC_ADD(&zerr__pool.sys_frees, 1ULL);
+}
+
+// Gives a block of class 'c' back to Z_FREE.
+static void zerr__pool_release(int c, void *p)
+{
+    zerr__pool_sys_free(p, (size_t)ZERR__POOL_MIN << c);
+    ZERROR_ATOMIC_ADD(&zerr__pool.reserved[c], 0ULL - 1);
+}
+
+static void zerr__pool_refill(int c, zerr__pool_list *cache)
+{
+    unsigned n = 0;
+    zerr__pool_lock();
+    for (void *p; n < ZERR__POOL_BATCH && NULL != (p = zerr__pool_pop(&zerr__pool.lists[c])); n++)
+    {
+        zerr__pool_push(cache, p);
+    }
+    zerr__pool_unlock();
+    if (n)
+    {
+        ZERROR_ATOMIC_ADD(&zerr__pool.refills, 1ULL);
+    }
+}
+
+// Moves up to 'count' cached blocks to the global list; blocks it has no room for go to Z_FREE.
+static void zerr__pool_spill(int c, zerr__pool_list *cache, unsigned count)
+{
+    zerr__pool_list drop = { NULL, 0 };
+    zerr__pool_lock();
+    for (unsigned n = 0; n < count && cache->head; n++)
+    {
+        void *p = zerr__pool_pop(cache);
+        zerr__pool_push(zerr__pool.lists[c].count < ZERROR_POOL_GLOBAL ? &zerr__pool.lists[c] : &drop, p);
+    }
+    zerr__pool_unlock();
+    ZERROR_ATOMIC_ADD(&zerr__pool.spills, 1ULL);
+    for (void *p; NULL != (p = zerr__pool_pop(&drop)); )
+    {
+        zerr__pool_release(c, p);
+    }
+}
+
+static void zerr__pool_flush(void)
+{
+    for (int c = 0; c < ZERR_POOL_CLASSES; c++)
+    {
+        if (zerr__pool_cache[c].head)
+        {
+            zerr__pool_spill(c, &zerr__pool_cache[c], zerr__pool_cache[c].count);
+        }
+    }
+}
+
+#if !defined(_WIN32)
+static pthread_key_t zerr__pool_key;
+static pthread_once_t zerr__pool_once = PTHREAD_ONCE_INIT;
+
+static void zerr__pool_exit(void *unused)
+{
+    (void)unused;
+    zerr__pool_flush();
+}
+
+static void zerr__pool_key_init(void)
+{
+    pthread_key_create(&zerr__pool_key, zerr__pool_exit);
+}
+#endif
+
+// Called before a thread first caches a block, so its cache is flushed when it exits.
+static void zerr__pool_watch(void)
+{
+    zerr__pool_watched = true;
+#if !defined(_WIN32)
+    pthread_once(&zerr__pool_once, zerr__pool_key_init);
+    pthread_setspecific(zerr__pool_key, &zerr__pool_watched);
+#endif
+}
+
+static void *zerr__pool_alloc(size_t size)
+{
+    int c = zerr__pool_class_of(size);
+    if (ZERR_POOL_CLASSES == c)
+    {
+        ZERROR_ATOMIC_ADD(&zerr__pool.oversize, 1ULL);
+        return zerr__pool_sys_alloc(size);
+    }
+    zerr__pool_list *cache = &zerr__pool_cache[c];
+    if (!cache->head)
+    {
+        if (!zerr__pool_watched)
+        {
+            zerr__pool_watch();
+        }
+        zerr__pool_refill(c, cache);
+    }
+    void *p = zerr__pool_pop(cache);
+    if (!p && NULL != (p = zerr__pool_sys_alloc((size_t)ZERR__POOL_MIN << c)))
+    {
+        unsigned long long now = ZERROR_ATOMIC_ADD(&zerr__pool.reserved[c], 1ULL) + 1;
+        zerr__pool_raise(&zerr__pool.peak[c], now);
+    }
+    return p;
+}
+
+static void zerr__pool_free(void *p, size_t size)
+{
+    int c = zerr__pool_class_of(size);
+    if (ZERR_POOL_CLASSES == c)
+    {
+        zerr__pool_sys_free(p, size);
+        return;
+    }
+    zerr__pool_list *cache = &zerr__pool_cache[c];
+    if (!zerr__pool_watched)
+    {
+        zerr__pool_watch();
+    }
+    if (cache->count >= ZERROR_POOL_CACHE)
+    {
+        zerr__pool_spill(c, cache, ZERR__POOL_BATCH);
+    }
+    zerr__pool_push(cache, p);
+}
+
+void zerr_pool_trim(void)
+{
+    zerr__pool_flush();
+    for (int c = 0; c < ZERR_POOL_CLASSES; c++)
+    {
+        zerr__pool_lock();
+        zerr__pool_list idle = zerr__pool.lists[c];
+        zerr__pool.lists[c].head = NULL;
+        zerr__pool.lists[c].count = 0;
+        zerr__pool_unlock();
+        for (void *p; NULL != (p = zerr__pool_pop(&idle)); )
+        {
+            zerr__pool_release(c, p);
+        }
+    }
+}
+
+void zerr_pool_stats(zerr_pool_stat *out)
+{
+    if (!out)
+    {
+        return;
+    }
+    memset(out, 0, sizeof(*out));
+    out->reserved_bytes = ZERROR_ATOMIC_LOAD(&zerr__pool.bytes);
+    out->peak_bytes = ZERROR_ATOMIC_LOAD(&zerr__pool.peak_bytes);
+    out->limit_bytes = (unsigned long long)ZERROR_POOL_LIMIT;
+    out->sys_allocs = ZERROR_ATOMIC_LOAD(&zerr__pool.sys_allocs);
+    out->sys_frees = ZERROR_ATOMIC_LOAD(&zerr__pool.sys_frees);
+    out->refills = ZERROR_ATOMIC_LOAD(&zerr__pool.refills);
+    out->spills = ZERROR_ATOMIC_LOAD(&zerr__pool.spills);
+    out->oversize = ZERROR_ATOMIC_LOAD(&zerr__pool.oversize);
+    out->denied = ZERROR_ATOMIC_LOAD(&zerr__pool.denied);
+    zerr__pool_lock();
+    for (int c = 0; c < ZERR_POOL_CLASSES; c++)
+    {
+        out->classes[c].size = (size_t)ZERR__POOL_MIN << c;
+        out->classes[c].reserved = ZERROR_ATOMIC_LOAD(&zerr__pool.reserved[c]);
+        out->classes[c].peak = ZERROR_ATOMIC_LOAD(&zerr__pool.peak[c]);
+        out->classes[c].idle = zerr__pool.lists[c].count;
+    }
+    zerr__pool_unlock();
+}
+
+/*
+ * Owned errors: a header, then one layer per error of the chain (outermost
+ * first), then every layer's frames (oldest first), then the message text.
+ * Files, functions and source expressions are string literals, so only the
+ * messages are copied. Rebuilding walks the layers innermost first and pushes
+ * into the calling thread's pools.
+ */
+typedef struct
+{
+    int code;
+    int line;
+    const char *msg;
+    const char *file;
+    const char *func;
+    const char *source;
+    unsigned first;     // Index of the layer's oldest frame.
+    unsigned frames;
+} zerr__owned_layer;
+
+struct zerr_owned
+{
+    size_t size;        // Bytes in the block.
+    unsigned layers;    // Layers filled, at most 'slots'.
+    unsigned slots;     // Layer slots measured; the frames follow them.
+};
+
+typedef struct
+{
+    unsigned layers;
+    unsigned frames;
+    size_t text;
+} zerr__owned_shape;
+
+static size_t zerr__owned_measure(zerr e, zerr__owned_shape *shape)
+{
+    zerr_frame frames[ZERROR_TRACE_MAX];
+    shape->layers = 0;
+    shape->frames = 0;
+    shape->text = 0;
+    for (int depth = 0; depth <= ZERROR_CAUSE_POOL; depth++)
+    {
+        shape->layers++;
+        shape->frames += (unsigned)zerr_trace(e, frames, ZERROR_TRACE_MAX);
+        shape->text += strlen(zerr_msg(e)) + 1;
+        if (!zerr__cause_get(e, &e))
+        {
+            break;
+        }
+    }
+    return sizeof(zerr_owned) + shape->layers * sizeof(zerr__owned_layer) + 
+           shape->frames * sizeof(zerr_frame) + shape->text;
+}
 
-        result(::zres r) : is_ok_(r.is_ok), err_(r.err), err(r.err) {}
+size_t zerr_clone_size(zerr e)
+{
+    zerr__owned_shape shape;
+    return zerr__owned_measure(e, &shape);
+}
 
-        static result<void> success() 
-        { 
-            return result<void>(); 
-        }
+static zerr_owned *zerr__owned_fill(zerr e, const zerr__owned_shape *shape, void *mem, size_t size)
+{
+    zerr_owned *o = (zerr_owned *)mem;
+    zerr__owned_layer *layers = (zerr__owned_layer *)(o + 1);
+    zerr_frame *frames = (zerr_frame *)(layers + shape->layers);
+    char *text = (char *)(frames + shape->frames);
+    const char *end = (const char *)mem + size;
+    o->size = size;
+    o->layers = 0;
+    o->slots = shape->layers;
 
-        bool ok() const 
-        { 
-            return is_ok_; 
+    // Second walk of the chain. A deferred message or a compact body can expire
+    // between the walks, so nothing is written past what the first one measured.
+    unsigned first = 0;
+    for (unsigned i = 0; i < shape->layers; i++)
+    {
+        zerr__owned_layer *l = &layers[i];
+        const char *msg = zerr_msg(e);
+        size_t len = strlen(msg);
+        size_t room = (size_t)(end - text) - (shape->layers - 1 - i);
+        if (len >= room)
+        {
+            len = room - 1;
         }
-
-        operator bool() const 
-        { 
-            return is_ok_; 
+        memcpy(text, msg, len);
+        text[len] = '\0';
+        l->code = e.code;
+        l->line = zerr_line(e);
+        l->msg = text;
+        l->file = zerr_file(e);
+        l->func = zerr_func(e);
+        l->source = zerr_source(e);
+        l->first = first;
+        l->frames = (unsigned)zerr_trace(e, frames + first, (int)(shape->frames - first));
+        first += l->frames;
+        text += len + 1;
+        o->layers++;
+        if (!zerr__cause_get(e, &e))
+        {
+            break;
         }
+    }
+    return o;
+}
 
-        void unwrap_val() 
-        { 
-            if (!is_ok_) 
-            { 
-                ::zerr_print(err_);
-                abort(); 
-            } 
-        }
-    };
-    
-    template <typename T> inline result<T> from_c_res(T val) 
-    { 
-        return result<T>(val); 
+zerr_owned *zerr_clone_into(zerr e, void *mem, size_t size)
+{
+    zerr__owned_shape shape;
+    size_t need = zerr__owned_measure(e, &shape);
+    if (!mem || size < need)
+    {
+        return NULL;
     }
+    return zerr__owned_fill(e, &shape, mem, need);
 }
 
-#if defined(ZERROR_SHORT_NAMES) && (defined(__GNUC__) || defined(__clang__))
-#   define ztry(expr) ({ auto _r = (expr); if (!_r.ok()) return _r.err; std::move(_r.unwrap_val()); })
-#endif
+zerr_owned *zerr_clone(zerr e)
+{
+    zerr__owned_shape shape;
+    size_t need = zerr__owned_measure(e, &shape);
+    void *mem = zerr__pool_alloc(need);
+    if (!mem)
+    {
+        return NULL;
+    }
+    return zerr__owned_fill(e, &shape, mem, need);
+}
 
-#endif // __cplusplus
+void zerr_free(zerr_owned *o)
+{
+    if (o)
+    {
+        zerr__pool_free(o, o->size);
+    }
+}
 
-#endif // ZERROR_H
+int zerr_owned_code(const zerr_owned *o)
+{
+    return o ? ((const zerr__owned_layer *)(o + 1))->code : 0;
+}
 
-#ifdef ZERROR_IMPLEMENTATION
-#ifndef ZERROR_IMPLEMENTATION_GUARD
-#define ZERROR_IMPLEMENTATION_GUARD
+const char *zerr_owned_msg(const zerr_owned *o)
+{
+    return o ? ((const zerr__owned_layer *)(o + 1))->msg : NULL;
+}
 
-#include <time.h> 
+zerr zerr_owned_get(const zerr_owned *o)
+{
+    zerr e = ZERROR_NO_ERROR;
+    if (!o)
+    {
+        return e;
+    }
+    const zerr__owned_layer *layers = (const zerr__owned_layer *)(o + 1);
+    const zerr_frame *frames = (const zerr_frame *)(layers + o->slots);
+    for (unsigned i = o->layers; i-- > 0; )
+    {
+        const zerr__owned_layer *l = &layers[i];
+        zerr outer = zerr__new(l->code, NULL, l->file, l->line, l->func);
+        for (unsigned f = 0; f < l->frames; f++)
+        {
+            const zerr_frame *fr = &frames[l->first + f];
+            outer = zerr__push_frame(outer, fr->func, fr->file, fr->line);
+        }
+        if (l->source)
+        {
+            outer = zerr_with_src(outer, l->source);
+        }
+        // A wrapping layer's message carries its cause link, so it goes into the arena.
+        e = (i + 1 < o->layers) ? zerr__link(outer, e, "%s", l->msg) : zerr__set_msg(outer, l->msg, 0);
+    }
+    return e;
+}
 
+/*
+ * Crash reports. Everything reachable from the handler is async-signal-safe:
+ * output goes straight to write(2), numbers are formatted by hand, and the ring
+ * sink and error pools are read in place, without zlog__state.mutex (a thread
+ * may have died holding it). A lazy message shows its format string.
+ */
 #if defined(_WIN32)
-#   define WIN32_LEAN_AND_MEAN
-#   include <windows.h>
-#else
-#   include <pthread.h>
-#   include <sys/time.h>
-#   include <unistd.h>
-#endif
 
-static struct 
+bool zerr_crash_install(const zerr_crash_config *cfg)
 {
-    FILE *fp;
-    zlog_level level;
-    bool colors;
-    bool init;
-#   if defined(_WIN32)
-    CRITICAL_SECTION mutex;
-#   else
-    pthread_mutex_t mutex;
-#   endif
-#   pragma GCC diagnostic push
-#   pragma GCC diagnostic ignored "-Wmissing-field-initializers"
-} zlog__state = { NULL, ZLOG_INFO, true, false };
-#pragma GCC diagnostic pop
+    (void)cfg;
+    return false;
+}
 
-static const char *zlog__colors[] = 
+void zerr_crash_uninstall(void)
 {
-    "\x1b[94m", 
-    "\x1b[36m", 
-    "\x1b[32m", 
-    "\x1b[33m", 
-    "\x1b[31m", 
-    "\x1b[35m"
-};
+}
 
-static const char *zlog__labels[] = 
-{ 
-    "TRACE", 
-    "DEBUG", 
-    "INFO ", 
-    "WARN ", 
-    "ERROR", 
-    "FATAL" 
-};
+void zerr_crash_report(int fd)
+{
+    (void)fd;
+}
 
-#if defined(_MSC_VER)
-    static __declspec(thread) char z_err_buf[2048];
 #else
-    static __thread char z_err_buf[2048];
+
+static const int zerr__crash_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+#define ZERR__CRASH_SIGNALS (int)(sizeof(zerr__crash_signals) / sizeof(zerr__crash_signals[0]))
+
+#ifndef ZERROR_CRASH_STACK
+#   define ZERROR_CRASH_STACK 65536
 #endif
 
-// Helpers.
-static void zlog__init_mutex(void) 
+static struct
 {
-    if (zlog__state.init) 
+    zerr_crash_config cfg;
+    bool installed;
+    unsigned long long busy;
+    struct sigaction old[ZERR__CRASH_SIGNALS];
+} zerr__crash;
+
+#ifdef SA_ONSTACK
+// Lets the handler run after a stack overflow (installing thread only; needs XSI signals).
+static char zerr__crash_stack[ZERROR_CRASH_STACK];
+#endif
+
+static void zerr__crash_put(int fd, const char *s, size_t n)
+{
+    while (n > 0)
     {
-        return;
+        ssize_t w = write(fd, s, n);
+        if (w <= 0)
+        {
+            if (w < 0 && EINTR == errno)
+            {
+                continue;
+            }
+            return;
+        }
+        s += w;
+        n -= (size_t)w;
     }
-#   if defined(_WIN32)
-    InitializeCriticalSection(&zlog__state.mutex);
-    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-    DWORD dwMode = 0;
-    GetConsoleMode(hOut, &dwMode);
-    SetConsoleMode(hOut, dwMode | 0x0004);
-#   else
-    pthread_mutex_init(&zlog__state.mutex, NULL);
-#   endif
-    zlog__state.init = true;
 }
 
-static void zlog__lock(void) 
+static void zerr__crash_str(int fd, const char *s)
 {
-    if (!zlog__state.init) 
-    {
-        zlog__init_mutex();
-    }
-#   if defined(_WIN32)
-    EnterCriticalSection(&zlog__state.mutex);
-#   else
-    pthread_mutex_lock(&zlog__state.mutex);
-#   endif
+    s = s ? s : "(null)";
+    zerr__crash_put(fd, s, strlen(s));
 }
 
-static void zlog__unlock(void) 
+static void zerr__crash_num(int fd, unsigned long long v, unsigned base)
 {
-    if (!zlog__state.init) 
+    char buf[24];
+    size_t at = sizeof(buf);
+    do
     {
-        return;
+        buf[--at] = "0123456789abcdef"[v % base];
+        v /= base;
+    } while (v > 0);
+    if (16 == base)
+    {
+        buf[--at] = 'x';
+        buf[--at] = '0';
     }
-#   if defined(_WIN32)
-    LeaveCriticalSection(&zlog__state.mutex);
-#   else
-    pthread_mutex_unlock(&zlog__state.mutex);
-#   endif
+    zerr__crash_put(fd, buf + at, sizeof(buf) - at);
 }
 
-static void zlog__get_time(char *buf, size_t size) 
+static void zerr__crash_at(int fd, const char *prefix, const char *func, const char *file, int line)
 {
-#   if defined(ZTIME_H)
-    ztime_fmt_now(buf, size);
-#   else
-    time_t t = time(NULL);
-    struct tm tm;
-    memset(&tm, 0, sizeof(tm));
+    zerr__crash_str(fd, prefix);
+    zerr__crash_str(fd, func);
+    zerr__crash_str(fd, " (");
+    zerr__crash_str(fd, file);
+    zerr__crash_str(fd, ":");
+    zerr__crash_num(fd, (unsigned long long)(line < 0 ? 0 : line), 10);
+    zerr__crash_str(fd, ")\n");
+}
 
-#   ifdef _WIN32
-    localtime_s(&tm, &t);
-#   else
-    struct tm *ptr = localtime(&t);
-    if (ptr) 
+static const char *zerr__crash_signame(int sig)
+{
+    switch (sig)
     {
-        tm = *ptr;
+        case SIGSEGV: return "SIGSEGV";
+        case SIGBUS:  return "SIGBUS";
+        case SIGFPE:  return "SIGFPE";
+        case SIGILL:  return "SIGILL";
+        case SIGABRT: return "SIGABRT";
+        default:      return "signal";
     }
-#   endif
-    strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm);
-#endif
 }
 
-void zlog_init(const char *file_path, zlog_level min_level) 
+static void zerr__crash_error(int fd, zerr e)
 {
-    zlog__init_mutex();
-    zlog__state.level = min_level;
-    if (file_path) 
+    if (0 == e.code && !zerr_source(e))
+    {
+        zerr__crash_str(fd, "  (none)\n");
+        return;
+    }
+    unsigned gen;
+    const char *msg = zerr__msg_of(e, &gen);
+    zerr__crash_str(fd, "  [");
+    zerr__crash_num(fd, (unsigned long long)(unsigned)e.code, 10);
+    const char *name = zerr_code_name(e.code);
+    if (name)
+    {
+        zerr__crash_str(fd, " ");
+        zerr__crash_str(fd, name);
+    }
+    zerr__crash_str(fd, "] ");
+    zerr__crash_str(fd, zerr__msg_text(msg, gen));
+    zerr__crash_str(fd, "\n");
+    zerr__crash_at(fd, "    at ", zerr_func(e), zerr_file(e), zerr_line(e));
+
+    zerr_frame frames[ZERROR_TRACE_MAX];
+    int count = zerr__frames_of(e, frames, ZERROR_TRACE_MAX);
+    for (int i = count - 1; i >= 0; i--)
     {
-        zlog__state.fp = fopen(file_path, "a");
+        zerr__crash_at(fd, "    from ", frames[i].func, frames[i].file, frames[i].line);
+    }
+    if (zerr_source(e))
+    {
+        zerr__crash_str(fd, "    [Expr] ");
+        zerr__crash_str(fd, zerr_source(e));
+        zerr__crash_str(fd, "\n");
     }
 }
 
-void zlog_set_level(zlog_level level) 
-{ 
-    zlog__state.level = level; 
+// The last error and, innermost last, the errors it wraps.
+static void zerr__crash_chain(int fd)
+{
+    zerr__crash_error(fd, zerr__last);
+    zerr c = zerr__last;
+    unsigned id;
+    int code;
+    for (int depth = 0; depth < ZERROR_CAUSE_POOL && zerr__cause_of(c, &id, &code); depth++)
+    {
+        if (zerr__causes.slots[id % ZERROR_CAUSE_POOL].id != id)
+        {
+            zerr__crash_str(fd, "  caused by [");
+            zerr__crash_num(fd, (unsigned long long)(unsigned)code, 10);
+            zerr__crash_str(fd, "] (expired error cause)\n");
+            return;
+        }
+        c = zerr__causes.slots[id % ZERROR_CAUSE_POOL].err;
+        zerr__crash_str(fd, "  caused by\n");
+        zerr__crash_error(fd, c);
+    }
 }
 
-static void zlog__print_internal(zlog_level lvl, const char *label, const char *time_str, 
-                                 const char *msg, const char *file, int line, const char *func, const char *extra) 
+// The newest 'records' records of a ring sink: lines that do not start with blank space.
+static void zerr__crash_ring(int fd, int id, int records)
 {
-    if (zlog__state.colors) 
+    if (id <= 0 || id >= ZLOG_SINK_MAX)
     {
-        fprintf(stderr, "\n%s[%s] %s:%s %s\n", zlog__colors[lvl], time_str, label, "\x1b[0m", msg);
-        fprintf(stderr, "    \x1b[90mat\x1b[0m %s (%s:%d)%s\n", func ? func : "?", file, line, extra ? extra : "");
-    } 
-    else 
+        return;
+    }
+    const zlog__sink *sink = &zlog__sinks.items[id];
+    if (!sink->used || ZLOG_SINK_RING != sink->cfg.kind || !sink->ring)
     {
-        fprintf(stderr, "\n[%s] %s: %s\n", time_str, label, msg);
-        fprintf(stderr, "    at %s (%s:%d)%s\n", func ? func : "?", file, line, extra ? extra : "");
+        return;
     }
-    if (zlog__state.fp) 
+    size_t cap = sink->cfg.size;
+    size_t end = sink->ring_total;
+    size_t lo = end > cap ? end - cap : 0;
+    size_t from = end;
+    int found = 0;
+    for (size_t p = end; p-- > lo && found < records; )
     {
-        fprintf(zlog__state.fp, "\n[%s] %s: %s\n", time_str, label, msg);
-        fprintf(zlog__state.fp, "    at %s (%s:%d)%s\n", func ? func : "?", file, line, extra ? extra : "");
-        fflush(zlog__state.fp);
+        char c = sink->ring[p % cap];
+        bool start = (0 == p) || (p > lo && '\n' == sink->ring[(p - 1) % cap]);
+        if (start && c != ' ' && c != '\t' && c != '\n')
+        {
+            found++;
+            from = p;
+        }
     }
+    zerr__crash_str(fd, "\nRecent log records:\n");
+    size_t at = from % cap;
+    size_t n = end - from;
+    size_t first = (n < cap - at) ? n : cap - at;
+    zerr__crash_put(fd, sink->ring + at, first);
+    zerr__crash_put(fd, sink->ring, n - first);
 }
 
-void zlog_msg(zlog_level level, const char *file, int line, const char *func, const char *fmt, ...) 
+// The crashing thread's flight recorder. Formatting is not signal-safe, so formats are shown unexpanded.
+static void zerr__crash_flight(int fd)
 {
-    if (level < zlog__state.level) 
+    const zlog__flight_t *fr = &zlog__flight;
+    unsigned long long from = fr->total > ZLOG_FLIGHT_RECORDS ? fr->total - ZLOG_FLIGHT_RECORDS : 0;
+    if (from >= fr->total)
     {
         return;
     }
-    char time_buf[64];
-    zlog__get_time(time_buf, sizeof(time_buf));
-    char msg_buf[2048];
-    va_list args;
-    va_start(args, fmt);
-    vsnprintf(msg_buf, sizeof(msg_buf), fmt, args);
-    va_end(args);
-
-    zlog__lock();
-    zlog__print_internal(level, zlog__labels[level], time_buf, msg_buf, file, line, func, NULL);
-    zlog__unlock();
+    zerr__crash_str(fd, "\nFlight recorder (this thread, formats unexpanded):\n");
+    for (unsigned long long i = from; i < fr->total; i++)
+    {
+        const zlog__flight_rec *rec = &fr->recs[i % ZLOG_FLIGHT_RECORDS];
+        zerr__crash_str(fd, "  ");
+        zerr__crash_str(fd, zlog__labels[rec->level]);
+        zerr__crash_str(fd, " ");
+        zerr__crash_str(fd, (rec->flags & ZLOG__FLIGHT_KV) ? (const char *)rec->args : rec->fmt);
+        zerr__crash_at(fd, "  at ", rec->func, rec->file, rec->line);
+    }
 }
 
-void zerr_print(zerr e) 
+static void zerr__crash_write(int fd, int sig, const void *addr)
 {
-    char time_buf[64];
-    zlog__get_time(time_buf, sizeof(time_buf));
-    char extra_buf[1024] = {0};
-    if (e.source) 
+    fd = (fd > 0) ? fd : 2;
+    zerr__crash_str(fd, "\n*** zerror crash report: ");
+    if (sig)
+    {
+        zerr__crash_str(fd, zerr__crash_signame(sig));
+        zerr__crash_str(fd, " (");
+        zerr__crash_num(fd, (unsigned long long)sig, 10);
+        zerr__crash_str(fd, "), address ");
+        zerr__crash_num(fd, (unsigned long long)(uintptr_t)addr, 16);
+    }
+    else
     {
-        snprintf(extra_buf, sizeof(extra_buf), "\n    [Expr] %s", e.source);
+        zerr__crash_str(fd, "on request");
     }
+    zerr__crash_str(fd, ", pid ");
+    zerr__crash_num(fd, (unsigned long long)getpid(), 10);
+    zerr__crash_str(fd, ", time ");
+    zerr__crash_num(fd, (unsigned long long)time(NULL), 10);
+    zerr__crash_str(fd, " ***\n\nLast error on this thread:\n");
+    zerr__crash_chain(fd);
 
-    zlog__lock();
-    zlog__print_internal(ZLOG_ERROR, "Error", time_buf, e.msg, e.file, e.line, e.func, extra_buf);
-    zlog__unlock();
+    int records = zerr__crash.cfg.records > 0 ? zerr__crash.cfg.records : ZERROR_CRASH_RECORDS;
+    zerr__crash_ring(fd, zerr__crash.cfg.ring, records);
+    zerr__crash_flight(fd);
+
+    zerr__crash_str(fd, "\nBacktrace:\n");
+#   ifdef ZERROR_HAS_BACKTRACE
+    void *frames[ZERROR_CRASH_FRAMES];
+    int n = backtrace(frames, ZERROR_CRASH_FRAMES);
+    backtrace_symbols_fd(frames, n, fd);
+#   else
+    zerr__crash_str(fd, "  (not available on this platform)\n");
+#   endif
+    zerr__crash_str(fd, "*** end of crash report ***\n");
 }
 
-void zerr_panic(const char *msg, const char *file, int line) 
+static void zerr__crash_handler(int sig, siginfo_t *info, void *uctx)
 {
-    char time_buf[64];
-    zlog__get_time(time_buf, sizeof(time_buf));
-    zlog__lock();
-    zlog__print_internal(ZLOG_FATAL, "PANIC", time_buf, msg, file, line, "!", NULL);
-    zlog__unlock();
-    ZERROR_TRAP();
-    ZERROR_PANIC_ACTION();
+    (void)uctx;
+    int saved = errno;
+    // Only the first crashing thread reports.
+    if (0 == ZERROR_ATOMIC_ADD(&zerr__crash.busy, 1))
+    {
+        zerr__crash_write(zerr__crash.cfg.fd, sig, info ? info->si_addr : NULL);
+    }
+    // Hand the signal to whatever was installed before (usually the default: core dump).
+    for (int i = 0; i < ZERR__CRASH_SIGNALS; i++)
+    {
+        if (zerr__crash_signals[i] == sig)
+        {
+            sigaction(sig, &zerr__crash.old[i], NULL);
+        }
+    }
+    errno = saved;
+    raise(sig);
 }
 
-zerr zerr_create_impl(int code, const char *file, int line, const char *func, const char *fmt, ...) 
+bool zerr_crash_install(const zerr_crash_config *cfg)
 {
-    va_list args;
-    va_start(args, fmt);
-    vsnprintf(z_err_buf, sizeof(z_err_buf), fmt, args);
-    va_end(args);
-    return (zerr)
-    { 
-        .code = code, 
-        .msg = z_err_buf, 
-        .file = file, 
-        .line = line, 
-        .func = func, 
-        .source = NULL 
-    };
+    if (zerr__crash.installed)
+    {
+        zerr_crash_uninstall();
+    }
+    memset(&zerr__crash.cfg, 0, sizeof(zerr__crash.cfg));
+    if (cfg)
+    {
+        zerr__crash.cfg = *cfg;
+    }
+    ZERROR_ATOMIC_STORE(&zerr__crash.busy, 0);
+
+#   ifdef ZERROR_HAS_BACKTRACE
+    // The first call may load libgcc; do it now rather than in the handler.
+    void *warm[1];
+    (void)backtrace(warm, 1);
+#   endif
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = zerr__crash_handler;
+    sa.sa_flags = SA_SIGINFO;
+#   ifdef SA_ONSTACK
+    stack_t current;
+    if (0 == sigaltstack(NULL, &current) && (current.ss_flags & SS_DISABLE))
+    {
+        stack_t alt;
+        memset(&alt, 0, sizeof(alt));
+        alt.ss_sp = zerr__crash_stack;
+        alt.ss_size = sizeof(zerr__crash_stack);
+        (void)sigaltstack(&alt, NULL);
+    }
+    sa.sa_flags |= SA_ONSTACK;
+#   endif
+    sigemptyset(&sa.sa_mask);
+    for (int i = 0; i < ZERR__CRASH_SIGNALS; i++)
+    {
+        if (sigaction(zerr__crash_signals[i], &sa, &zerr__crash.old[i]) != 0)
+        {
+            while (i-- > 0)
+            {
+                sigaction(zerr__crash_signals[i], &zerr__crash.old[i], NULL);
+            }
+            return false;
+        }
+    }
+    zerr__crash.installed = true;
+    return true;
 }
 
-zerr zerr_errno_impl(int code, const char *file, int line, const char *func, const char *fmt, ...) 
+void zerr_crash_uninstall(void)
 {
-    char temp[1024];
-    va_list args;
-    va_start(args, fmt);
-    vsnprintf(temp, sizeof(temp), fmt, args);
-    va_end(args);
-    snprintf(z_err_buf, sizeof(z_err_buf), "%s: %s", temp, strerror(errno));
-    return (zerr)
-    { 
-        .code = code,
-         .msg = z_err_buf, 
-         .file = file, 
-         .line = line, 
-         .func = func, 
-         .source = NULL 
-        };
+    if (!zerr__crash.installed)
+    {
+        return;
+    }
+    for (int i = 0; i < ZERR__CRASH_SIGNALS; i++)
+    {
+        sigaction(zerr__crash_signals[i], &zerr__crash.old[i], NULL);
+    }
+    zerr__crash.installed = false;
 }
 
-zerr zerr_add_trace(zerr e, const char *func, const char *file, int line) 
+void zerr_crash_report(int fd)
 {
-    char combined[2048];
-    const char *msg = e.msg ? e.msg : "Unknown Error";
-    snprintf(combined, sizeof(combined), "%s\n    at %s (%s:%d)", msg, func, file, line);
-    snprintf(z_err_buf, sizeof(z_err_buf), "%s", combined);
-    e.msg = z_err_buf;
-    return e;
+    zerr__crash_write(fd, 0, NULL);
 }
 
-zerr zerr_wrap(zerr e, const char *fmt, ...) 
-{ 
-    char new_msg[1024];
-    va_list args;
-    va_start(args, fmt);
-    vsnprintf(new_msg, sizeof(new_msg), fmt, args);
-    va_end(args);
-    
-    char combined[2048];
-    snprintf(combined, sizeof(combined), "%s: %s", new_msg, e.msg);
-    snprintf(z_err_buf, sizeof(z_err_buf), "%s", combined);
-    e.msg = z_err_buf;
-    return e; 
-} 
+#endif
 
 int zerr_run(zres result) 
 {
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#define ZERROR_IMPLEMENTATION
+#define ZERROR_SHORT_NAMES
+#define ZERROR_COMPACT
+#define ZERROR_ENABLE_TRACE
+#include "zerror.h"
+
+#define TEST(name) printf("[TEST] %-35s", name);
+#define PASS() printf(" \033[0;32mPASS\033[0m\n")
+
+static int leaf_line;
+
+zres compact_leaf(void)
+{
+    leaf_line = __LINE__ + 1;
+    return zres_err(zerr_create(503, "Backend %s down", "db"));
+}
+
+zres compact_mid(void)
+{
+    check(compact_leaf());
+    return zres_ok();
+}
+
+ResInt compact_top(void)
+{
+    check_into(ResInt, compact_mid());
+    return ResInt_ok(1);
+}
+
+void test_layout(void)
+{
+    TEST("Layout (16 bytes, static site)");
+
+    assert(sizeof(zerr) == sizeof(int) + sizeof(unsigned) + sizeof(void *));
+
+    int line = __LINE__ + 1;
+    zerr a = zerr_create(404, "Not Found: %s", "index.html");
+    assert(a.code == 404);
+    assert(strcmp(zerr_msg(a), "Not Found: index.html") == 0);
+    assert(strcmp(zerr_file(a), __FILE__) == 0);
+    assert(strcmp(zerr_func(a), "test_layout") == 0);
+    assert(zerr_line(a) == line);
+    assert(zerr_source(a) == NULL);
+
+    // Every error raised at one call site shares its descriptor.
+    const zerr_site *sites[2];
+    for (int i = 0; i < 2; i++)
+    {
+        zerr e = zerr_create(500, "loop %d", i);
+        sites[i] = e.site;
+    }
+    assert(sites[0] != NULL && sites[0] == sites[1]);
+
+    // Without a descriptor the site is kept in the body.
+    zerr d = zerr_create_impl(400, "dyn.c", 7, "dyn", "dynamic");
+    assert(NULL == d.site);
+    assert(strcmp(zerr_file(d), "dyn.c") == 0 && zerr_line(d) == 7);
+
+    errno = ENOENT;
+    zerr s = zerr_errno(ENOENT, "open %s", "cfg");
+    assert(strstr(zerr_msg(s), "open cfg: ") == zerr_msg(s));
+
+    PASS();
+}
+
+void test_propagation(void)
+{
+    TEST("Propagation (source, trace)");
+
+    ResInt r = compact_top();
+    assert(!r.is_ok);
+    assert(503 == r.err.code);
+    assert(zerr_line(r.err) == leaf_line);
+    assert(strcmp(zerr_msg(r.err), "Backend db down") == 0);
+    assert(strcmp(zerr_source(r.err), "compact_leaf()") == 0);
+
+    zerr_frame frames[4];
+    int n = zerr_trace(r.err, frames, 4);
+    assert(2 == n);
+    assert(strcmp(frames[0].func, "compact_mid") == 0);
+    assert(strcmp(frames[1].func, "compact_top") == 0);
+
+    PASS();
+}
+
+void test_values(void)
+{
+    TEST("Value Semantics (wrap, expiry)");
+
+    // Changing a copy never changes the original.
+    zerr e = zerr_create(500, "inner");
+    zerr w = zerr_wrap(e, "outer");
+    zerr s = zerr_with_src(e, "expr()");
+    assert(strcmp(zerr_msg(e), "inner") == 0);
+    assert(strcmp(zerr_msg(w), "outer") == 0);
+    assert(strcmp(zerr_msg(zerr_cause(w)), "inner") == 0);
+    assert(zerr_line(w) == zerr_line(e) + 1);
+
+    // An owned copy outlives the bodies it was taken from.
+    zerr_owned *o = zerr_clone(zerr_with_src(w, "load()"));
+    assert(NULL == zerr_source(e));
+    assert(strcmp(zerr_source(s), "expr()") == 0);
+
+    // Deferred formatting still works through the body.
+    zerr_set_lazy_format(true);
+    zerr l = zerr_create(400, "lazy %d", 7);
+    zerr_set_lazy_format(false);
+    assert(strcmp(zerr_msg(l), "lazy 7") == 0);
+    l = zerr_resolve(l);
+    assert(strcmp(zerr_msg(l), "lazy 7") == 0);
+
+    // Bodies are recycled; the call site survives, the message expires.
+    zerr old = zerr_create(410, "old");
+    for (int i = 0; i < ZERROR_BODY_POOL; i++)
+    {
+        (void)zerr_create(500, "churn");
+    }
+    assert(strcmp(zerr_msg(old), "(expired error message)") == 0);
+    assert(strcmp(zerr_file(old), __FILE__) == 0);
+
+    // The cause link is kept by the newest node, so it lasts as long as the error.
+    zerr deep = zerr_wrap(e, "deep");
+    for (int i = 0; i < ZERROR_BODY_POOL; i++)
+    {
+        deep = zerr_add_trace(deep, "hop", "hop.c", i);
+    }
+    assert(zerr_cause(deep).code == 500);
+    zerr back = zerr_owned_get(o);
+    assert(strcmp(zerr_msg(back), "outer") == 0 && strcmp(zerr_source(back), "load()") == 0);
+    assert(strcmp(zerr_msg(zerr_cause(back)), "inner") == 0);
+    assert(zerr_line(back) == zerr_line(w));
+    zerr_free(o);
+
+    PASS();
+}
+
+void test_print(void)
+{
+    TEST("Printing");
+
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_NONE);
+    zlog_sink_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.kind = ZLOG_SINK_RING;
+    cfg.level = ZLOG_TRACE;
+    cfg.format = ZLOG_FORMAT_TEXT;
+    int ring = zlog_add_sink(&cfg);
+    assert(ring > 0);
+
+    ResInt r = compact_top();
+    zerr_print(r.err);
+
+    char buf[2048];
+    zlog_ring_read(ring, buf, sizeof(buf));
+    assert(strstr(buf, "Backend db down") != NULL);
+    assert(strstr(buf, "at compact_mid") != NULL);
+    assert(strstr(buf, "[Expr] compact_leaf()") != NULL);
+
+    // Wrapped layers come after the outermost one.
+    zerr_print(zerr_wrap_code(r.err, 502, "Gateway failed"));
+    zlog_ring_read(ring, buf, sizeof(buf));
+    assert(strstr(buf, "Gateway failed") != NULL);
+    assert(strstr(buf, "Caused by: [503] Backend db down") != NULL);
+
+    zlog_shutdown();
+    PASS();
+}
+
+int main(void)
+{
+    printf("=> Running tests (zerror.h, compact).\n");
+
+    test_layout();
+    test_propagation();
+    test_values();
+    test_print();
+
+    printf("=> All tests passed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,153 @@
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <cassert>
+
+#define ZERROR_IMPLEMENTATION
+#define ZERROR_SHORT_NAMES
+#include "zerror.h"
+
+#if !ZERROR_HAS_COROUTINES
+#   error "test_coro.cpp needs C++20 coroutines"
+#endif
+
+using namespace z_error;
+
+#define TEST(name) printf("[TEST] %-40s", name);
+#define PASS() std::cout << "\033[0;32mPASS\033[0m\n";
+
+// Counts live instances, to check frames unwind on short-circuit.
+struct guard
+{
+    static int live;
+    guard() { live++; }
+    ~guard() { live--; }
+};
+
+int guard::live = 0;
+
+static int reached = 0;
+
+result<int> parse(int v) 
+{
+    if (v < 0) 
+    {
+        return zerr_create(400, "Negative input");
+    }
+    return v * 10;
+}
+
+task<int> step(int v) 
+{
+    guard g;
+    int x = co_await parse(v);
+    reached++;
+    co_return x + 1;
+}
+
+task<std::string> pipeline(int v) 
+{
+    guard g;
+    int a = co_await step(v);
+    int b = co_await step(a);
+    co_return std::to_string(b);
+}
+
+task<void> no_value(int v) 
+{
+    co_await parse(v);
+    co_return;
+}
+
+task<int> recover(int v) 
+{
+    result<int> r = co_await step(v).as_result();
+    if (!r) 
+    {
+        co_return r.error().code;
+    }
+    co_return zerr_create(500, "Expected an error");
+}
+
+void test_task_basics() 
+{
+    TEST("task<T> (co_await, co_return)");
+
+    result<std::string> r = pipeline(2).get();
+    assert(r.ok() && r.value() == "211");
+
+    result<void> v = no_value(1).get();
+    assert(v.ok());
+
+    // co_return accepts a zerr too.
+    auto fails = []() -> task<int> { co_return zerr_create(7, "Seven"); };
+    assert(fails().get().error().code == 7);
+
+    PASS();
+}
+
+void test_task_short_circuit() 
+{
+    TEST("task<T> Short-Circuit");
+
+    reached = 0;
+    {
+        task<std::string> t = pipeline(-1);
+        result<std::string> r = t.get();
+        assert(!r.ok());
+        assert(r.error().code == 400);
+        assert(t.done());
+    }
+    // Neither step got past its co_await, and every frame unwound.
+    assert(reached == 0);
+    assert(guard::live == 0);
+
+    result<void> v = no_value(-1).get();
+    assert(!v.ok() && v.error().code == 400);
+
+    PASS();
+}
+
+void test_task_as_result() 
+{
+    TEST("task<T>::as_result()");
+
+    assert(recover(-1).get().value() == 400);
+    assert(recover(1).get().error().code == 500);
+
+    // Lazy: nothing runs until awaited or get().
+    reached = 0;
+    task<int> t = step(1);
+    assert(!t.done() && reached == 0);
+    assert(t.get().value() == 11 && reached == 1);
+
+    PASS();
+}
+
+#if ZLOG_FMT_CHECKED
+// The spec checks behind log_*_fmt's compile-time errors.
+static constexpr int int_arg[] = { z_log::detail::spec_integer };
+static constexpr int double_arg[] = { z_log::detail::spec_floating };
+static constexpr int string_arg[] = { z_log::detail::spec_free };
+static_assert(z_log::detail::specs_match("{:08x} {{:s}}", int_arg, 1), "hex int");
+static_assert(z_log::detail::specs_match("{:.3f}", double_arg, 1), "fixed double");
+static_assert(z_log::detail::specs_match("{:s}", string_arg, 1), "strings are unchecked");
+static_assert(!z_log::detail::specs_match("{:s}", int_arg, 1), "string conversion on int");
+static_assert(!z_log::detail::specs_match("{:n}", int_arg, 1), "%n on int");
+static_assert(!z_log::detail::specs_match("{:>5}", int_arg, 1), "fill/align");
+static_assert(!z_log::detail::specs_match("{:f}", int_arg, 1), "float conversion on int");
+static_assert(!z_log::detail::specs_match("{:x}", double_arg, 1), "hex on double");
+#endif
+
+int main() 
+{
+    std::cout << "=> Running tests (zerror.h, coroutines).\n";
+
+    test_task_basics();
+    test_task_short_circuit();
+    test_task_as_result();
+
+    std::cout << "=> All tests passed successfully.\n";
+    return 0;
+}
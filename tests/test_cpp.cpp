@@ -5,6 +5,7 @@
 #include <memory>
 #include <cassert>
 #include <algorithm>
+#include <thread>
 
 #define ZERROR_IMPLEMENTATION
 #define ZERROR_SHORT_NAMES
@@ -91,8 +92,209 @@ void test_complex_types()
     PASS();
 }
 
+// Counts copies and moves; the move is noexcept so containers use it.
+struct tracked
+{
+    static int copies;
+    static int moves;
+    int v;
+
+    tracked(int x) : v(x) {}
+    tracked(const tracked &o) : v(o.v) { copies++; }
+    tracked(tracked &&o) noexcept : v(o.v) { moves++; }
+    tracked &operator=(const tracked &o) { v = o.v; copies++; return *this; }
+    tracked &operator=(tracked &&o) noexcept { v = o.v; moves++; return *this; }
+};
+
+int tracked::copies = 0;
+int tracked::moves = 0;
+
+void test_copy_move() 
+{
+    TEST("Copy/Move Semantics (trivial, noexcept)");
+
+    // The error is stored once, in the same slot as the value.
+    static_assert(sizeof(result<int>) <= sizeof(::zerr) + alignof(::zerr), "result<int> too large");
+    static_assert(std::is_trivially_copyable<result<int>>::value, "result<int> not trivially copyable");
+    static_assert(std::is_trivially_destructible<result<int>>::value, "result<int> not trivially destructible");
+    static_assert(!std::is_trivially_copyable<result<std::string>>::value, "result<std::string> trivially copyable");
+    static_assert(std::is_nothrow_move_constructible<result<std::string>>::value, "result<std::string> move may throw");
+    static_assert(std::is_nothrow_move_constructible<result<tracked>>::value, "result<tracked> move may throw");
+    static_assert(!std::is_copy_constructible<result<std::unique_ptr<int>>>::value, "result<unique_ptr> copyable");
+    static_assert(std::is_move_assignable<result<std::unique_ptr<int>>>::value, "result<unique_ptr> not movable");
+
+    // Copy and assignment across ok/err states.
+    result<std::string> a = std::string("value");
+    result<std::string> b = a;
+    assert(b.ok() && b.unwrap_val() == "value");
+    assert(a.unwrap_val() == "value");
+
+    result<std::string> e = zerr_create(7, "seven");
+    b = e;
+    assert(!b.ok() && b.err.code == 7);
+    b = a;
+    assert(b.ok() && b.unwrap_val() == "value");
+    b = std::move(e);
+    assert(!b.ok() && b.err.code == 7);
+
+    result<std::unique_ptr<int>> p = std::unique_ptr<int>(new int(5));
+    result<std::unique_ptr<int>> q = zerr_create(8, "eight");
+    q = std::move(p);
+    assert(q.ok() && *q.unwrap_val() == 5);
+
+    // Vector growth moves instead of copying.
+    tracked::copies = 0;
+    std::vector<result<tracked>> v;
+    for (int i = 0; i < 64; i++)
+    {
+        v.push_back(result<tracked>(tracked(i)));
+    }
+    assert(tracked::copies == 0);
+    assert(v[63].unwrap_val().v == 63);
+
+    PASS();
+}
+
+void test_combinators() 
+{
+    TEST("Combinators (and_then, map, or_else)");
+
+    // Pipeline on success.
+    auto r1 = helper_calc(3)
+        .and_then([](int v) { return helper_calc(v); })
+        .transform([](int v) { return std::to_string(v); });
+    static_assert(std::is_same<decltype(r1), result<std::string>>::value, "transform type");
+    assert(r1.has_value() && *r1 == "300");
+
+    // The first error short-circuits the rest.
+    int calls = 0;
+    auto r2 = helper_calc(0)
+        .and_then([&](int v) { calls++; return helper_calc(v); })
+        .map([&](int v) { calls++; return v + 1; });
+    assert(!r2 && r2.error().code == 101 && calls == 0);
+
+    // Recovery and error rewriting.
+    assert(r2.or_else([](const zerr &) { return result<int>(7); }).value() == 7);
+    auto r3 = r2.transform_error([](const zerr &e) { return zerr_create(e.code + 1, "Rewritten"); });
+    assert(r3.error().code == 102);
+    assert(r2.value_or(-1) == -1 && helper_calc(2).value_or(-1) == 20);
+
+    // The && overloads move the payload.
+    std::unique_ptr<int> p(new int(4));
+    auto r4 = result<std::unique_ptr<int>>(std::move(p))
+        .transform([](std::unique_ptr<int> q) { return *q * 2; });
+    assert(r4.value() == 8);
+
+    // void results.
+    result<void> ok;
+    auto r5 = ok.transform([] { return 5; });
+    assert(r5.value() == 5);
+    auto r6 = helper_calc(1).transform([](int) {});
+    static_assert(std::is_same<decltype(r6), result<void>>::value, "void transform type");
+    assert(r6.has_value());
+    assert(result<void>(zerr_create(9, "Nine")).and_then([] { return result<int>(1); }).error().code == 9);
+
+    PASS();
+}
+
+struct point 
+{ 
+    int x, y; 
+};
+
+namespace z_log
+{
+    template <>
+    struct formatter<point>
+    {
+        static void format(writer &w, const point &p, format_spec) 
+        { 
+            w.printf("(%d, %d)", p.x, p.y); 
+        }
+    };
+}
+
+static int expensive_calls = 0;
+
+static int expensive() 
+{ 
+    return ++expensive_calls; 
+}
+
+void test_format_logging() 
+{
+    TEST("Type-Safe Logging (log_info_fmt)");
+
+    char buf[128];
+    std::string name = "disk";
+    size_t n = z_log::format_to(buf, sizeof(buf), "{} {} at {:04x}, {:.1f}% {{ok}} {} {}",
+                                name, point{ 1, 2 }, 255u, 99.25, true, "done");
+    assert(std::string(buf) == "disk (1, 2) at 00ff, 99.2% {ok} true done");
+    assert(n == strlen(buf));
+
+    // Specs that do not suit the argument print as written, never reaching printf.
+    z_log::format_to(buf, sizeof(buf), "{:s} {:n} {:>5} {:f} {:x} {:#d} {:1234}", 1, 2, 3, 4, 5.5, 6, 7);
+    assert(std::string(buf) == "{:s} {:n} {:>5} {:f} {:x} {:#d} {:1234}");
+    z_log::format_to(buf, sizeof(buf), "{:+5d}|{:-4x}|{:#o}|{:.2e}|{:X}|{:d}", 42, 255, 8, 1500.0, -1, 4000000000u);
+    assert(std::string(buf) == "  +42|ff  |010|1.50e+03|FFFFFFFFFFFFFFFF|4000000000");
+
+    // Truncates instead of overflowing.
+    char small[8];
+    z_log::format_to(small, sizeof(small), "{}", name + name);
+    assert(std::string(small) == "diskdis");
+
+    // Records go through the C sinks and level checks.
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_NONE);
+    zlog_sink_config ring = {};
+    ring.kind = ZLOG_SINK_RING;
+    ring.level = ZLOG_TRACE;
+    ring.format = ZLOG_FORMAT_TEXT;
+    ring.size = 1024;
+    int id = zlog_add_sink(&ring);
+    assert(id > 0);
+
+    log_warn_fmt("{} failed: {}", name, zerr_create(5, "Full"));
+    log_debug_fmt("skipped {}", expensive());
+    zlog_flush();
+
+    char out[1024];
+    zlog_ring_read(id, out, sizeof(out));
+    assert(strstr(out, "disk failed: Full (code 5)") != NULL);
+    assert(strstr(out, "skipped") == NULL);
+    assert(0 == expensive_calls);
+
+    zlog_remove_sink(id);
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_TRACE);
+    PASS();
+}
+
 // Requires statement expressions (GCC/Clang/TCC).
 #if defined(__GNUC__) || defined(__clang__)
+void test_owned() 
+{
+    TEST("Owned Errors (move to another thread)");
+
+    owned handed;
+    std::thread worker([&handed]() 
+    {
+        zerr e = zerr_wrap_code(zerr_create(404, "no such user"), 500, "lookup failed");
+        handed = owned(e);
+    });
+    worker.join();
+
+    assert(handed);
+    assert(handed.code() == 500);
+    assert(std::string(handed.msg()) == "lookup failed");
+
+    owned moved(std::move(handed));
+    assert(!handed && moved);
+    zerr e = moved.get();
+    assert(zerr_root_cause(e).code == 404);
+    assert(std::string(zerr_msg(zerr_cause(e))) == "no such user");
+
+    PASS();
+}
+
 void test_macros_cpp() 
 {
     TEST("Macros C++ (ztry, check)");
@@ -149,6 +351,10 @@ int main()
     test_result_void();
     test_complex_types();
     test_implicit_conversion();
+    test_copy_move();
+    test_combinators();
+    test_format_logging();
+    test_owned();
 
 #if defined(__GNUC__) || defined(__clang__)
     test_macros_cpp();
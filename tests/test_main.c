@@ -3,9 +3,16 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <pthread.h>
 
 #define ZERROR_IMPLEMENTATION
 #define ZERROR_SHORT_NAMES
+#define ZERROR_ENABLE_STATS
+#define ZERROR_POOL_LIMIT (256u << 10)
 #include "zerror.h"
 
 #define TEST(name) printf("[TEST] %-35s", name);
@@ -110,20 +117,1069 @@ void test_validation(void)
 
 void test_wrapping(void) 
 {
-    TEST("Error Wrapping");
+    TEST("Error Wrapping (cause chain)");
 
     zerr root = zerr_create(503, "Database Unavailable");
-    zerr wrapped = zerr_wrap(root, "Login Failed");
+    zerr mid = zerr_wrap(root, "Login Failed");
+    zerr top = zerr_wrap_code(mid, 401, "Request %d rejected", 7);
 
-    assert(wrapped.code == 503);
-    assert(strstr(wrapped.msg, "Login Failed") != NULL);
-    assert(strstr(wrapped.msg, "Database Unavailable") != NULL);
+    // Each layer keeps its own code, message and location.
+    assert(mid.code == 503 && top.code == 401);
+    assert(strcmp(mid.msg, "Login Failed") == 0);
+    assert(strcmp(top.msg, "Request 7 rejected") == 0);
+    assert(strcmp(zerr_func(top), "test_wrapping") == 0);
+    assert(top.line == mid.line + 1);
+    assert(0 == zerr_trace(top, NULL, 0));
+
+    // Walking the chain.
+    assert(strcmp(zerr_cause(top).msg, "Login Failed") == 0);
+    assert(strcmp(zerr_cause(mid).msg, "Database Unavailable") == 0);
+    assert(0 == zerr_cause(root).code);
+    assert(strcmp(zerr_root_cause(top).msg, "Database Unavailable") == 0);
+    assert(strcmp(zerr_root_cause(root).msg, "Database Unavailable") == 0);
+
+    zerr found;
+    assert(zerr_find_code(top, 503, &found) && strcmp(found.msg, "Login Failed") == 0);
+    assert(zerr_find_code(top, 401, NULL));
+    assert(!zerr_find_code(top, 404, &found));
+
+    char text[64];
+    size_t n = zerr_chain_text(top, text, sizeof(text));
+    assert(strcmp(text, "Request 7 rejected: Login Failed: Database Unavailable") == 0);
+    assert(n == strlen(text));
+    assert(zerr_chain_text(top, text, 8) == n && strcmp(text, "Request") == 0);
+
+    // Frames added to the outer layer stay apart from the cause link.
+    zerr hop = zerr_add_trace(top, "caller", "caller.c", 10);
+    zerr_frame f[2];
+    assert(1 == zerr_trace(hop, f, 2) && strcmp(f[0].func, "caller") == 0);
+    assert(strcmp(zerr_cause(hop).msg, "Login Failed") == 0);
+
+    // The report shows every layer, once, after the outermost one.
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_NONE);
+    zlog_sink_config cfg = { 0 };
+    cfg.kind = ZLOG_SINK_RING;
+    cfg.level = ZLOG_TRACE;
+    cfg.format = ZLOG_FORMAT_TEXT;
+    int id = zlog_add_sink(&cfg);
+    zerr_print(hop);
+    char buf[2048];
+    zlog_ring_read(id, buf, sizeof(buf));
+    const char *c1 = strstr(buf, "Caused by: [503] Login Failed");
+    const char *c2 = strstr(buf, "Caused by: [503] Database Unavailable");
+    assert(strstr(buf, "Request 7 rejected") != NULL);
+    assert(c1 && c2 && c1 < c2);
+    assert(strstr(c1, "at caller") == NULL);
+    zlog_remove_sink(id);
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_TRACE);
+
+    // The cause link outlives reuse of the frame pool, by this error or others.
+    zerr deep = zerr_wrap(root, "Retry failed");
+    for (int i = 0; i < ZERROR_TRACE_POOL; i++)
+    {
+        deep = zerr_add_trace(deep, "retry", "retry.c", i);
+        (void)zerr_add_trace(root, "churn", "churn.c", i);
+    }
+    assert(zerr_cause(deep).code == 503);
+    assert(strcmp(zerr_msg(zerr_cause(deep)), "Database Unavailable") == 0);
+
+    // A recycled cause keeps its code.
+    for (int i = 0; i < ZERROR_CAUSE_POOL; i++)
+    {
+        (void)zerr_wrap(root, "churn");
+    }
+    assert(zerr_cause(top).code == 503);
+    assert(strcmp(zerr_msg(zerr_cause(top)), "(expired error cause)") == 0);
     
+    // The link is stored with the wrapper's message, and expires with it.
+    zerr_arena_reset();
+    assert(strcmp(zerr_msg(deep), "(expired error message)") == 0);
+    assert(strcmp(zerr_msg(zerr_cause(deep)), "(expired error cause)") == 0);
+    assert(0 == zerr_cause(root).code);
+
+    PASS();
+}
+
+void test_arena(void) 
+{
+    TEST("Message Arena (Coexist, Reset)");
+
+    // Several live errors on one thread keep their own text.
+    zerr a = zerr_create(1, "first %d", 1);
+    zerr b = zerr_create(2, "second %d", 2);
+    zerr w = zerr_wrap(a, "context");
+    assert(strcmp(a.msg, "first 1") == 0);
+    assert(strcmp(b.msg, "second 2") == 0);
+    assert(strcmp(w.msg, "context") == 0);
+    assert(strcmp(zerr_cause(w).msg, "first 1") == 0);
+
+    // Filling the arena laps around without corrupting recent messages.
+    for (int i = 0; i < 4096; i++) 
+    {
+        zerr tmp = zerr_create(3, "filler message number %d", i);
+        (void)tmp;
+    }
+    zerr last = zerr_create(4, "still here");
+    assert(strcmp(last.msg, "still here") == 0);
+
+    zerr_arena_reset();
+    zerr fresh = zerr_create(5, "fresh");
+    assert(strcmp(fresh.msg, "fresh") == 0);
+
+    PASS();
+}
+
+zres trace_leaf(void) 
+{
+    return zres_err(zerr_create(42, "leaf failure"));
+}
+
+zres trace_mid(void) 
+{
+    zres r = trace_leaf();
+    if (!r.is_ok) return zres_err(zerr_add_trace(r.err, __func__, __FILE__, __LINE__));
+    return zres_ok();
+}
+
+zres trace_top(void) 
+{
+    zres r = trace_mid();
+    if (!r.is_ok) return zres_err(zerr_add_trace(r.err, __func__, __FILE__, __LINE__));
+    return zres_ok();
+}
+
+void test_trace_frames(void) 
+{
+    TEST("Trace Frames (Order, Message)");
+
+    zres r = trace_top();
+    assert(!r.is_ok);
+
+    // Hops are stored as frames; the message itself is untouched.
+    assert(strcmp(r.err.msg, "leaf failure") == 0);
+
+    zerr_frame frames[8];
+    int n = zerr_trace(r.err, frames, 8);
+    assert(n == 2);
+    assert(strcmp(frames[0].func, "trace_mid") == 0);
+    assert(strcmp(frames[1].func, "trace_top") == 0);
+    assert(frames[0].line < frames[1].line);
+
+    // Untraced errors have no frames.
+    assert(zerr_trace(zerr_create(1, "plain"), frames, 8) == 0);
+
+    PASS();
+}
+
+void test_lazy_format(void) 
+{
+    TEST("Deferred Formatting (zerr_msg)");
+
+    zerr_set_lazy_format(true);
+
+    char name[16];
+    strcpy(name, "index.html");
+    zerr e = zerr_create(404, "Not Found: %s (%d/%5.2f/%-4s|%lld|%zu|%x|%c|%%)", 
+                         name, 7, 3.14159, "ab", -5LL, (size_t)42, 255u, 'z');
+
+    // The argument snapshot survives the caller reusing its buffers.
+    strcpy(name, "changed");
+    assert(strcmp(e.msg, "Not Found: %s (%d/%5.2f/%-4s|%lld|%zu|%x|%c|%%)") == 0);
+
+    char expect[256];
+    snprintf(expect, sizeof(expect), "Not Found: %s (%d/%5.2f/%-4s|%lld|%zu|%x|%c|%%)", 
+             "index.html", 7, 3.14159, "ab", -5LL, (size_t)42, 255u, 'z');
+    assert(strcmp(zerr_msg(e), expect) == 0);
+
+    // Rendered once, then cached.
+    assert(zerr_msg(e) == zerr_msg(e));
+
+    // Star width/precision.
+    zerr s = zerr_create(1, "[%*d|%.*s]", -4, 9, 3, "abcdef");
+    assert(strcmp(zerr_msg(s), "[9   |abc]") == 0);
+
+    // Resolved errors carry plain text.
+    zerr r = zerr_resolve(e);
+    assert(strcmp(r.msg, expect) == 0);
+
+    // Too many arguments to capture: the eager fallback must not clobber a
+    // previous-lap message that the new lap has not reached yet.
+    zerr_set_lazy_format(false);
+    zerr_arena_reset();
+    char fill[1024];
+    memset(fill, 'f', sizeof(fill) - 1);
+    fill[sizeof(fill) - 1] = '\0';
+    const char *base = zerr_create(1, "").msg;
+    size_t top = 1;
+    size_t at = ZERROR_ARENA_SIZE - 100;
+    for (; top + sizeof(fill) < at; top += sizeof(fill))
+    {
+        (void)zerr_create(1, "%s", fill);
+    }
+    (void)zerr_create(1, "%.*s", (int)(at - top - 1), fill);
+    zerr older = zerr_create(2, "older %d", 1);
+    assert(older.msg == base + at);
+    (void)zerr_create(1, "%s", fill);
+    top = sizeof(fill);
+    for (; top + sizeof(fill) < at - 100; top += sizeof(fill))
+    {
+        (void)zerr_create(1, "%s", fill);
+    }
+    (void)zerr_create(1, "%.*s", (int)(at - 100 - top - 1), fill);
+
+    zerr_set_lazy_format(true);
+    zerr wide = zerr_create(3, "%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d",
+                            1, 2, 3, 4, 5, 6, 7, 8, 9, 1, 2, 3, 4, 5, 6, 7, 8, 9, 1, 2, 3, 4, 5, 6, 7, 8, 9, 
+                            1, 2, 3, 4, 5, 6);
+    assert(strcmp(zerr_msg(wide), "123456789123456789123456789123456") == 0);
+    assert(strcmp(zerr_msg(older), "older 1") == 0);
+
+    zerr_set_lazy_format(false);
+    zerr plain = zerr_create(2, "eager %d", 1);
+    assert(strcmp(plain.msg, "eager 1") == 0);
+    assert(zerr_msg(plain) == plain.msg);
+
+    PASS();
+}
+
+void test_async_log(void) 
+{
+    TEST("Async Logging (Queue, Flush)");
+
+    const char *path = "tests/async_test.log";
+    remove(path);
+
+    // A sink added before switching to async mode keeps its id.
+    zlog_sink_config ring = { 0 };
+    ring.kind = ZLOG_SINK_RING;
+    ring.level = ZLOG_TRACE;
+    ring.format = ZLOG_FORMAT_TEXT;
+    int ring_id = zlog_add_sink(&ring);
+    assert(ring_id > 0);
+
+    zlog_init_async(path, ZLOG_INFO, 16, ZLOG_OVERFLOW_BLOCK);
+    for (int i = 0; i < 64; i++) 
+    {
+        log_debug("filtered %d", i);
+    }
+    log_info("async record %d", 1);
+    log_warn("async record %d", 2);
+    zlog_flush();
+
+    // Records are on disk after the flush barrier.
+    FILE *fp = fopen(path, "r");
+    assert(fp != NULL);
+    char line[256];
+    int found = 0;
+    while (fgets(line, sizeof(line), fp)) 
+    {
+        if (strstr(line, "async record")) found++;
+    }
+    fclose(fp);
+    assert(found == 2);
+    assert(zlog_dropped() == 0);
+    char buf[512];
+    zlog_ring_read(ring_id, buf, sizeof(buf));
+    assert(strstr(buf, "async record 1") && strstr(buf, "async record 2"));
+
+    zlog_shutdown();
+    remove(path);
+    
+    PASS();
+}
+
+void test_binary_log(void) 
+{
+    TEST("Binary Logging (Sites, Raw Args)");
+
+    const char *path = "tests/binary_test.zlog";
+    remove(path);
+
+    zlog_init_binary(path, ZLOG_INFO);
+    for (int i = 0; i < 3; i++) 
+    {
+        log_info("binary record %d of %s", i, "three");
+    }
+    zlog_shutdown();
+
+    FILE *fp = fopen(path, "rb");
+    assert(fp != NULL);
+    char buf[4096];
+    size_t n = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+    assert(n > 8 && memcmp(buf, "ZLOGBIN1", 8) == 0);
+
+    // The format string is written once per call site; records carry raw args.
+    int fmts = 0;
+    const char *fmt = "binary record %d of %s";
+    for (size_t i = 0; i + strlen(fmt) <= n; i++) 
+    {
+        if (memcmp(buf + i, fmt, strlen(fmt)) == 0) fmts++;
+    }
+    assert(fmts == 1);
+
+    int records = 0;
+    for (size_t i = 0; i + 5 <= n; i++) 
+    {
+        if (memcmp(buf + i, "three", 5) == 0) records++;
+    }
+    assert(records == 3);
+
+    remove(path);
+    PASS();
+}
+
+static int level_hits = 0;
+
+static int level_touch(void) 
+{
+    return ++level_hits;
+}
+
+void test_log_levels(void) 
+{
+    TEST("Log Levels (Filtered Args Unevaluated)");
+
+    // Filtered at runtime: the macro checks the level before building the call.
+    zlog_set_level(ZLOG_WARN);
+    log_info("filtered %d", level_touch());
+    log_debug("filtered %d", level_touch());
+    assert(level_hits == 0);
+    assert(ZLOG_ENABLED(ZLOG_WARN) && !ZLOG_ENABLED(ZLOG_INFO));
+
+    // Filtered at compile time: even the lowest runtime level lets nothing through.
+#undef ZLOG_COMPILE_LEVEL
+#define ZLOG_COMPILE_LEVEL ZLOG_FATAL
+    zlog_set_level(ZLOG_TRACE);
+    log_trace("eliminated %d", level_touch());
+    log_error("eliminated %d", level_touch());
+    assert(level_hits == 0);
+    assert(!ZLOG_ENABLED(ZLOG_ERROR) && ZLOG_ENABLED(ZLOG_FATAL));
+#undef ZLOG_COMPILE_LEVEL
+#define ZLOG_COMPILE_LEVEL ZLOG_TRACE
+
+    zlog_set_level(ZLOG_INFO);
+    PASS();
+}
+
+void test_timestamps(void) 
+{
+    TEST("Log Timestamps (UTC, Epoch ns)");
+
+    const char *path = "tests/time_test.log";
+    remove(path);
+
+    zlog_init(path, ZLOG_INFO);
+    zlog_set_time_mode(ZLOG_TIME_UTC);
+    log_info("utc stamp");
+    zlog_set_time_mode(ZLOG_TIME_EPOCH_NS);
+    log_info("epoch stamp");
+    zlog_set_time_mode(ZLOG_TIME_LOCAL);
+    zlog_shutdown();
+
+    FILE *fp = fopen(path, "r");
+    assert(fp != NULL);
+    char buf[1024];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[n] = '\0';
+
+    // "[YYYY-MM-DD HH:MM:SS.mmmZ] INFO : utc stamp"
+    const char *utc = strstr(buf, "] INFO : utc stamp");
+    assert(utc != NULL && utc - buf >= 24);
+    const char *stamp = utc - 24;
+    assert(stamp[-1] == '[' && stamp[4] == '-' && stamp[10] == ' ' && stamp[19] == '.' && stamp[23] == 'Z');
+    char year[5];
+    time_t now = time(NULL);
+    strftime(year, sizeof(year), "%Y", gmtime(&now));
+    assert(memcmp(stamp, year, 4) == 0);
+
+    const char *epoch = strstr(buf, "] INFO : epoch stamp");
+    assert(epoch != NULL);
+    const char *start = epoch;
+    while (start > buf && start[-1] != '[') start--;
+    unsigned long long ns = strtoull(start, NULL, 10);
+    assert(ns / 1000000000ULL + 5 >= (unsigned long long)now && ns / 1000000000ULL <= (unsigned long long)now + 5);
+
+    remove(path);
+    PASS();
+}
+
+static int sink_calls = 0;
+
+static void sink_count(const zlog_entry *entry, const char *text, size_t len, void *user) 
+{
+    (void)user;
+    sink_calls++;
+    assert(strlen(text) == len);
+    assert(strstr(text, entry->msg) != NULL);
+}
+
+void test_sinks(void) 
+{
+    TEST("Log Sinks (Ring, Callback, Levels)");
+
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_NONE);
+
+    zlog_sink_config ring = { 0 };
+    ring.kind = ZLOG_SINK_RING;
+    ring.level = ZLOG_WARN;
+    ring.format = ZLOG_FORMAT_TEXT;
+    ring.size = 256;
+    int ring_id = zlog_add_sink(&ring);
+    assert(ring_id > 0);
+
+    zlog_sink_config cb = { 0 };
+    cb.kind = ZLOG_SINK_CALLBACK;
+    cb.level = ZLOG_TRACE;
+    cb.format = ZLOG_FORMAT_TEXT;
+    cb.fn = sink_count;
+    int cb_id = zlog_add_sink(&cb);
+    assert(cb_id > 0 && cb_id != ring_id);
+
+    // Binary output is only for files.
+    zlog_sink_config bad = { 0 };
+    bad.kind = ZLOG_SINK_RING;
+    bad.format = ZLOG_FORMAT_BINARY;
+    assert(zlog_add_sink(&bad) == -1);
+
+    log_info("only the callback sees this");
+    log_warn("both see warning %d", 1);
+    assert(sink_calls == 2);
+
+    char buf[512];
+    size_t n = zlog_ring_read(ring_id, buf, sizeof(buf));
+    assert(n == strlen(buf));
+    assert(strstr(buf, "both see warning 1") != NULL);
+    assert(strstr(buf, "only the callback") == NULL);
+
+    // The ring keeps the newest bytes once it wraps.
+    for (int i = 0; i < 20; i++) 
+    {
+        log_warn("wrap %d", i);
+    }
+    n = zlog_ring_read(ring_id, buf, sizeof(buf));
+    assert(n == 256 && strstr(buf, "wrap 19") != NULL && strstr(buf, "wrap 0\n") == NULL);
+
+    zlog_remove_sink(cb_id);
+    log_warn("after removal");
+    assert(sink_calls == 22);
+
+    zlog_shutdown();
+    PASS();
+}
+
+static int rotations = 0;
+
+static void rotated_file(const char *path, void *user) 
+{
+    assert(strcmp(path, "tests/rotate_test.log.1") == 0);
+    assert(user == &rotations);
+    rotations++;
+}
+
+static long file_size(const char *path) 
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+    fseek(fp, 0, SEEK_END);
+    long n = ftell(fp);
+    fclose(fp);
+    return n;
+}
+
+void test_rotation(void) 
+{
+    TEST("Log Rotation (Size, Retention, Batching)");
+
+    const char *names[] = { "tests/rotate_test.log", "tests/rotate_test.log.1", 
+                            "tests/rotate_test.log.2", "tests/rotate_test.log.3" };
+    for (int i = 0; i < 4; i++) remove(names[i]);
+
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_NONE);
+    zlog_sink_config cfg = { 0 };
+    cfg.kind = ZLOG_SINK_ROTATING;
+    cfg.level = ZLOG_TRACE;
+    cfg.format = ZLOG_FORMAT_TEXT;
+    cfg.path = names[0];
+    cfg.size = 200;
+    cfg.keep = 2;
+    cfg.flush_ms = 60000;
+    cfg.rotated = rotated_file;
+    cfg.user = &rotations;
+    int id = zlog_add_sink(&cfg);
+    assert(id > 0);
+
+    // Info lines wait in the buffer; errors go straight to disk.
+    log_info("buffered line");
+    assert(file_size(names[0]) == 0);
+    log_error("urgent line");
+    assert(file_size(names[0]) > 0);
+
+    for (int i = 0; i < 10; i++) 
+    {
+        log_info("filler line %d", i);
+    }
+    zlog_flush();
+    assert(rotations >= 3);
+    assert(file_size(names[0]) > 0 && file_size(names[0]) <= 200);
+    assert(file_size(names[1]) > 0 && file_size(names[1]) <= 200);
+    assert(file_size(names[2]) > 0);
+    assert(file_size(names[3]) == -1);
+
+    zlog_shutdown();
+    for (int i = 0; i < 4; i++) remove(names[i]);
+    PASS();
+}
+
+void test_structured_log(void) 
+{
+    TEST("Structured Logging (JSON, logfmt)");
+
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_NONE);
+    zlog_sink_config cfg = { 0 };
+    cfg.kind = ZLOG_SINK_RING;
+    cfg.level = ZLOG_TRACE;
+    cfg.format = ZLOG_FORMAT_JSON;
+    int json = zlog_add_sink(&cfg);
+    cfg.format = ZLOG_FORMAT_LOGFMT;
+    int logfmt = zlog_add_sink(&cfg);
+    assert(json > 0 && logfmt > 0);
+
+    log_info_kv("request done", ZKV_INT("status", 200), ZKV_STR("path", "/a \"b\""), ZKV_BOOL("ok", 1));
+
+    char buf[1024];
+    zlog_ring_read(json, buf, sizeof(buf));
+    assert(strstr(buf, "\"level\":\"info\",\"msg\":\"request done\"") != NULL);
+    assert(strstr(buf, "\"status\":200,\"path\":\"/a \\\"b\\\"\",\"ok\":true}") != NULL);
+    zlog_ring_read(logfmt, buf, sizeof(buf));
+    assert(strstr(buf, "level=info msg=\"request done\"") != NULL);
+    assert(strstr(buf, "status=200 path=\"/a \\\"b\\\"\" ok=true") != NULL);
+
+    // Errors carry their code and source expression as fields.
+    zerr_print(zerr_with_src(zerr_create(404, "missing"), "lookup(id)"));
+    zlog_ring_read(json, buf, sizeof(buf));
+    assert(strstr(buf, "\"msg\":\"missing\"") != NULL);
+    assert(strstr(buf, "\"code\":404,\"source\":\"lookup(id)\"") != NULL);
+
+    zlog_shutdown();
+    PASS();
+}
+
+static size_t count_of(const char *hay, const char *needle)
+{
+    size_t n = 0;
+    for (const char *p = strstr(hay, needle); p; p = strstr(p + 1, needle))
+    {
+        n++;
+    }
+    return n;
+}
+
+#define NET_ERRORS(X)                                                       \
+    X(NET_TIMEOUT, "Connection timed out", ZERR_SEV_WARN,  true)            \
+    X(NET_REFUSED, "Connection refused",   ZERR_SEV_ERROR, true)            \
+    X(NET_BAD_TLS, "TLS handshake failed", ZERR_SEV_FATAL, false)
+
+ZERR_DEFINE_DOMAIN(net, 3, NET_ERRORS);
+
+void test_code_registry(void)
+{
+    TEST("Error Code Registry");
+
+    assert(NET_TIMEOUT == 3 * ZERR_DOMAIN_SPAN);
+    assert(NET_BAD_TLS == NET_TIMEOUT + 2);
+
+    // Unknown until registered.
+    assert(zerr_code_name(NET_REFUSED) == NULL);
+    assert(zerr_domain_register(&zerr_domain_net));
+    assert(zerr_domain_register(&zerr_domain_net));
+
+    // Another domain cannot take the id; ids must be in range.
+    zerr_domain other = { "other", 3, zerr_domain_net.codes, 1 };
+    assert(!zerr_domain_register(&other));
+    other.id = ZERR_DOMAIN_MAX;
+    assert(!zerr_domain_register(&other));
+
+    assert(strcmp(zerr_code_name(NET_REFUSED), "NET_REFUSED") == 0);
+    assert(strcmp(zerr_code_lookup(NET_TIMEOUT)->text, "Connection timed out") == 0);
+    assert(zerr_code_severity(NET_BAD_TLS) == ZERR_SEV_FATAL);
+    assert(zerr_code_retryable(NET_TIMEOUT) && !zerr_code_retryable(NET_BAD_TLS));
+    assert(zerr_code_lookup(NET_BAD_TLS + 1) == NULL);
+    assert(zerr_code_lookup(404) == NULL);
+
+    // Built-in codes and categories.
+    assert(strcmp(zerr_code_name(Z_ENOMEM), "Z_ENOMEM") == 0);
+    assert(zerr_code_domain(NET_REFUSED) == 3);
+    zerr e = zerr_create(NET_REFUSED, "Refused by %s", "db1");
+    assert(ZERR_IN_DOMAIN(e.code, net));
+    assert(!ZERR_IN_DOMAIN(404, net));
+
+    // The name reaches the structured sinks.
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_NONE);
+    zlog_sink_config cfg = { 0 };
+    cfg.kind = ZLOG_SINK_RING;
+    cfg.level = ZLOG_TRACE;
+    cfg.format = ZLOG_FORMAT_JSON;
+    int id = zlog_add_sink(&cfg);
+    zerr_print(e);
+    char buf[1024];
+    zlog_ring_read(id, buf, sizeof(buf));
+    assert(strstr(buf, "\"name\":\"NET_REFUSED\"") != NULL);
+    zlog_remove_sink(id);
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_TRACE);
+
+    PASS();
+}
+
+static void *owned_worker(void *arg)
+{
+    zerr root = zerr_create(5, "disk %d failed", 3);
+    root = zerr_add_trace(root, "read_block", "disk.c", 12);
+    zerr top = zerr_wrap_code(root, 500, "job %d aborted", 42);
+    zerr_owned *o = zerr_clone(top);
+
+    // The worker's arena and pools are churned before the coordinator looks.
+    for (int i = 0; i < 4096; i++)
+    {
+        (void)zerr_wrap(zerr_create(1, "filler message number %d", i), "churn");
+    }
+    *(zerr_owned **)arg = o;
+    return NULL;
+}
+
+void test_owned_errors(void)
+{
+    TEST("Owned Errors (clone across threads)");
+
+    zerr_owned *o = NULL;
+    pthread_t t;
+    assert(0 == pthread_create(&t, NULL, owned_worker, &o));
+    assert(0 == pthread_join(t, NULL));
+    assert(o != NULL);
+    assert(500 == zerr_owned_code(o));
+    assert(strcmp(zerr_owned_msg(o), "job 42 aborted") == 0);
+
+    // Rebuilt on this thread, with its trace and cause chain.
+    zerr e = zerr_owned_get(o);
+    assert(500 == e.code && strcmp(zerr_func(e), "owned_worker") == 0);
+    zerr root = zerr_root_cause(e);
+    assert(5 == root.code);
+    assert(strcmp(zerr_msg(root), "disk 3 failed") == 0);
+    zerr_frame f[2];
+    assert(1 == zerr_trace(root, f, 2) && strcmp(f[0].func, "read_block") == 0);
+    char text[64];
+    zerr_chain_text(e, text, sizeof(text));
+    assert(strcmp(text, "job 42 aborted: disk 3 failed") == 0);
+    zerr_free(o);
+    zerr_free(NULL);
+
+    // Caller-provided memory.
+    zerr w = zerr_wrap(zerr_create(7, "inner"), "outer");
+    size_t need = zerr_clone_size(w);
+    char mem[512];
+    assert(need <= sizeof(mem));
+    assert(NULL == zerr_clone_into(w, mem, need - 1));
+    zerr_owned *in = zerr_clone_into(w, mem, sizeof(mem));
+    assert(in == (zerr_owned *)mem && 7 == zerr_owned_code(in));
+    assert(strcmp(zerr_msg(zerr_cause(zerr_owned_get(in))), "inner") == 0);
+
+    PASS();
+}
+
+static void *pool_worker(void *arg)
+{
+    zerr_owned *o = zerr_clone(zerr_create(1, "worker"));
+    zerr_free(o);
+    *(int *)arg = (o != NULL);
+    return NULL;
+}
+
+void test_owned_pool(void)
+{
+    TEST("Owned Error Pool (classes, limit)");
+
+    zerr_pool_trim();
+    zerr_pool_stat st;
+    zerr_pool_stats(&st);
+    assert(0 == st.reserved_bytes && 0 == st.classes[0].idle);
+    assert(128 == st.classes[0].size && 4096 == st.classes[ZERR_POOL_CLASSES - 1].size);
+    unsigned long long sys = st.sys_allocs;
+
+    // Steady state: one block goes back and forth through the thread cache.
+    zerr e = zerr_wrap(zerr_create(7, "inner"), "outer");
+    int c = 0;
+    while (st.classes[c].size < zerr_clone_size(e))
+    {
+        c++;
+    }
+    for (int i = 0; i < 1000; i++)
+    {
+        zerr_free(zerr_clone(e));
+    }
+    zerr_pool_stats(&st);
+    assert(sys + 1 == st.sys_allocs);
+    assert(st.reserved_bytes == st.classes[c].size);
+
+    // A full cache spills to the global list; another thread refills from it.
+    static zerr_owned *held[4096];
+    for (int i = 0; i < 3 * ZERROR_POOL_CACHE; i++)
+    {
+        held[i] = zerr_clone(e);
+    }
+    for (int i = 0; i < 3 * ZERROR_POOL_CACHE; i++)
+    {
+        zerr_free(held[i]);
+    }
+    zerr_pool_stats(&st);
+    assert(st.spills > 0 && st.classes[c].idle > 0);
+    assert(st.classes[c].peak == 3 * ZERROR_POOL_CACHE);
+    sys = st.sys_allocs;
+    unsigned long long refills = st.refills;
+    int ok = 0;
+    pthread_t t;
+    assert(0 == pthread_create(&t, NULL, pool_worker, &ok));
+    assert(0 == pthread_join(t, NULL));
+    zerr_pool_stats(&st);
+    assert(ok && sys == st.sys_allocs && refills + 1 == st.refills);
+
+    // Blocks larger than the biggest class bypass the lists.
+    char big[1500];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    zerr b = zerr_wrap(zerr_wrap(zerr_create(1, "%s", big), "%s", big), "%s", big);
+    zerr_owned *ob = zerr_clone(b);
+    zerr_pool_stats(&st);
+    assert(ob && 1 == st.oversize);
+    zerr_free(ob);
+
+    // The limit bounds what an error storm can hold.
+    int n = 0;
+    while (n < 4096 && NULL != (held[n] = zerr_clone(e)))
+    {
+        n++;
+    }
+    zerr_pool_stats(&st);
+    assert(n < 4096 && st.denied > 0);
+    assert(st.reserved_bytes <= st.limit_bytes && st.peak_bytes <= st.limit_bytes);
+    for (int i = 0; i < n; i++)
+    {
+        zerr_free(held[i]);
+    }
+    zerr_pool_trim();
+    zerr_pool_stats(&st);
+    assert(0 == st.reserved_bytes && 0 == st.classes[c].reserved);
+
+    PASS();
+}
+
+void test_flight_recorder(void)
+{
+    TEST("Flight Recorder (replay on error)");
+
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_NONE);
+    zlog_sink_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.kind = ZLOG_SINK_RING;
+    cfg.level = ZLOG_TRACE;
+    cfg.format = ZLOG_FORMAT_LOGFMT;
+    int ring = zlog_add_sink(&cfg);
+    assert(ring > 0);
+
+    zlog_set_level(ZLOG_WARN);
+    zlog_set_flight_level(ZLOG_TRACE);
+    assert(ZLOG_ENABLED(ZLOG_DEBUG));
+    zlog_flight_clear();
+
+    log_debug("opening %s (attempt %d)", "users.db", 2);
+    log_info_kv("cache miss", ZKV_STR("key", "user:42"), ZKV_INT("ttl", 30));
+    log_warn("slow query: %d ms", 950);
+
+    char buf[8192];
+    zlog_ring_read(ring, buf, sizeof(buf));
+    assert(NULL == strstr(buf, "users.db"));
+    assert(1 == count_of(buf, "slow query"));
+
+    // An error report brings the filtered context along, once.
+    zerr_print(zerr_create(500, "query failed"));
+    zlog_ring_read(ring, buf, sizeof(buf));
+    assert(strstr(buf, "msg=\"2 earlier records from this thread\"") != NULL);
+    assert(strstr(buf, "level=debug msg=\"opening users.db (attempt 2)\"") != NULL);
+    assert(strstr(buf, "msg=\"cache miss\"") != NULL && strstr(buf, "key=user:42 ttl=30") != NULL);
+    assert(1 == count_of(buf, "slow query"));
+    assert(strstr(buf, "users.db") < strstr(buf, "query failed"));
+
+    zerr_print(zerr_create(500, "again"));
+    zlog_ring_read(ring, buf, sizeof(buf));
+    assert(1 == count_of(buf, "users.db"));
+
+    // Manual trigger.
+    log_trace("tick %d", 1);
+    zlog_flight_dump();
+    zlog_ring_read(ring, buf, sizeof(buf));
+    assert(strstr(buf, "msg=\"tick 1\"") != NULL);
+
+    // A record the global rate limit dropped was never shown, so it is replayed.
+    zlog_set_rate_limit(1);
+    for (int i = 0; i < 2; i++)
+    {
+        log_warn("limited %d", i);
+    }
+    zlog_set_rate_limit(0);
+    zlog_ring_read(ring, buf, sizeof(buf));
+    assert(1 == count_of(buf, "limited 0") && NULL == strstr(buf, "limited 1"));
+    zlog_flight_dump();
+    zlog_ring_read(ring, buf, sizeof(buf));
+    assert(1 == count_of(buf, "limited 0") && 1 == count_of(buf, "limited 1"));
+
+    zlog_set_flight_level(ZLOG_NONE);
+    zlog_set_level(ZLOG_INFO);
+    assert(!ZLOG_ENABLED(ZLOG_DEBUG));
+    zlog_shutdown();
+    PASS();
+}
+
+void test_rate_limit(void) 
+{
+    TEST("Log Rate Limiting & Sampling");
+
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_NONE);
+    zlog_sink_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.kind = ZLOG_SINK_RING;
+    cfg.level = ZLOG_TRACE;
+    cfg.format = ZLOG_FORMAT_TEXT;
+    int ring = zlog_add_sink(&cfg);
+    assert(ring > 0);
+
+    for (int i = 0; i < 10; i++)
+    {
+        log_warn_every(4, "sampled %d", i);
+    }
+    for (int i = 0; i < 100; i++)
+    {
+        log_error_ratelimit(5, "burst %d", i);
+    }
+    zlog_set_rate_limit(2);
+    for (int i = 0; i < 10; i++)
+    {
+        log_info("global %d", i);
+    }
+    zlog_set_rate_limit(0);
+    log_info("unlimited again");
+    // Extreme rates are clamped: one call per eon is still one call, then nothing.
+    for (int i = 0; i < 3; i++)
+    {
+        log_info_ratelimit(1e-15, "tiny %d", i);
+    }
+
+    char buf[8192];
+    zlog_ring_read(ring, buf, sizeof(buf));
+    assert(strstr(buf, "sampled 0") && strstr(buf, "sampled 4") && strstr(buf, "sampled 8"));
+    assert(!strstr(buf, "sampled 1") && !strstr(buf, "sampled 9"));
+    // The second sampled call reports the three it skipped; the third is inside the summary interval.
+    const char *summary = strstr(buf, "suppressed 3 similar messages");
+    assert(summary && !strstr(summary + 1, "suppressed"));
+    assert(strstr(buf, "burst 4") && !strstr(buf, "burst 5"));
+    assert(strstr(buf, "global 1") && !strstr(buf, "global 2"));
+    assert(strstr(buf, "unlimited again"));
+    assert(strstr(buf, "tiny 0") && !strstr(buf, "tiny 1"));
+
+    zlog_shutdown();
     PASS();
 }
 
 // Extension test (GCC/Clang only).
 #if defined(__GNUC__) || defined(__clang__)
+static int stats_leaf_line;
+
+zres stats_leaf(void) 
+{
+    stats_leaf_line = __LINE__ + 1;
+    return zres_err(zerr_create(418, "I'm a teapot"));
+}
+
+zres stats_mid(void) 
+{
+    check(stats_leaf());
+    return zres_ok();
+}
+
+void test_error_stats(void) 
+{
+    TEST("Error Stats (per site, Prometheus)");
+
+    zerr_stats_reset();
+    zres r = zres_ok();
+    for (int i = 0; i < 3; i++)
+    {
+        r = stats_mid();
+        assert(!r.is_ok);
+    }
+    zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_NONE);
+    zerr_print(r.err);
+    zlog_shutdown();
+
+    zerr_stat stats[64];
+    size_t n = zerr_stats_snapshot(stats, 64);
+    const zerr_stat *teapot = NULL;
+    for (size_t i = 0; i < n && i < 64; i++)
+    {
+        if (418 == stats[i].code)
+        {
+            teapot = &stats[i];
+        }
+    }
+    assert(teapot != NULL);
+    assert(teapot->line == stats_leaf_line);
+    assert(teapot->created == 3 && teapot->propagated == 3 && teapot->printed == 1);
+
+    char buf[16384];
+    size_t len = zerr_stats_prometheus(buf, sizeof(buf));
+    assert(len < sizeof(buf) && len == strlen(buf));
+    assert(zerr_stats_prometheus(NULL, 0) == len);
+    assert(strstr(buf, "# TYPE zerror_errors_created_total counter\n") != NULL);
+    char want[256];
+    snprintf(want, sizeof(want), "zerror_errors_propagated_total{code=\"418\",file=\"%s\",line=\"%d\"} 3\n", 
+             __FILE__, stats_leaf_line);
+    assert(strstr(buf, want) != NULL);
+    PASS();
+}
+
+DEFINE_RESULT_SLIM(int, SlimInt)
+
+static int slim_leaf_line;
+
+SlimInt slim_leaf(int x)
+{
+    slim_leaf_line = __LINE__ + 1;
+    if (x < 0) return SlimInt_err(zerr_create(422, "Bad value %d", x));
+    return SlimInt_ok(x);
+}
+
+SlimInt slim_double(int x)
+{
+    int v = try_slim(slim_leaf(x));
+    return SlimInt_ok(v * 2);
+}
+
+ResInt slim_to_typed(int x)
+{
+    int v = try_slim_into(ResInt, slim_double(x));
+    return ResInt_ok(v + 1);
+}
+
+zres slim_to_zres(int x)
+{
+    check_slim(slim_double(x));
+    return zres_ok();
+}
+
+SlimInt slim_from_zres(void)
+{
+    check_into(SlimInt, helper_fail());
+    return SlimInt_ok(0);
+}
+
+void test_slim_result(void)
+{
+    TEST("Slim Results (register-sized)");
+
+    assert(sizeof(SlimInt) <= 2 * sizeof(void *));
+
+    SlimInt ok = slim_double(21);
+    assert(ok.is_ok && 42 == ok.val);
+
+    // try_slim hands the same parked error up; only the first source is kept.
+    SlimInt leaf = slim_leaf(-1);
+    SlimInt bad = slim_double(-1);
+    assert(!bad.is_ok && 422 == bad.ref.code);
+    assert(leaf.ref.id + 1 == bad.ref.id);
+    zerr e = zerr_ref_get(bad.ref);
+    assert(422 == e.code && e.line == slim_leaf_line);
+    assert(strcmp(e.msg, "Bad value -1") == 0);
+    assert(strcmp(e.source, "slim_leaf(x)") == 0);
+
+    // Interop with zres and DEFINE_RESULT types, both ways.
+    ResInt typed = slim_to_typed(-2);
+    assert(!typed.is_ok && 422 == typed.err.code);
+    assert(strcmp(typed.err.source, "slim_leaf(x)") == 0);
+    zres r = slim_to_zres(-3);
+    assert(!r.is_ok && strcmp(r.err.msg, "Bad value -3") == 0);
+    assert(slim_to_zres(3).is_ok);
+    SlimInt from = slim_from_zres();
+    assert(!from.is_ok && 500 == zerr_ref_get(from.ref).code);
+
+    // Once its slot is reused the handle still knows the code.
+    for (int i = 0; i < ZERROR_REF_POOL; i++)
+    {
+        (void)zerr_ref_new(zerr_create(1, "churn"));
+    }
+    e = zerr_ref_get(bad.ref);
+    assert(422 == e.code);
+    assert(strcmp(zerr_msg(e), "(expired error message)") == 0);
+    PASS();
+}
+
+void test_crash_report(void)
+{
+    TEST("Crash Report (fatal signal)");
+
+    int fds[2];
+    assert(0 == pipe(fds));
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (0 == pid)
+    {
+        close(fds[0]);
+        zlog_set_sink_level(ZLOG_CONSOLE_SINK, ZLOG_NONE);
+        zlog_sink_config cfg;
+        memset(&cfg, 0, sizeof(cfg));
+        cfg.kind = ZLOG_SINK_RING;
+        cfg.level = ZLOG_TRACE;
+        cfg.format = ZLOG_FORMAT_TEXT;
+        int ring = zlog_add_sink(&cfg);
+        log_info("too old to report");
+        for (int i = 0; i < 3; i++)
+        {
+            log_warn("step %d of 3", i);
+        }
+
+        zerr_crash_config crash = { fds[1], ring, 2 };
+        if (!zerr_crash_install(&crash))
+        {
+            _exit(3);
+        }
+        zerr e = zerr_create(503, "Backend %s down", "db");
+        (void)e;
+        raise(SIGSEGV);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    char buf[16384];
+    size_t len = 0;
+    ssize_t n;
+    while ((n = read(fds[0], buf + len, sizeof(buf) - 1 - len)) > 0)
+    {
+        len += (size_t)n;
+    }
+    buf[len] = '\0';
+    close(fds[0]);
+    int status = 0;
+    assert(waitpid(pid, &status, 0) == pid);
+
+    // Killed by the signal, or by a sanitizer's handler that we chained to.
+    assert(WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) != 0 && WEXITSTATUS(status) != 3));
+    assert(strstr(buf, "*** zerror crash report: SIGSEGV (11)") != NULL);
+    assert(strstr(buf, "[503] Backend db down") != NULL);
+    assert(strstr(buf, "step 1 of 3") != NULL && strstr(buf, "step 2 of 3") != NULL);
+    assert(NULL == strstr(buf, "step 0 of 3"));
+    assert(strstr(buf, "Backtrace:\n") != NULL);
+    assert(strstr(buf, "*** end of crash report ***") != NULL);
+    PASS();
+}
+
 void test_defer(void) 
 {
     TEST("Defer (Cleanup)");
@@ -147,8 +1203,26 @@ int main(void)
     test_flow_macros();
     test_wrapping();
     test_validation();
+    test_arena();
+    test_trace_frames();
+    test_lazy_format();
+    test_async_log();
+    test_binary_log();
+    test_log_levels();
+    test_timestamps();
+    test_sinks();
+    test_rotation();
+    test_structured_log();
+    test_rate_limit();
+    test_flight_recorder();
+    test_code_registry();
+    test_owned_errors();
+    test_owned_pool();
 
 #if defined(__GNUC__) || defined(__clang__)
+    test_error_stats();
+    test_slim_result();
+    test_crash_report();
     test_defer();
 #endif
 
@@ -0,0 +1,245 @@
+
+/*
+ * zlog_decode — Turns a binary log written by zlog_init_binary() back into
+ * the text layout of the regular file sink.
+ *
+ * Usage: zlog_decode <input.zlog> [output.txt]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ZERROR_IMPLEMENTATION
+#include "zerror.h"
+
+typedef struct
+{
+    int level;
+    int line;
+    char *label;
+    char *file;
+    char *func;
+    char *fmt;
+} site_t;
+
+// Site ids count up from 1 in each file; an id beyond this is corrupt input.
+#define SITE_ID_MAX (1u << 24)
+
+static site_t *sites = NULL;
+static unsigned site_cap = 0;
+
+// Fields from a 'K' record, waiting for the 'R' record they belong to.
+static unsigned char kv_blob[65536];
+static unsigned short kv_size = 0;
+static unsigned char kv_count = 0;
+static unsigned char kv_shown = 0;
+
+static int read_bytes(FILE *in, void *dst, size_t n)
+{
+    return fread(dst, 1, n, in) == n;
+}
+
+static char *read_str(FILE *in)
+{
+    unsigned short n;
+    if (!read_bytes(in, &n, sizeof(n)))
+    {
+        return NULL;
+    }
+    char *s = (char *)malloc((size_t)n + 1);
+    if (!s || !read_bytes(in, s, n))
+    {
+        free(s);
+        return NULL;
+    }
+    s[n] = '\0';
+    return s;
+}
+
+static void reset_sites(void)
+{
+    for (unsigned i = 0; i < site_cap; i++)
+    {
+        free(sites[i].label);
+        free(sites[i].file);
+        free(sites[i].func);
+        free(sites[i].fmt);
+    }
+    free(sites);
+    sites = NULL;
+    site_cap = 0;
+}
+
+static int read_header(FILE *in)
+{
+    char magic[8];
+    unsigned char info[2];
+    unsigned probe = 1;
+    if (!read_bytes(in, magic, sizeof(magic)) || memcmp(magic, ZLOG_BIN_MAGIC, 8) != 0)
+    {
+        fprintf(stderr, "zlog_decode: not a binary zlog file\n");
+        return 0;
+    }
+    if (!read_bytes(in, info, sizeof(info)))
+    {
+        return 0;
+    }
+    if (info[0] != sizeof(long double) || info[1] != (unsigned char)(1 == *(unsigned char *)&probe))
+    {
+        fprintf(stderr, "zlog_decode: file was written on an incompatible platform\n");
+        return 0;
+    }
+    reset_sites();
+    return 1;
+}
+
+static int read_site(FILE *in)
+{
+    unsigned id;
+    unsigned char level;
+    int line;
+    if (!read_bytes(in, &id, sizeof(id)) || !read_bytes(in, &level, sizeof(level)) || 
+        !read_bytes(in, &line, sizeof(line)) || 0 == id || id > SITE_ID_MAX)
+    {
+        return 0;
+    }
+    if (id >= site_cap)
+    {
+        size_t cap = site_cap ? site_cap : 64;
+        while (cap <= id)
+        {
+            cap *= 2;
+        }
+        site_t *grown = (site_t *)realloc(sites, cap * sizeof(site_t));
+        if (!grown)
+        {
+            return 0;
+        }
+        memset(grown + site_cap, 0, (cap - site_cap) * sizeof(site_t));
+        sites = grown;
+        site_cap = (unsigned)cap;
+    }
+    // A repeated id replaces the site.
+    site_t *s = &sites[id];
+    free(s->label);
+    free(s->file);
+    free(s->func);
+    free(s->fmt);
+    s->level = level;
+    s->line = line;
+    s->label = read_str(in);
+    s->file = read_str(in);
+    s->func = read_str(in);
+    s->fmt = read_str(in);
+    return s->label && s->file && s->func && s->fmt;
+}
+
+static int read_fields(FILE *in)
+{
+    return read_bytes(in, &kv_count, sizeof(kv_count)) && read_bytes(in, &kv_shown, sizeof(kv_shown)) &&
+           read_bytes(in, &kv_size, sizeof(kv_size)) && read_bytes(in, kv_blob, kv_size);
+}
+
+static int read_record(FILE *in, FILE *out)
+{
+    unsigned long long ts;
+    unsigned char level;
+    unsigned id;
+    unsigned short size;
+    unsigned char blob[65536];
+    if (!read_bytes(in, &ts, sizeof(ts)) || !read_bytes(in, &level, sizeof(level)) ||
+        !read_bytes(in, &id, sizeof(id)) || !read_bytes(in, &size, sizeof(size)) ||
+        !read_bytes(in, blob, size))
+    {
+        return 0;
+    }
+    char *extra = read_str(in);
+    if (!extra)
+    {
+        return 0;
+    }
+
+    char time_buf[64];
+    time_t secs = (time_t)(ts / 1000000000ULL);
+    struct tm *tm = localtime(&secs);
+    if (!tm || !strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", tm))
+    {
+        snprintf(time_buf, sizeof(time_buf), "%llu", ts);
+    }
+
+    if (id < site_cap && sites[id].fmt)
+    {
+        const site_t *s = &sites[id];
+        char msg[ZLOG__LINE_MAX];
+        size_t n = zerr__render(s->fmt, blob, size, msg, sizeof(msg));
+        if (kv_count && kv_shown)
+        {
+            zkv fields[ZLOG_KV_MAX];
+            size_t count = zlog__kv_unpack(kv_blob, kv_size, kv_count, fields, ZLOG_KV_MAX);
+            zlog__buf b = { msg, n < sizeof(msg) ? n : sizeof(msg) - 1, sizeof(msg) };
+            zlog__buf_pairs(&b, fields, count);
+        }
+        fprintf(out, "\n[%s] %s: %s\n", time_buf, s->label, msg);
+        fprintf(out, "    at %s (%s:%d)%s\n", s->func[0] ? s->func : "?", s->file, s->line, extra);
+    }
+    else
+    {
+        fprintf(out, "\n[%s] level %u: <unknown call site %u>\n", time_buf, level, id);
+    }
+    free(extra);
+    kv_count = 0;
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <input.zlog> [output.txt]\n", argv[0]);
+        return 2;
+    }
+    FILE *in = fopen(argv[1], "rb");
+    if (!in)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    FILE *out = (argc > 2) ? fopen(argv[2], "w") : stdout;
+    if (!out)
+    {
+        perror(argv[2]);
+        fclose(in);
+        return 1;
+    }
+
+    int ok = read_header(in);
+    int tag;
+    while (ok && (tag = fgetc(in)) != EOF)
+    {
+        switch (tag)
+        {
+            case 'S': ok = read_site(in); break;
+            case 'K': ok = read_fields(in); break;
+            case 'R': ok = read_record(in, out); break;
+            case 'Z':
+                ungetc(tag, in);
+                ok = read_header(in);
+                break;
+            default: ok = 0; break;
+        }
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "zlog_decode: truncated or corrupt input\n");
+    }
+
+    reset_sites();
+    fclose(in);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return ok ? 0 : 1;
+}